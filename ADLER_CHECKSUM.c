@@ -0,0 +1,232 @@
+//
+// Created by Attila on 12/14/2025.
+//
+
+#include "ADLER_CHECKSUM.h"
+
+// The most bytes that can be summed before s2 may overflow 32 bits: 255n(n+1)/2 + (n+1)(MODULUS-1) <= 2^32-1.
+// Both sums are reduced only once per ADLER32_NMAX bytes instead of once per byte.
+#define ADLER32_NMAX 5552
+
+/**
+ * @brief Scalar Adler-32 with deferred modulo, 16 bytes per unrolled step.
+ */
+static uint32_t adler32_scalar(uint32_t adler, const uint8_t* buf, size_t length) {
+    uint32_t s1 = adler & 0xFFFF;
+    uint32_t s2 = adler >> 16;
+
+    while (length > 0) {
+        size_t n = length < ADLER32_NMAX ? length : ADLER32_NMAX;
+        length -= n;
+        for (; n >= 16; n -= 16, buf += 16) {
+            for (int i = 0; i < 16; i++) {
+                s1 += buf[i];
+                s2 += s1;
+            }
+        }
+        for (; n > 0; n--) {
+            s1 += *buf++;
+            s2 += s1;
+        }
+        s1 %= ADLER32_MODULUS;
+        s2 %= ADLER32_MODULUS;
+    }
+    return s2 << 16 | s1;
+}
+
+// The vector kernels are x86 only and compiled with per-function target attributes, the rest of the program keeps the
+// baseline instruction set.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(ADLER32_DISABLE_SIMD)
+#define ADLER32_HAS_SIMD 1
+#include <immintrin.h>
+
+// Both kernels consume 32 byte blocks. Per block, s2 grows by 32 * s1 (s1 before the block) plus the bytes weighted
+// 32, 31, ..., 1. The "32 * s1" part is collected in a separate vector of previous s1 values and scaled once at the
+// end, and both sums are reduced modulo 65521 only once per ADLER32_NMAX bytes.
+#define ADLER32_BLOCK 32
+
+// Which kernel calculate_adler32 uses, decided once on first use (-1 until then).
+static int adler_kernel = -1;
+
+/**
+ * @brief SSSE3 kernel: two 16 byte vectors per block, byte sums with PSADBW and weighted sums with PMADDUBSW.
+ * Processes the largest multiple of 32 bytes and returns the number of bytes consumed.
+ */
+__attribute__((target("ssse3")))
+static size_t adler32_ssse3(uint32_t* adler, const uint8_t* buf, size_t length) {
+    uint32_t s1 = *adler & 0xFFFF;
+    uint32_t s2 = *adler >> 16;
+    size_t blocks = length / ADLER32_BLOCK;
+    const size_t consumed = blocks * ADLER32_BLOCK;
+
+    const __m128i weightsHigh = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i weightsLow = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while (blocks > 0) {
+        size_t n = ADLER32_NMAX / ADLER32_BLOCK;
+        if (n > blocks) n = blocks;
+        blocks -= n;
+
+        __m128i previousS1 = _mm_cvtsi32_si128((int) (s1 * n));
+        __m128i sumS1 = _mm_setzero_si128();
+        __m128i sumS2 = _mm_cvtsi32_si128((int) s2);
+        for (; n > 0; n--, buf += ADLER32_BLOCK) {
+            const __m128i bytesHigh = _mm_loadu_si128((const __m128i*) buf);
+            const __m128i bytesLow = _mm_loadu_si128((const __m128i*) (buf + 16));
+
+            previousS1 = _mm_add_epi32(previousS1, sumS1);
+            sumS1 = _mm_add_epi32(sumS1, _mm_sad_epu8(bytesHigh, zero));
+            sumS1 = _mm_add_epi32(sumS1, _mm_sad_epu8(bytesLow, zero));
+            sumS2 = _mm_add_epi32(sumS2, _mm_madd_epi16(_mm_maddubs_epi16(bytesHigh, weightsHigh), ones));
+            sumS2 = _mm_add_epi32(sumS2, _mm_madd_epi16(_mm_maddubs_epi16(bytesLow, weightsLow), ones));
+        }
+        sumS2 = _mm_add_epi32(sumS2, _mm_slli_epi32(previousS1, 5));
+
+        // Horizontal sums of the four 32 bit lanes
+        sumS1 = _mm_add_epi32(sumS1, _mm_shuffle_epi32(sumS1, _MM_SHUFFLE(2, 3, 0, 1)));
+        sumS1 = _mm_add_epi32(sumS1, _mm_shuffle_epi32(sumS1, _MM_SHUFFLE(1, 0, 3, 2)));
+        sumS2 = _mm_add_epi32(sumS2, _mm_shuffle_epi32(sumS2, _MM_SHUFFLE(2, 3, 0, 1)));
+        sumS2 = _mm_add_epi32(sumS2, _mm_shuffle_epi32(sumS2, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        s1 = (s1 + (uint32_t) _mm_cvtsi128_si32(sumS1)) % ADLER32_MODULUS;
+        s2 = (uint32_t) _mm_cvtsi128_si32(sumS2) % ADLER32_MODULUS;
+    }
+
+    *adler = s2 << 16 | s1;
+    return consumed;
+}
+
+/**
+ * @brief AVX2 kernel: one 32 byte vector per block, same scheme as the SSSE3 kernel with twice the width.
+ * Processes the largest multiple of 32 bytes and returns the number of bytes consumed.
+ */
+__attribute__((target("avx2")))
+static size_t adler32_avx2(uint32_t* adler, const uint8_t* buf, size_t length) {
+    uint32_t s1 = *adler & 0xFFFF;
+    uint32_t s2 = *adler >> 16;
+    size_t blocks = length / ADLER32_BLOCK;
+    const size_t consumed = blocks * ADLER32_BLOCK;
+
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    while (blocks > 0) {
+        size_t n = ADLER32_NMAX / ADLER32_BLOCK;
+        if (n > blocks) n = blocks;
+        blocks -= n;
+
+        __m256i previousS1 = _mm256_zextsi128_si256(_mm_cvtsi32_si128((int) (s1 * n)));
+        __m256i sumS1 = _mm256_setzero_si256();
+        __m256i sumS2 = _mm256_zextsi128_si256(_mm_cvtsi32_si128((int) s2));
+        for (; n > 0; n--, buf += ADLER32_BLOCK) {
+            const __m256i bytes = _mm256_loadu_si256((const __m256i*) buf);
+
+            previousS1 = _mm256_add_epi32(previousS1, sumS1);
+            sumS1 = _mm256_add_epi32(sumS1, _mm256_sad_epu8(bytes, zero));
+            sumS2 = _mm256_add_epi32(sumS2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+        }
+        sumS2 = _mm256_add_epi32(sumS2, _mm256_slli_epi32(previousS1, 5));
+
+        // Horizontal sums of the eight 32 bit lanes
+        __m128i s1Lanes = _mm_add_epi32(_mm256_castsi256_si128(sumS1), _mm256_extracti128_si256(sumS1, 1));
+        __m128i s2Lanes = _mm_add_epi32(_mm256_castsi256_si128(sumS2), _mm256_extracti128_si256(sumS2, 1));
+        s1Lanes = _mm_add_epi32(s1Lanes, _mm_shuffle_epi32(s1Lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+        s1Lanes = _mm_add_epi32(s1Lanes, _mm_shuffle_epi32(s1Lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2Lanes = _mm_add_epi32(s2Lanes, _mm_shuffle_epi32(s2Lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+        s2Lanes = _mm_add_epi32(s2Lanes, _mm_shuffle_epi32(s2Lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        s1 = (s1 + (uint32_t) _mm_cvtsi128_si32(s1Lanes)) % ADLER32_MODULUS;
+        s2 = (uint32_t) _mm_cvtsi128_si32(s2Lanes) % ADLER32_MODULUS;
+    }
+
+    *adler = s2 << 16 | s1;
+    return consumed;
+}
+
+/**
+ * @brief Tells whether the running CPU has the instructions of a kernel.
+ */
+static bool adler32_kernel_supported(ADLER32_KERNEL kernel) {
+    __builtin_cpu_init();
+    switch (kernel) {
+        case ADLER32_KERNEL_AVX2: return __builtin_cpu_supports("avx2");
+        case ADLER32_KERNEL_SSSE3: return __builtin_cpu_supports("ssse3");
+        default: return kernel == ADLER32_KERNEL_SCALAR;
+    }
+}
+
+/**
+ * @brief Picks the fastest kernel the running CPU supports, once.
+ * Must run on one thread before several threads use calculate_adler32 at the same time.
+ */
+static void detect_adler_kernel() {
+    if (adler_kernel >= 0) return;
+    if (adler32_kernel_supported(ADLER32_KERNEL_AVX2)) {
+        adler_kernel = ADLER32_KERNEL_AVX2;
+    } else if (adler32_kernel_supported(ADLER32_KERNEL_SSSE3)) {
+        adler_kernel = ADLER32_KERNEL_SSSE3;
+    } else {
+        adler_kernel = ADLER32_KERNEL_SCALAR;
+    }
+}
+#endif
+
+/**
+ * @brief Updates a running Adler-32 checksum based on a block of data.
+ * On x86 CPUs the bulk goes through an AVX2 or SSSE3 kernel chosen on first use, the tail (and everything on other
+ * CPUs) through the scalar loop. The result is identical in every case.
+ *
+ * @param current_adler The current running Adler-32 value (initial value 1).
+ * @param data Pointer to the buffer containing the data chunk.
+ * @param length The number of bytes in the data chunk.
+ * @return uint32_t The updated Adler-32 value.
+ */
+extern uint32_t calculate_adler32(uint32_t current_adler, const uint8_t* data, size_t length) {
+    uint32_t adler = current_adler;
+    size_t i = 0;
+
+#ifdef ADLER32_HAS_SIMD
+    detect_adler_kernel();
+    if (adler_kernel == ADLER32_KERNEL_AVX2) {
+        i = adler32_avx2(&adler, data, length);
+    } else if (adler_kernel == ADLER32_KERNEL_SSSE3) {
+        i = adler32_ssse3(&adler, data, length);
+    }
+#endif
+
+    return adler32_scalar(adler, data + i, length - i);
+}
+
+/**
+ * @brief Forces calculate_adler32 to use the given kernel, see ADLER_CHECKSUM.h.
+ *
+ * @param kernel The kernel to use from now on.
+ * @return bool False if the build or the running CPU doesn't support the kernel.
+ */
+extern bool select_adler32_kernel(ADLER32_KERNEL kernel) {
+#ifdef ADLER32_HAS_SIMD
+    if (!adler32_kernel_supported(kernel)) return false;
+    adler_kernel = kernel;
+    return true;
+#else
+    return kernel == ADLER32_KERNEL_SCALAR;
+#endif
+}
+
+/**
+ * @brief Updates a running Adler-32 checksum with 'length' zero bytes, without the data.
+ * A zero byte leaves s1 as it is and adds s1 to s2, so the run adds length * s1 to s2.
+ *
+ * @param current_adler The current running Adler-32 value (initial value 1).
+ * @param length The number of zero bytes.
+ * @return uint32_t The updated Adler-32 value, as calculate_adler32 would return it for that many zeros.
+ */
+extern uint32_t calculate_adler32_zeros(uint32_t current_adler, uint64_t length) {
+    const uint64_t s1 = current_adler & 0xFFFF;
+    const uint64_t s2 = current_adler >> 16;
+    return (uint32_t) ((s2 + (length % ADLER32_MODULUS) * s1) % ADLER32_MODULUS) << 16 | (uint32_t) s1;
+}
@@ -0,0 +1,49 @@
+//
+// Created by Attila on 12/14/2025.
+//
+
+#ifndef DEFLATE_ADLER_CHECKSUM_H
+#define DEFLATE_ADLER_CHECKSUM_H
+
+// The largest prime below 2^16, both sums of Adler-32 are kept modulo this value (RFC 1950)
+#define ADLER32_MODULUS 65521UL
+
+// The initial value of the Adler-32 checksum (s1 = 1, s2 = 0)
+#define ADLER32_INITIAL_VALUE 1UL
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Updates a running Adler-32 checksum (used in the zlib container) based on a block of data.
+ *
+ * @param current_adler The current running Adler-32 value (should be 1 for the start).
+ * @param data Pointer to the buffer containing the data chunk.
+ * @param length The number of bytes in the data chunk.
+ * @return uint32_t The updated Adler-32 value, which is also the final value (no inversion needed).
+ */
+extern uint32_t calculate_adler32(uint32_t current_adler, const uint8_t* data, size_t length);
+
+/**
+ * @brief Updates a running Adler-32 checksum with a run of zero bytes, e.g. a hole of a sparse file.
+ *
+ * @param current_adler The current running Adler-32 value (should be 1 for the start).
+ * @param length The number of zero bytes.
+ * @return uint32_t The updated Adler-32 value.
+ */
+extern uint32_t calculate_adler32_zeros(uint32_t current_adler, uint64_t length);
+
+// The kernels calculate_adler32 can sum the bulk of the data with, the fastest one the CPU supports is picked on first use
+typedef enum { ADLER32_KERNEL_SCALAR, ADLER32_KERNEL_SSSE3, ADLER32_KERNEL_AVX2 } ADLER32_KERNEL;
+
+/**
+ * @brief Forces calculate_adler32 to use the given kernel, so the kernels can be checked against each other.
+ * Must not be called while other threads calculate Adler-32 values.
+ *
+ * @param kernel The kernel to use from now on.
+ * @return bool False if the build or the running CPU doesn't support the kernel, the previous one stays in use then.
+ */
+extern bool select_adler32_kernel(ADLER32_KERNEL kernel);
+
+#endif //DEFLATE_ADLER_CHECKSUM_H
@@ -3,13 +3,15 @@
 //
 
 #include "CRC_CHECKSUM.h"
+#include <pthread.h>
 #include <stdio.h>
 
-// Static array to store the 256 pre-calculated CRC values
-static uint32_t crc_table[256];
+// 16 pre-calculated tables of 256 CRC values. crc_table[0] is the classic byte-at-a-time table, crc_table[k][n] is the
+// CRC of byte n followed by k zero bytes, which lets the slicing loops process 8 or 16 bytes per step.
+static uint32_t crc_table[16][256];
 
 /**
- * @brief Generates the 256-entry lookup table for fast CRC32 calculation.
+ * @brief Generates the lookup tables for fast CRC32 calculation.
  * This should only be called once at program start or upon first use.
  */
 static void build_crc_table() {
@@ -28,37 +30,439 @@ static void build_crc_table() {
                 c = c >> 1;
             }
         }
-        crc_table[n] = c;
+        crc_table[0][n] = c;
+    }
+
+    // Each further table extends the previous one by one zero byte.
+    for (n = 0; n < 256; n++) {
+        c = crc_table[0][n];
+        for (k = 1; k < 16; k++) {
+            c = crc_table[0][c & 0xFF] ^ (c >> 8);
+            crc_table[k][n] = c;
+        }
     }
 }
 
 // Flag to ensure the table is only built once
 static int table_is_initialized = 0;
 
+// x2n_table[n] is x^(2^n) modulo the CRC polynomial, used to shift a CRC forward over a run of zero bytes.
+static uint32_t x2n_table[32];
+
+/**
+ * @brief Multiplies two polynomials modulo the CRC polynomial, both in the bit-reflected representation.
+ */
+static uint32_t multiply_mod_p(uint32_t a, uint32_t b) {
+    uint32_t m = (uint32_t) 1 << 31;
+    uint32_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32_POLYNOMIAL : b >> 1;
+    }
+    return p;
+}
+
+/**
+ * @brief Returns x^(n * 2^k) modulo the CRC polynomial by square-and-multiply over x2n_table.
+ */
+static uint32_t x2n_mod_p(size_t n, unsigned k) {
+    uint32_t p = (uint32_t) 1 << 31; // x^0 == 1
+
+    while (n) {
+        if (n & 1) p = multiply_mod_p(x2n_table[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+static void build_x2n_table() {
+    uint32_t p = (uint32_t) 1 << 30; // x^1
+    x2n_table[0] = p;
+    for (int n = 1; n < 32; n++) {
+        x2n_table[n] = p = multiply_mod_p(p, p);
+    }
+}
+
+// Reads 4 bytes as a little endian value, independent of the byte order of the machine.
+static uint32_t load_le32(const uint8_t *p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/**
+ * @brief Slicing-by-16: consumes 16 bytes per step with 16 independent table lookups.
+ * Processes the largest multiple of 16 bytes and returns the number of bytes consumed.
+ */
+static size_t crc32_slice_by_16(uint32_t *crc, const uint8_t *buf, size_t length) {
+    uint32_t c = *crc;
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        const uint32_t a = c ^ load_le32(buf + i);
+        const uint32_t b = load_le32(buf + i + 4);
+        const uint32_t d = load_le32(buf + i + 8);
+        const uint32_t e = load_le32(buf + i + 12);
+        c = crc_table[15][a & 0xFF] ^ crc_table[14][(a >> 8) & 0xFF] ^
+            crc_table[13][(a >> 16) & 0xFF] ^ crc_table[12][a >> 24] ^
+            crc_table[11][b & 0xFF] ^ crc_table[10][(b >> 8) & 0xFF] ^
+            crc_table[9][(b >> 16) & 0xFF] ^ crc_table[8][b >> 24] ^
+            crc_table[7][d & 0xFF] ^ crc_table[6][(d >> 8) & 0xFF] ^
+            crc_table[5][(d >> 16) & 0xFF] ^ crc_table[4][d >> 24] ^
+            crc_table[3][e & 0xFF] ^ crc_table[2][(e >> 8) & 0xFF] ^
+            crc_table[1][(e >> 16) & 0xFF] ^ crc_table[0][e >> 24];
+    }
+
+    *crc = c;
+    return i;
+}
+
+/**
+ * @brief Slicing-by-8: consumes 8 bytes per step with 8 independent table lookups.
+ * Processes the largest multiple of 8 bytes and returns the number of bytes consumed.
+ */
+static size_t crc32_slice_by_8(uint32_t *crc, const uint8_t *buf, size_t length) {
+    uint32_t c = *crc;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        const uint32_t a = c ^ load_le32(buf + i);
+        const uint32_t b = load_le32(buf + i + 4);
+        c = crc_table[7][a & 0xFF] ^ crc_table[6][(a >> 8) & 0xFF] ^
+            crc_table[5][(a >> 16) & 0xFF] ^ crc_table[4][a >> 24] ^
+            crc_table[3][b & 0xFF] ^ crc_table[2][(b >> 8) & 0xFF] ^
+            crc_table[1][(b >> 16) & 0xFF] ^ crc_table[0][b >> 24];
+    }
+
+    *crc = c;
+    return i;
+}
+
+// Carry-less multiplication folding is only available on x86 with a GCC compatible compiler, the kernels are compiled
+// with per-function target attributes so the rest of the program keeps the baseline instruction set.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(CRC32_DISABLE_CLMUL)
+#define CRC32_HAS_CLMUL 1
+#include <immintrin.h>
+
+// Folding constants in the bit-reflected domain, see "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+// Instruction" (Gopal et al., Intel 2009). Each pair is (x^(d+32) mod P, x^(d-32) mod P) reflected and shifted left
+// by one, where d is the folding distance in bits.
+static const uint64_t fold_512[2] = {0x0154442bd4ULL, 0x01c6e41596ULL};   // d = 4 * 128 bits
+static const uint64_t fold_128[2] = {0x01751997d0ULL, 0x00ccaa009eULL};   // d = 128 bits
+static const uint64_t fold_2048[2] = {0x011542778aULL, 0x01322d1430ULL};  // d = 4 * 512 bits
+static const uint64_t fold_64 = 0x0163cd6124ULL;                          // 64 -> 32 bit reduction
+static const uint64_t barrett[2] = {0x01db710641ULL, 0x01f7011641ULL};    // P(x)' and mu' for Barrett reduction
+
+// Which kernel calculate_crc32 uses, decided once on first use.
+static CRC32_KERNEL crc_kernel = CRC32_KERNEL_TABLE;
+
+/**
+ * @brief Reduces a 128 bit folded remainder to the final 32 bit CRC register value.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_reduce_128(__m128i x) {
+    const __m128i k = _mm_loadu_si128((const __m128i *) fold_128);
+    const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    // 128 -> 96 bits
+    __m128i t = _mm_clmulepi64_si128(x, k, 0x10);
+    x = _mm_xor_si128(_mm_srli_si128(x, 8), t);
+
+    // 96 -> 64 bits
+    t = _mm_srli_si128(x, 4);
+    x = _mm_clmulepi64_si128(_mm_and_si128(x, low32), _mm_loadl_epi64((const __m128i *) &fold_64), 0x00);
+    x = _mm_xor_si128(x, t);
+
+    // Barrett reduction to 32 bits
+    const __m128i p = _mm_loadu_si128((const __m128i *) barrett);
+    t = _mm_clmulepi64_si128(_mm_and_si128(x, low32), p, 0x10);
+    t = _mm_clmulepi64_si128(_mm_and_si128(t, low32), p, 0x00);
+    x = _mm_xor_si128(x, t);
+
+    return (uint32_t) _mm_extract_epi32(x, 1);
+}
+
+/**
+ * @brief Folds one 128 bit accumulator forward by the distance encoded in k and adds the next data block.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i crc32_fold_128(__m128i x, __m128i data, __m128i k) {
+    const __m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+    const __m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(low, high), data);
+}
+
+/**
+ * @brief PCLMULQDQ kernel: four 128 bit lanes folded in parallel over 64 byte steps.
+ * Processes the largest multiple of 16 bytes (at least 64 are required) and returns the number of bytes consumed.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static size_t crc32_pclmul(uint32_t *crc, const uint8_t *buf, size_t length) {
+    if (length < 64) return 0;
+    const size_t total = length & ~(size_t) 15;
+    size_t i = 64;
+
+    __m128i x1 = _mm_loadu_si128((const __m128i *) (buf + 0));
+    __m128i x2 = _mm_loadu_si128((const __m128i *) (buf + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i *) (buf + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i *) (buf + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) *crc));
+
+    __m128i k = _mm_loadu_si128((const __m128i *) fold_512);
+    for (; i + 64 <= total; i += 64) {
+        x1 = crc32_fold_128(x1, _mm_loadu_si128((const __m128i *) (buf + i + 0)), k);
+        x2 = crc32_fold_128(x2, _mm_loadu_si128((const __m128i *) (buf + i + 16)), k);
+        x3 = crc32_fold_128(x3, _mm_loadu_si128((const __m128i *) (buf + i + 32)), k);
+        x4 = crc32_fold_128(x4, _mm_loadu_si128((const __m128i *) (buf + i + 48)), k);
+    }
+
+    // Collapse the four lanes into one, then fold the remaining 16 byte blocks
+    k = _mm_loadu_si128((const __m128i *) fold_128);
+    x1 = crc32_fold_128(x1, x2, k);
+    x1 = crc32_fold_128(x1, x3, k);
+    x1 = crc32_fold_128(x1, x4, k);
+    for (; i < total; i += 16) {
+        x1 = crc32_fold_128(x1, _mm_loadu_si128((const __m128i *) (buf + i)), k);
+    }
+
+    *crc = crc32_reduce_128(x1);
+    return total;
+}
+
+/**
+ * @brief Folds one 512 bit accumulator forward by the distance encoded in k and adds the next data block.
+ */
+__attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.1")))
+static inline __m512i crc32_fold_512(__m512i x, __m512i data, __m512i k) {
+    const __m512i low = _mm512_clmulepi64_epi128(x, k, 0x00);
+    const __m512i high = _mm512_clmulepi64_epi128(x, k, 0x11);
+    // 0x96 is the truth table of a three way XOR
+    return _mm512_ternarylogic_epi64(low, high, data, 0x96);
+}
+
+/**
+ * @brief VPCLMULQDQ kernel: four 512 bit lanes folded in parallel over 256 byte steps.
+ * Processes the largest multiple of 64 bytes (at least 256 are required) and returns the number of bytes consumed.
+ */
+__attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.1")))
+static size_t crc32_vpclmul(uint32_t *crc, const uint8_t *buf, size_t length) {
+    if (length < 256) return 0;
+    const size_t total = length & ~(size_t) 63;
+    size_t i = 256;
+
+    __m512i x1 = _mm512_loadu_si512((const void *) (buf + 0));
+    __m512i x2 = _mm512_loadu_si512((const void *) (buf + 64));
+    __m512i x3 = _mm512_loadu_si512((const void *) (buf + 128));
+    __m512i x4 = _mm512_loadu_si512((const void *) (buf + 192));
+    x1 = _mm512_xor_si512(x1, _mm512_zextsi128_si512(_mm_cvtsi32_si128((int) *crc)));
+
+    __m512i k = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) fold_2048));
+    for (; i + 256 <= total; i += 256) {
+        x1 = crc32_fold_512(x1, _mm512_loadu_si512((const void *) (buf + i + 0)), k);
+        x2 = crc32_fold_512(x2, _mm512_loadu_si512((const void *) (buf + i + 64)), k);
+        x3 = crc32_fold_512(x3, _mm512_loadu_si512((const void *) (buf + i + 128)), k);
+        x4 = crc32_fold_512(x4, _mm512_loadu_si512((const void *) (buf + i + 192)), k);
+    }
+
+    // Collapse the four lanes into one, then fold the remaining 64 byte blocks
+    k = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) fold_512));
+    x1 = crc32_fold_512(x1, x2, k);
+    x1 = crc32_fold_512(x1, x3, k);
+    x1 = crc32_fold_512(x1, x4, k);
+    for (; i < total; i += 64) {
+        x1 = crc32_fold_512(x1, _mm512_loadu_si512((const void *) (buf + i)), k);
+    }
+
+    // The four 128 bit lanes of the accumulator are folded into one with the 128 bit distance
+    const __m128i k128 = _mm_loadu_si128((const __m128i *) fold_128);
+    __m128i a = _mm512_extracti32x4_epi32(x1, 0);
+    a = crc32_fold_128(a, _mm512_extracti32x4_epi32(x1, 1), k128);
+    a = crc32_fold_128(a, _mm512_extracti32x4_epi32(x1, 2), k128);
+    a = crc32_fold_128(a, _mm512_extracti32x4_epi32(x1, 3), k128);
+
+    *crc = crc32_reduce_128(a);
+    return total;
+}
+
+/**
+ * @brief Tells whether the running CPU has the instructions of a carry-less multiplication kernel.
+ */
+static bool crc32_kernel_supported(CRC32_KERNEL kernel) {
+    __builtin_cpu_init();
+    bool pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    if (kernel == CRC32_KERNEL_VPCLMUL) {
+        return pclmul && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+    }
+    return kernel == CRC32_KERNEL_TABLE || (kernel == CRC32_KERNEL_PCLMUL && pclmul);
+}
+
+/**
+ * @brief Picks the fastest kernel the running CPU supports.
+ */
+static void detect_crc_kernel() {
+    if (crc32_kernel_supported(CRC32_KERNEL_VPCLMUL)) {
+        crc_kernel = CRC32_KERNEL_VPCLMUL;
+    } else if (crc32_kernel_supported(CRC32_KERNEL_PCLMUL)) {
+        crc_kernel = CRC32_KERNEL_PCLMUL;
+    }
+}
+#endif
+
+/**
+ * @brief Builds the lookup tables and selects the kernel, once.
+ * Must run on one thread before several threads use calculate_crc32 at the same time.
+ */
+static void init_crc32() {
+    if (!table_is_initialized) {
+        build_crc_table();
+        build_x2n_table();
+#ifdef CRC32_HAS_CLMUL
+        detect_crc_kernel();
+#endif
+        table_is_initialized = 1;
+    }
+}
+
 /**
  * @brief Updates a running CRC32 checksum based on a block of data.
- * * @param current_crc The current running CRC value (initial value 0xFFFFFFFF).
+ * On x86 CPUs with carry-less multiplication the bulk is folded with (V)PCLMULQDQ, otherwise it goes through
+ * slicing-by-16. The tail goes through slicing-by-8 and then byte by byte, so the result is always bit-identical to
+ * the classic one-byte-per-step table algorithm.
+ *
+ * @param current_crc The current running CRC value (initial value 0xFFFFFFFF).
  * @param data Pointer to the buffer containing the data chunk.
  * @param length The number of bytes in the data chunk.
  * @return uint32_t The updated CRC value.
  */
 extern uint32_t calculate_crc32(uint32_t current_crc, const uint8_t* data, size_t length) {
-    if (!table_is_initialized) {
-        build_crc_table();
-        table_is_initialized = 1;
-    }
+    init_crc32();
 
     uint32_t c = current_crc;
     const uint8_t *buf = data;
-    size_t i;
+    size_t i = 0;
+
+#ifdef CRC32_HAS_CLMUL
+    if (crc_kernel == CRC32_KERNEL_VPCLMUL) {
+        i += crc32_vpclmul(&c, buf, length);
+    }
+    if (crc_kernel != CRC32_KERNEL_TABLE) {
+        i += crc32_pclmul(&c, buf + i, length - i);
+    }
+#endif
+    i += crc32_slice_by_16(&c, buf + i, length - i);
+    i += crc32_slice_by_8(&c, buf + i, length - i);
 
-    // Core lookup table logic (optimized for speed)
-    for (i = 0; i < length; i++) {
+    // Core lookup table logic for the last few bytes
+    for (; i < length; i++) {
         // 1. XOR the current byte of input data with the LSB byte of the CRC accumulator (c)
         // 2. Look up the result in the table
         // 3. XOR the result with the MSB portion of the accumulator (c shifted right by 8 bits)
-        c = crc_table[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+        c = crc_table[0][(c ^ buf[i]) & 0xFF] ^ (c >> 8);
     }
 
     return c;
 }
+
+/**
+ * @brief Forces calculate_crc32 to use the given kernel, see CRC_CHECKSUM.h.
+ *
+ * @param kernel The kernel to use from now on.
+ * @return bool False if the build or the running CPU doesn't support the kernel.
+ */
+extern bool select_crc32_kernel(CRC32_KERNEL kernel) {
+    init_crc32();
+#ifdef CRC32_HAS_CLMUL
+    if (!crc32_kernel_supported(kernel)) return false;
+    crc_kernel = kernel;
+    return true;
+#else
+    return kernel == CRC32_KERNEL_TABLE;
+#endif
+}
+
+/**
+ * @brief Combines the CRC32 of two consecutive pieces of data.
+ * The CRC of the first piece is shifted forward over len2 zero bytes (a multiplication by x^(8 * len2) modulo the
+ * polynomial, done in O(log len2) steps) and added to the CRC of the second piece.
+ *
+ * @param crc1 The finished CRC32 (running value XOR 0xFFFFFFFF) of the first piece.
+ * @param crc2 The finished CRC32 of the second piece.
+ * @param len2 The length of the second piece in bytes.
+ * @return uint32_t The finished CRC32 of the two pieces concatenated.
+ */
+extern uint32_t combine_crc32(uint32_t crc1, uint32_t crc2, size_t len2) {
+    init_crc32();
+    return multiply_mod_p(x2n_mod_p(len2, 3), crc1) ^ crc2;
+}
+
+/**
+ * @brief Updates a running CRC32 checksum with 'length' zero bytes.
+ * Zero bytes only shift the register, which is the first half of combine_crc32: a multiplication by x^(8 * length).
+ *
+ * @param current_crc The current running CRC value (initial value 0xFFFFFFFF).
+ * @param length The number of zero bytes.
+ * @return uint32_t The updated CRC value, exactly as calculate_crc32 would return it for that many zeros.
+ */
+extern uint32_t calculate_crc32_zeros(uint32_t current_crc, size_t length) {
+    return combine_crc32(current_crc, 0, length);
+}
+
+typedef struct {
+    const uint8_t* data;
+    size_t length;
+    uint32_t crc;
+} CRC_CHUNK;
+
+static void* crc32_chunk_worker(void* arg) {
+    CRC_CHUNK* chunk = arg;
+    chunk->crc = calculate_crc32(CRC32_INITIAL_VALUE, chunk->data, chunk->length) ^ CRC32_INITIAL_VALUE;
+    return NULL;
+}
+
+/**
+ * @brief Updates a running CRC32 checksum with a large block of data split across worker threads.
+ * Every thread computes the CRC of its own chunk, the results are merged in order with combine_crc32. Blocks too
+ * small to give every thread at least CRC32_PARALLEL_MIN_CHUNK bytes use fewer threads, down to the calling thread
+ * alone. If a thread cannot be started its chunk is computed by the calling thread.
+ *
+ * @param current_crc The current running CRC value (initial value 0xFFFFFFFF).
+ * @param data Pointer to the buffer containing the data.
+ * @param length The number of bytes in the buffer.
+ * @param threads The maximum number of threads to use (capped at CRC32_MAX_THREADS).
+ * @return uint32_t The updated CRC value, exactly as calculate_crc32 would return it.
+ */
+extern uint32_t calculate_crc32_parallel(uint32_t current_crc, const uint8_t* data, size_t length, unsigned threads) {
+    init_crc32();
+
+    if (threads > CRC32_MAX_THREADS) threads = CRC32_MAX_THREADS;
+    if (threads > length / CRC32_PARALLEL_MIN_CHUNK) threads = (unsigned) (length / CRC32_PARALLEL_MIN_CHUNK);
+    if (threads <= 1) {
+        return calculate_crc32(current_crc, data, length);
+    }
+
+    CRC_CHUNK chunks[CRC32_MAX_THREADS];
+    pthread_t workers[CRC32_MAX_THREADS];
+    bool started[CRC32_MAX_THREADS];
+    const size_t chunkSize = length / threads;
+
+    for (unsigned t = 0; t < threads; t++) {
+        chunks[t].data = data + t * chunkSize;
+        chunks[t].length = t == threads - 1 ? length - t * chunkSize : chunkSize;
+        // The first chunk runs on the calling thread
+        started[t] = t > 0 && pthread_create(&workers[t], NULL, crc32_chunk_worker, &chunks[t]) == 0;
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        if (!started[t]) crc32_chunk_worker(&chunks[t]);
+    }
+
+    uint32_t crc = current_crc ^ CRC32_INITIAL_VALUE;
+    for (unsigned t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(workers[t], NULL);
+        crc = combine_crc32(crc, chunks[t].crc, chunks[t].length);
+    }
+    return crc ^ CRC32_INITIAL_VALUE;
+}
@@ -10,6 +10,13 @@
 
 // The initial value for the CRC32 calculation in Gzip/Zlib is 0xFFFFFFFF
 #define CRC32_INITIAL_VALUE 0xFFFFFFFFUL
+
+// Upper bound on the worker threads of calculate_crc32_parallel, and the smallest chunk worth a thread of its own
+#define CRC32_MAX_THREADS 64
+#define CRC32_PARALLEL_MIN_CHUNK (1u << 20)
+
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -23,4 +30,47 @@
  */
 extern uint32_t calculate_crc32(uint32_t current_crc, const uint8_t* data, size_t length);
 
+/**
+ * @brief Combines the CRC32 of two consecutive pieces of data into the CRC32 of both, without the data itself.
+ * Named apart from zlib's crc32_combine, so the program can be linked with zlib.
+ *
+ * @param crc1 The finished CRC32 (running value XOR 0xFFFFFFFF) of the first piece.
+ * @param crc2 The finished CRC32 of the second piece.
+ * @param len2 The length of the second piece in bytes.
+ * @return uint32_t The finished CRC32 of the first piece followed by the second.
+ */
+extern uint32_t combine_crc32(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/**
+ * @brief Updates a running CRC32 checksum with a run of zero bytes (e.g. a hole of a sparse file), without the data.
+ *
+ * @param current_crc The current running CRC value (should be 0xFFFFFFFF for the start).
+ * @param length The number of zero bytes.
+ * @return uint32_t The updated CRC value.
+ */
+extern uint32_t calculate_crc32_zeros(uint32_t current_crc, size_t length);
+
+/**
+ * @brief Updates a running CRC32 checksum like calculate_crc32, splitting the data across worker threads.
+ *
+ * @param current_crc The current running CRC value (should be 0xFFFFFFFF for the start).
+ * @param data Pointer to the buffer containing the data.
+ * @param length The number of bytes in the buffer.
+ * @param threads The maximum number of threads to use, the calling thread included.
+ * @return uint32_t The updated CRC value.
+ */
+extern uint32_t calculate_crc32_parallel(uint32_t current_crc, const uint8_t* data, size_t length, unsigned threads);
+
+// The kernels calculate_crc32 can fold the bulk of the data with, the fastest one the CPU supports is picked on first use
+typedef enum { CRC32_KERNEL_TABLE, CRC32_KERNEL_PCLMUL, CRC32_KERNEL_VPCLMUL } CRC32_KERNEL;
+
+/**
+ * @brief Forces calculate_crc32 to use the given kernel, so the kernels can be checked against each other.
+ * Must not be called while other threads calculate CRC32 values.
+ *
+ * @param kernel The kernel to use from now on.
+ * @return bool False if the build or the running CPU doesn't support the kernel, the previous one stays in use then.
+ */
+extern bool select_crc32_kernel(CRC32_KERNEL kernel);
+
 #endif //DEFLATE_CRC_CHECKSUM_H
\ No newline at end of file
@@ -24,65 +24,210 @@ uint16_t reverse_bits(uint16_t val, int bits) {
 }
 
 /**
- * @bug There are cases where this function can not decode the distance symbol or the length symbol and the whole code breaks.
- * I couldn't find it in time.
+ * @brief Decode Symbol
  *
- * @param reader
- * @param tree
- * @return
+ * Decodes one symbol with the given tree. Codes up to FAST_BITS are resolved with one lookup in the fast table, longer
+ * ones with the canonical code ranges (the codes of one length are consecutive numbers, so one compare per length).
+ *
+ * @param reader The BIT_READER to read the code from.
+ * @param tree The tree to decode with.
+ *
+ * @return uint16_t The decoded symbol, or 0xFFFF if the bits are not a valid code of the tree.
  */
 uint16_t decode_symbol(BIT_READER* reader, const HuffmanTree* tree) {
     // 1. FAST PATH: Peek 9 bits (or whatever FAST_BITS is)
     uint16_t peek_val = peek_bits(reader, FAST_BITS);
-    printf("peaked bits:%d\n",peek_val);
     HuffmanEntry entry = tree->lookup_table[peek_val];
 
     // Check if we found a valid symbol in the fast table
     if (entry.bits > 0 && entry.bits <= FAST_BITS) {
-        read_bits(reader, entry.bits); // Consume the bits
+        consume_bits(reader, entry.bits); // Consume the bits
         return entry.symbol;
     }
-    printf("turning to slowpath.\n");
+
     // 2. SLOW PATH: The code is longer than FAST_BITS (e.g. 10-15 bits)
-    // We must search for a match bit-by-bit.
-
-    uint16_t current_code = 0;
-    int cur_len = 0;
-
-    // Optimization: We know the first FAST_BITS didn't match a short code,
-    // but they ARE the prefix of the long code.
-    // We can start by consuming those bits.
-    // (Or, simpler for now: just restart from bit 0 to be safe and clear)
-
-    // Let's use the robust "try 1 bit, then 2..." method you described.
-    // Because this happens rarely (only for very rare symbols), speed is less critical.
-
-    while (cur_len < MAX_BITS) {
-        // Read 1 bit from file
-        int bit = read_bit(reader);
-        cur_len++;
-
-        // Add bit to current_code.
-        // Note: Since we need to match the "MSB-First" definition of codes,
-        // and we are reading bits in order...
-        // current_code = (current_code << 1) | bit;
-        // This builds the code in MSB-first order (matching the canonical_codes).
-        current_code = (current_code << 1) | bit;
-
-        for (int i = 0; i < tree->total_symbols; i++) {
-            // Check length match first (fastest reject)
-            if (tree->codes_list[i].length == cur_len) {
-                // Check code value match
-                if (tree->codes_list[i].code == current_code) {
-                    return i; // Symbol found!
-                }
-            }
+    // Codes are MSB-first, so the bits are appended to 'code' one by one from the peeked value.
+    const uint16_t bits = peek_bits(reader, MAX_BITS);
+    int code = 0;  // The code read so far
+    int first = 0; // The first code of the current length
+    int index = 0; // Index of the first symbol of the current length in sorted_symbols
+
+    for (int len = 1; len <= MAX_BITS; len++) {
+        code |= (bits >> (len - 1)) & 1;
+        const int count = tree->length_counts[len];
+        if (code - first < count) {
+            consume_bits(reader, len);
+            return tree->sorted_symbols[index + (code - first)];
         }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
     }
-    printf("no code found\n");
     return 0xFFFF;
 }
 
+/**
+ * @brief Build Decode Tree
+ *
+ * Assigns the canonical codes (RFC 1951 3.2.2) for the given code lengths and fills up the tree with them. Works on
+ * the stack and the tree only, so a block header can be turned into decode tables without any heap allocation.
+ *
+ * @param lengths The code length of each symbol (0 if the symbol is unused).
+ * @param total_symbols The number of symbols.
+ * @param tree The tree to fill.
+ */
+extern void buildDecodeTree(const uint8_t* lengths, int total_symbols, HuffmanTree* tree) {
+    uint16_t bl_count[MAX_BITS + 1] = {0};
+    uint16_t next_code[MAX_BITS + 1] = {0};
+    HUFFMAN_CODE canonical_codes[MAX_CODE_SYMBOLS];
+
+    for (int i = 0; i < total_symbols; i++) {
+        if (lengths[i] > 0) bl_count[lengths[i]]++;
+    }
+    uint16_t code = 0;
+    for (int L = 1; L <= MAX_BITS; L++) {
+        code = (code + bl_count[L - 1]) << 1;
+        next_code[L] = code;
+    }
+    for (int i = 0; i < total_symbols; i++) {
+        canonical_codes[i].length = lengths[i];
+        canonical_codes[i].code = lengths[i] > 0 ? next_code[lengths[i]]++ : 0;
+        tree->codes_list[i].code = canonical_codes[i].code;
+        tree->codes_list[i].length = canonical_codes[i].length;
+    }
+    tree->total_symbols = total_symbols;
+    buildFastLookupTable(canonical_codes, total_symbols, tree->lookup_table);
+
+    // Symbols in canonical order (by length, then by symbol) for the slow path of decode_symbol.
+    uint16_t offsets[MAX_BITS + 1];
+    offsets[1] = 0;
+    for (int L = 1; L < MAX_BITS; L++) {
+        offsets[L + 1] = offsets[L] + bl_count[L];
+    }
+    for (int L = 0; L <= MAX_BITS; L++) {
+        tree->length_counts[L] = L > 0 ? bl_count[L] : 0;
+    }
+    for (int i = 0; i < total_symbols; i++) {
+        if (lengths[i] > 0) tree->sorted_symbols[offsets[lengths[i]]++] = (uint16_t) i;
+    }
+}
+
+/**
+ * @brief Is Multi Literal Table Profitable
+ *
+ * Estimates from the literal code lengths how often one MULTI_BITS wide lookup would return two literals. A code of
+ * length L is used with a probability of about 2^-L, so a pair (a, b) covers 2^-(La+Lb) of the lookups. The pair table
+ * costs a fill of MULTI_SIZE entries per block, so it is only worth it when a large share of the lookups are pairs.
+ *
+ * @param lengths The literal/length code lengths of the block (at least the first 256 are used).
+ *
+ * @return bool true if the block should be decoded with a multi literal table.
+ */
+extern bool isMultiLiteralTableProfitable(const uint8_t* lengths) {
+    uint32_t literals_per_length[MAX_BITS + 1] = {0};
+    for (int i = 0; i < 256; i++) {
+        literals_per_length[lengths[i]]++;
+    }
+
+    // Sum of 2^-(La+Lb) over all literal pairs fitting in MULTI_BITS, in units of 2^-MULTI_BITS.
+    uint32_t pair_weight = 0;
+    for (int la = 1; la < MULTI_BITS; la++) {
+        for (int lb = 1; la + lb <= MULTI_BITS; lb++) {
+            pair_weight += literals_per_length[la] * literals_per_length[lb] << (MULTI_BITS - la - lb);
+        }
+    }
+
+    // Profitable if at least ~30% of the lookups return two literals.
+    return pair_weight * 10 >= 3 * MULTI_SIZE;
+}
+
+/**
+ * @brief Build Multi Literal Table
+ *
+ * Fills a MULTI_BITS wide table from a literal/length tree: every index starting with a literal code gets that literal,
+ * and if the remaining bits also start with a complete literal code, that one as well. Indices starting with a length,
+ * the end of block, or a code longer than MULTI_BITS get count 0 and are decoded with decode_symbol.
+ *
+ * @param tree The literal/length tree of the block.
+ * @param table The MULTI_SIZE entry table to fill.
+ */
+extern void buildMultiLiteralTable(const HuffmanTree* tree, MultiLiteralEntry* table) {
+    uint16_t reversed[256];
+    const int literal_count = tree->total_symbols < 256 ? tree->total_symbols : 256;
+
+    memset(table, 0, sizeof(MultiLiteralEntry) * MULTI_SIZE);
+
+    // 1. Single literals
+    for (int a = 0; a < literal_count; a++) {
+        const uint8_t la = tree->codes_list[a].length;
+        if (la == 0 || la > MULTI_BITS) continue;
+        reversed[a] = reverse_bits(tree->codes_list[a].code, la);
+        for (int index = reversed[a]; index < MULTI_SIZE; index += 1 << la) {
+            table[index].count = 1;
+            table[index].bits = la;
+            table[index].literals[0] = (uint8_t) a;
+        }
+    }
+
+    // 2. Literal pairs overwrite the single entries they extend.
+    // sorted_symbols is ordered by code length, so the candidates for the second literal are a prefix of it,
+    // and every visited pair fills at least one entry: the work is bounded by the table size.
+    for (int a = 0; a < literal_count; a++) {
+        const uint8_t la = tree->codes_list[a].length;
+        if (la == 0 || la >= MULTI_BITS) continue;
+
+        int candidates = 0;
+        for (int L = 1; L <= MULTI_BITS - la; L++) candidates += tree->length_counts[L];
+
+        for (int k = 0; k < candidates; k++) {
+            const uint16_t b = tree->sorted_symbols[k];
+            if (b >= 256) continue; // Not a literal
+            const uint8_t lb = tree->codes_list[b].length;
+            const int step = 1 << (la + lb);
+            for (int index = reversed[a] | (reversed[b] << la); index < MULTI_SIZE; index += step) {
+                table[index].count = 2;
+                table[index].bits = la + lb;
+                table[index].literals[1] = (uint8_t) b;
+            }
+        }
+    }
+}
+
+// The fixed Huffman trees (BTYPE=01) are the same for every stream, so they are built once on first use.
+static HuffmanTree fixed_literal_tree;
+static HuffmanTree fixed_distance_tree;
+static int fixed_trees_are_initialized = 0;
+
+static void build_fixed_trees(void) {
+    uint8_t lengths[MAX_CODE_SYMBOLS];
+
+    // RFC 1951 3.2.6: 0-143 -> 8 bits, 144-255 -> 9 bits, 256-279 -> 7 bits, 280-287 -> 8 bits.
+    // Symbols 286 and 287 never occur, but they take part in the code assignment.
+    for (int i = 0; i < MAX_CODE_SYMBOLS; i++) {
+        if (i < 144) lengths[i] = 8;
+        else if (i < 256) lengths[i] = 9;
+        else if (i < 280) lengths[i] = 7;
+        else lengths[i] = 8;
+    }
+    buildDecodeTree(lengths, MAX_CODE_SYMBOLS, &fixed_literal_tree);
+
+    // All 30 distance codes are 5 bits long.
+    for (int i = 0; i < 30; i++) lengths[i] = 5;
+    buildDecodeTree(lengths, 30, &fixed_distance_tree);
+
+    fixed_trees_are_initialized = 1;
+}
+
+extern const HuffmanTree* getFixedLiteralTree(void) {
+    if (!fixed_trees_are_initialized) build_fixed_trees();
+    return &fixed_literal_tree;
+}
+
+extern const HuffmanTree* getFixedDistanceTree(void) {
+    if (!fixed_trees_are_initialized) build_fixed_trees();
+    return &fixed_distance_tree;
+}
+
 extern void buildFastLookupTable(
     const HUFFMAN_CODE* canonical_codes,
     int total_symbols,
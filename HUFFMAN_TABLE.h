@@ -17,13 +17,24 @@ typedef struct {
 
 #define FAST_BITS 9
 #define FAST_SIZE (1 << FAST_BITS) // 512 entries
-#define MAX_CODE_SYMBOLS 286 // Max symbols for T_LL (the largest tree)
+#define MAX_CODE_SYMBOLS 288 // Max symbols for T_LL (the largest tree, the fixed tree defines all 288 codes)
 
 typedef struct {
     uint16_t symbol; // The decoded symbol
     uint8_t bits;   // Number of bits consumed (Length)
 } HuffmanEntry;
 
+#define MULTI_BITS 11
+#define MULTI_SIZE (1 << MULTI_BITS) // 2048 entries
+
+// --- Multi Literal Table Entry ---
+// One lookup resolves up to two literals whose codes fit together in MULTI_BITS bits.
+typedef struct {
+    uint8_t count;       // Number of literals in the entry (0: not a literal, use decode_symbol)
+    uint8_t bits;        // Number of bits consumed by all of them
+    uint8_t literals[2]; // The decoded literals
+} MultiLiteralEntry;
+
 // --- 2. Full Code/Length Storage (for the Slow Path) ---
 // This stores the mathematically generated canonical codes for *all* symbols.
 typedef struct {
@@ -41,6 +52,11 @@ typedef struct {
     // This allows the slow path in decode_symbol to check all possible codes.
     CanonicalCode codes_list[MAX_CODE_SYMBOLS];
 
+    // Number of codes of each length, and the symbols ordered by their canonical code.
+    // Lets the slow path find a long code with one compare per code length.
+    uint16_t length_counts[16];
+    uint16_t sorted_symbols[MAX_CODE_SYMBOLS];
+
     // III. Metadata
     uint16_t total_symbols; // e.g., 19, HLIT, or HDIST+1
     uint8_t max_length;     // Max code length observed in this tree (up to 15)
@@ -56,4 +72,21 @@ extern void buildFastLookupTable(
     HuffmanEntry* lookup_table
 );
 uint16_t decode_symbol(BIT_READER* reader, const HuffmanTree* tree);
+
+extern void buildDecodeTree(const uint8_t* lengths, int total_symbols, HuffmanTree* tree);
+
+extern bool isMultiLiteralTableProfitable(const uint8_t* lengths);
+
+extern void buildMultiLiteralTable(const HuffmanTree* tree, MultiLiteralEntry* table);
+
+/**
+ * @brief The shared, prebuilt literal/length tree of the fixed Huffman blocks (BTYPE=01).
+ * Built once on first use, every code fits in the fast lookup table.
+ */
+extern const HuffmanTree* getFixedLiteralTree(void);
+
+/**
+ * @brief The shared, prebuilt distance tree of the fixed Huffman blocks (BTYPE=01).
+ */
+extern const HuffmanTree* getFixedDistanceTree(void);
 #endif //DEFLATE_HUFFMAN_TABLE_H
\ No newline at end of file
@@ -0,0 +1,399 @@
+//
+// Created by Attila on 12/18/2025.
+//
+
+#include "batch.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef DEFLATE_DEBUGMALLOC
+#include "debugmalloc.h"
+#endif
+
+#include "ADLER_CHECKSUM.h"
+#include "compress.h"
+#include "CRC_CHECKSUM.h"
+#include "decompress.h"
+#include "HUFFMAN_TABLE.h"
+
+#define BATCH_INITIAL_CAPACITY 64
+
+/**
+ * @brief The files of one worker, largest first. The owner takes from the head, thieves take from the tail.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    BATCH_FILE** files;
+    size_t head;
+    size_t tail;
+} BATCH_DEQUE;
+
+typedef struct BATCH BATCH;
+
+typedef struct {
+    BATCH* batch;
+    unsigned id;
+    pthread_t thread;
+    COMPRESS_CONTEXT* compressContext;  ///< Reused for every file the worker compresses.
+    INFLATE_CONTEXT* inflateContext;    ///< Reused for every file the worker decompresses.
+    size_t failed;                      ///< Files of this worker which failed.
+} BATCH_WORKER;
+
+struct BATCH {
+    BATCH_DEQUE* deques;
+    BATCH_WORKER* workers;
+    unsigned threads;
+    BATCH_MODE mode;
+    CONTAINER_FORMAT format;
+    BATCH_COMPRESSION compression;
+    pthread_mutex_t outputLock; ///< Keeps the messages of the workers from interleaving.
+};
+
+/**
+ * @brief Initialize BATCH_LIST
+ *
+ * @returns BATCH_LIST* An empty list OR NULL. Must be freed with freeBATCH_LIST.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: sizeof(BATCH_LIST) + BATCH_INITIAL_CAPACITY * sizeof(BATCH_FILE)
+ *  - 64bit systems: sizeof(BATCH_LIST) + BATCH_INITIAL_CAPACITY * sizeof(BATCH_FILE)
+ */
+extern BATCH_LIST* initBATCH_LIST(void) {
+    BATCH_LIST* list = (BATCH_LIST*) malloc(sizeof(BATCH_LIST));
+    if (list == NULL) {
+        return NULL;
+    }
+    list->files = (BATCH_FILE*) malloc(BATCH_INITIAL_CAPACITY * sizeof(BATCH_FILE));
+    if (list->files == NULL) {
+        free(list);
+        return NULL;
+    }
+    list->count = 0;
+    list->capacity = BATCH_INITIAL_CAPACITY;
+    return list;
+}
+
+/**
+ * @brief Free BATCH_LIST
+ *
+ * @param list The list to free, with the paths in it. NULL is allowed.
+ */
+extern void freeBATCH_LIST(BATCH_LIST* list) {
+    if (list == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->files[i].path);
+    }
+    free(list->files);
+    free(list);
+}
+
+static bool appendBatchFile(BATCH_LIST* list, const char* path, const uint64_t size) {
+    if (list->count == list->capacity) {
+        BATCH_FILE* files = (BATCH_FILE*) realloc(list->files, 2 * list->capacity * sizeof(BATCH_FILE));
+        if (files == NULL) {
+            return false;
+        }
+        list->files = files;
+        list->capacity *= 2;
+    }
+    char* copy = (char*) malloc(strlen(path) + 1);
+    if (copy == NULL) {
+        return false;
+    }
+    strcpy(copy, path);
+    list->files[list->count].path = copy;
+    list->files[list->count].size = size;
+    list->count++;
+    return true;
+}
+
+static bool hasContainerExtension(const char* path, const CONTAINER_FORMAT format) {
+    const char* extension = getContainerExtension(format);
+    const size_t pathLen = strlen(path);
+    const size_t extensionLen = strlen(extension);
+    return pathLen > extensionLen + 1 && path[pathLen - extensionLen - 1] == '.' &&
+           strcmp(path + pathLen - extensionLen, extension) == 0;
+}
+
+/**
+ * @brief Adds the regular files below a directory. Symbolic links are skipped, so a link loop can't trap the walk.
+ * Compressing skips the files which already have the container's extension, decompressing takes only those.
+ */
+static bool addDirectory(BATCH_LIST* list, const char* directory, const bool compressing, const CONTAINER_FORMAT format) {
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Can't open directory %s\n", directory);
+        return true;
+    }
+
+    bool ok = true;
+    const size_t directoryLen = strlen(directory);
+    struct dirent* entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char* path = (char*) malloc(directoryLen + strlen(entry->d_name) + 2);
+        if (path == NULL) {
+            ok = false;
+            break;
+        }
+        strcpy(path, directory);
+        if (directoryLen == 0 || directory[directoryLen - 1] != '/') {
+            strcat(path, "/");
+        }
+        strcat(path, entry->d_name);
+
+        struct stat info;
+        if (lstat(path, &info) == 0) {
+            if (S_ISDIR(info.st_mode)) {
+                ok = addDirectory(list, path, compressing, format);
+            } else if (S_ISREG(info.st_mode) && hasContainerExtension(path, format) != compressing) {
+                ok = appendBatchFile(list, path, (uint64_t) info.st_size);
+            }
+        }
+        free(path);
+    }
+    closedir(dir);
+    return ok;
+}
+
+/**
+ * @brief Add Batch Path
+ *
+ * Adds a path given on the command line: a file as it is, a directory with all the files below it (recursively). A path
+ * which can't be read is still added, so its failure is reported when the batch runs.
+ *
+ * @param list The list.
+ * @param path The file or directory.
+ * @param compressing Whether the batch compresses (picks which files of a directory are taken).
+ * @param format The container of the batch.
+ *
+ * @returns bool false if the memory ran out.
+ */
+extern bool addBatchPath(BATCH_LIST* list, const char* path, const bool compressing, const CONTAINER_FORMAT format) {
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        return addDirectory(list, path, compressing, format);
+    }
+    return appendBatchFile(list, path, stat(path, &info) == 0 ? (uint64_t) info.st_size : 0);
+}
+
+static int compareBatchFilesBySizeDescending(const void* a, const void* b) {
+    const uint64_t sizeA = ((const BATCH_FILE*) a)->size;
+    const uint64_t sizeB = ((const BATCH_FILE*) b)->size;
+    return sizeA < sizeB ? 1 : sizeA > sizeB ? -1 : 0;
+}
+
+static BATCH_FILE* takeOwnFile(BATCH_DEQUE* deque) {
+    BATCH_FILE* file = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        file = deque->files[deque->head++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return file;
+}
+
+static BATCH_FILE* stealFile(BATCH_DEQUE* deque) {
+    BATCH_FILE* file = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        file = deque->files[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return file;
+}
+
+/**
+ * @brief Compresses one file of the batch in the layout of the batch, see BATCH_COMPRESSION.
+ */
+static STATUS* compressBatchFile(BATCH_WORKER* worker, char* path) {
+    const BATCH* batch = worker->batch;
+    const BATCH_COMPRESSION* compression = &batch->compression;
+    if (compression->bgzf) {
+        return compressBgzf(path, 1);
+    }
+    if (compression->seekable) {
+        return compressSeekable(path, 1, compression->flushInterval);
+    }
+    if (compression->independent) {
+        return compressMembers(path, 1, compression->chunkSize);
+    }
+    if (compression->pipeline) {
+        return compressPipelined(path, batch->format, 1);
+    }
+    return compressWithContext(worker->compressContext, path, batch->format);
+}
+
+/**
+ * @brief Runs the files of one worker, then steals from the others until every deque is empty. Nothing is added to
+ * the deques once the workers run, so an empty round means the batch is done.
+ */
+static void* batchWorker(void* arg) {
+    BATCH_WORKER* worker = arg;
+    BATCH* batch = worker->batch;
+
+    for (;;) {
+        BATCH_FILE* file = takeOwnFile(&batch->deques[worker->id]);
+        for (unsigned k = 1; file == NULL && k < batch->threads; k++) {
+            file = stealFile(&batch->deques[(worker->id + k) % batch->threads]);
+        }
+        if (file == NULL) {
+            break;
+        }
+
+        STATUS* status = batch->mode == BATCH_COMPRESS
+            ? compressBatchFile(worker, file->path)
+            : batch->mode == BATCH_VERIFY
+            ? verifyWithContext(worker->inflateContext, file->path, batch->format)
+            : decompressWithContext(worker->inflateContext, file->path, batch->format);
+        if (status->code != COMPRESSION_SUCCESS && status->code != DECOMPRESS_SUCCESS) {
+            worker->failed++;
+            pthread_mutex_lock(&batch->outputLock);
+            fprintf(stderr, "%s: %s\n", file->path, status->message != NULL ? status->message : "failed");
+            pthread_mutex_unlock(&batch->outputLock);
+        }
+        free(status->message);
+        free(status);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Frees the deques and the workers of a batch. Allocations which failed are skipped.
+ */
+static void freeBatch(BATCH* batch) {
+    if (batch->deques != NULL) {
+        for (unsigned t = 0; t < batch->threads; t++) {
+            free(batch->deques[t].files);
+        }
+        free(batch->deques);
+    }
+    if (batch->workers != NULL) {
+        for (unsigned t = 0; t < batch->threads; t++) {
+            freeCOMPRESS_CONTEXT(batch->workers[t].compressContext);
+            freeINFLATE_CONTEXT(batch->workers[t].inflateContext);
+        }
+        free(batch->workers);
+    }
+}
+
+/**
+ * @brief Process Batch
+ *
+ * Compresses, decompresses or verifies every file of the list with a pool of worker threads. The files are sorted largest first
+ * and dealt out to the workers round robin, so every worker starts with its largest files and the big ones don't end
+ * up last on a single thread. A worker which runs out of files steals the smallest remaining file of another one. Every
+ * worker keeps its COMPRESS_CONTEXT or INFLATE_CONTEXT for all the files it handles. The calling thread is worker 0.
+ *
+ * @param list The files, sorted by this function.
+ * @param mode Compress, decompress or verify the files.
+ * @param format The container to write or read.
+ * @param compression The layout of the compressed files, NULL for plain streams. Ignored unless compressing.
+ * @param limits The caps on decompressing every file, NULL for none. Ignored when compressing.
+ * @param threads The number of workers (1 - BATCH_MAX_THREADS).
+ *
+ * @returns STATUS* COMPRESSION_SUCCESS / DECOMPRESS_SUCCESS if every file succeeded. The failures are reported on
+ * stderr one by one. Must be freed.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: threads * (sizeof(COMPRESS_CONTEXT) or sizeof(INFLATE_CONTEXT)) + 4 * files
+ *  - 64bit systems: threads * (sizeof(COMPRESS_CONTEXT) or sizeof(INFLATE_CONTEXT)) + 8 * files
+ */
+extern STATUS* processBatch(BATCH_LIST* list, const BATCH_MODE mode, const CONTAINER_FORMAT format,
+                            const BATCH_COMPRESSION* compression, const INFLATE_LIMITS* limits, unsigned threads) {
+    STATUS* status = initSTATUS();
+    const bool compressing = mode == BATCH_COMPRESS;
+    if (threads < 1) threads = 1;
+    if (threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+    if (threads > list->count && list->count > 0) threads = (unsigned) list->count;
+
+    BATCH batch;
+    memset(&batch, 0, sizeof(BATCH));
+    batch.threads = threads;
+    batch.mode = mode;
+    batch.format = format;
+    if (compression != NULL) {
+        batch.compression = *compression;
+    }
+    batch.deques = (BATCH_DEQUE*) calloc(threads, sizeof(BATCH_DEQUE));
+    batch.workers = (BATCH_WORKER*) calloc(threads, sizeof(BATCH_WORKER));
+    bool allocated = batch.deques != NULL && batch.workers != NULL;
+    for (unsigned t = 0; allocated && t < threads; t++) {
+        batch.deques[t].files = (BATCH_FILE**) malloc((list->count / threads + 1) * sizeof(BATCH_FILE*));
+        batch.workers[t].batch = &batch;
+        batch.workers[t].id = t;
+        if (compressing) {
+            batch.workers[t].compressContext = initCOMPRESS_CONTEXT();
+            allocated = batch.workers[t].compressContext != NULL;
+        } else {
+            batch.workers[t].inflateContext = initINFLATE_CONTEXT();
+            allocated = batch.workers[t].inflateContext != NULL;
+            if (allocated && limits != NULL) {
+                batch.workers[t].inflateContext->limits = *limits;
+            }
+        }
+        allocated = allocated && batch.deques[t].files != NULL;
+    }
+    if (!allocated) {
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the batch!");
+        freeBatch(&batch);
+        return status;
+    }
+
+    qsort(list->files, list->count, sizeof(BATCH_FILE), compareBatchFilesBySizeDescending);
+    for (size_t i = 0; i < list->count; i++) {
+        BATCH_DEQUE* deque = &batch.deques[i % threads];
+        deque->files[deque->tail++] = &list->files[i];
+    }
+
+    // The lazily built shared tables are built before the workers race for them
+    calculate_crc32(CRC32_INITIAL_VALUE, NULL, 0);
+    calculate_adler32(ADLER32_INITIAL_VALUE, NULL, 0);
+    getFixedLiteralTree();
+
+    pthread_mutex_init(&batch.outputLock, NULL);
+    for (unsigned t = 0; t < threads; t++) {
+        pthread_mutex_init(&batch.deques[t].lock, NULL);
+    }
+    // A worker which can't be started leaves its files to be stolen by the others
+    bool* started = (bool*) calloc(threads, sizeof(bool));
+    for (unsigned t = 1; started != NULL && t < threads; t++) {
+        started[t] = pthread_create(&batch.workers[t].thread, NULL, batchWorker, &batch.workers[t]) == 0;
+    }
+    batchWorker(&batch.workers[0]);
+
+    size_t failed = batch.workers[0].failed;
+    for (unsigned t = 1; started != NULL && t < threads; t++) {
+        if (started[t]) {
+            pthread_join(batch.workers[t].thread, NULL);
+        }
+        failed += batch.workers[t].failed;
+    }
+    free(started);
+    for (unsigned t = 0; t < threads; t++) {
+        pthread_mutex_destroy(&batch.deques[t].lock);
+    }
+    pthread_mutex_destroy(&batch.outputLock);
+    freeBatch(&batch);
+
+    char message[128];
+    if (failed == 0) {
+        status->code = compressing ? COMPRESSION_SUCCESS : DECOMPRESS_SUCCESS;
+        snprintf(message, sizeof(message), "%s %zu file(s)!",
+                 compressing ? "Compressed" : mode == BATCH_VERIFY ? "Verified" : "Decompressed", list->count);
+    } else {
+        status->code = compressing ? COMPRESSION_FAILED : DECOMPRESS_FAILED;
+        snprintf(message, sizeof(message), "%zu of %zu file(s) failed!", failed, list->count);
+    }
+    createSTATUSMessage(status, message);
+    return status;
+}
@@ -0,0 +1,66 @@
+//
+// Created by Attila on 12/18/2025.
+//
+
+#ifndef DEFLATE_BATCH_H
+#define DEFLATE_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "container.h"
+#include "decompress.h"
+#include "status.h"
+
+#define BATCH_MAX_THREADS 256 // Upper bound on the worker threads of processBatch
+
+/**
+ * @brief What processBatch does with every file.
+ */
+typedef enum {
+    BATCH_COMPRESS,
+    BATCH_DECOMPRESS,
+    BATCH_VERIFY        ///< Decode and check the trailers without writing anything (-t).
+} BATCH_MODE;
+
+/**
+ * @brief How processBatch compresses every file, the first flag set wins, like for a single file with one thread. With
+ * every flag false the file becomes a plain stream of the batch's container, compressed with the worker's context.
+ */
+typedef struct {
+    bool bgzf;              ///< BGZF blocks (see compressBgzf).
+    bool seekable;          ///< A full flush every flushInterval bytes and their index (see compressSeekable).
+    bool independent;       ///< A gzip member of its own for every chunkSize bytes (see compressMembers).
+    bool pipeline;          ///< Read, match and entropy code on separate threads (see compressPipelined).
+    size_t chunkSize;
+    size_t flushInterval;
+} BATCH_COMPRESSION;
+
+/**
+ * @brief One file of a batch.
+ */
+typedef struct {
+    char* path;
+    uint64_t size;  ///< Size in bytes when the batch was collected, the scheduling order.
+} BATCH_FILE;
+
+/**
+ * @brief The files of a batch, collected from the command line.
+ */
+typedef struct {
+    BATCH_FILE* files;
+    size_t count;
+    size_t capacity;
+} BATCH_LIST;
+
+extern BATCH_LIST* initBATCH_LIST(void);
+
+extern void freeBATCH_LIST(BATCH_LIST* list);
+
+extern bool addBatchPath(BATCH_LIST* list, const char* path, bool compressing, CONTAINER_FORMAT format);
+
+extern STATUS* processBatch(BATCH_LIST* list, BATCH_MODE mode, CONTAINER_FORMAT format,
+                            const BATCH_COMPRESSION* compression, const INFLATE_LIMITS* limits, unsigned threads);
+
+#endif //DEFLATE_BATCH_H
@@ -0,0 +1,364 @@
+//
+// Created by Attila on 12/21/2025.
+//
+
+#include "bgzf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef DEFLATE_DEBUGMALLOC
+#include "debugmalloc.h"
+#endif
+
+#include "bitreader.h"
+
+#define BGZF_ID1 'B' // The BC subfield: BSIZE, the size of the block minus 1
+#define BGZF_ID2 'C'
+#define BGZF_MEMBER_OVERHEAD 20 // Header without the extra field (12) and trailer (8) of a gzip member
+
+/**
+ * @brief The end of file marker of BGZF: an empty block, which readers use to tell a complete file from a truncated one.
+ */
+static const uint8_t BGZF_EOF[28] = {
+    0x1F, 0x8B, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+    0x1B, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/**
+ * @brief Write BGZF Header
+ *
+ * Writes the gzip header of a BGZF block: FEXTRA with the BC subfield. BSIZE isn't known before the block is
+ * compressed, so it is written as 0 and set later with setBgzfBlockSize.
+ *
+ * @param bw The BIT_WRITER, a memory sink collecting the block.
+ */
+extern void writeBgzfHeader(BIT_WRITER* bw) {
+    const uint8_t extra[6] = {BGZF_ID1, BGZF_ID2, 2, 0, 0, 0};
+    writeGzipExtraHeader(bw, extra, sizeof(extra));
+}
+
+/**
+ * @brief Set BGZF Block Size
+ *
+ * @param block The complete block, starting with the header written by writeBgzfHeader.
+ * @param size The size of the block, at most BGZF_MAX_BLOCK_SIZE.
+ */
+extern void setBgzfBlockSize(uint8_t* block, const size_t size) {
+    block[16] = (uint8_t) ((size - 1) & 0xFF);
+    block[17] = (uint8_t) ((size - 1) >> 8);
+}
+
+/**
+ * @brief Write BGZF EOF
+ *
+ * Writes the end of file marker closing every BGZF file.
+ */
+extern void writeBgzfEof(BIT_WRITER* bw) {
+    for (size_t i = 0; i < sizeof(BGZF_EOF); i++) {
+        addBytes(bw, BGZF_EOF[i], 1);
+    }
+}
+
+/**
+ * @brief Read BGZF Block Size
+ *
+ * Checks whether the bytes start with the header of a BGZF block: a gzip member header with only FEXTRA set, whose
+ * extra field holds a BC subfield.
+ *
+ * @param bytes The start of the member.
+ * @param size The bytes available, at least the header is needed.
+ * @param headerSize Output: the size of the header, the deflate stream starts after it.
+ *
+ * @returns size_t The size of the block (BSIZE + 1) OR 0 if it isn't a BGZF block.
+ */
+extern size_t readBgzfBlockSize(const uint8_t* bytes, const size_t size, size_t* headerSize) {
+    if (size < 12 || bytes[0] != 0x1F || bytes[1] != 0x8B || bytes[2] != 0x08 || bytes[3] != 0x04) {
+        return 0;
+    }
+    const size_t xlen = bytes[10] | (size_t) bytes[11] << 8;
+    const uint8_t* data = NULL;
+    size_t length = 0;
+    if (12 + xlen > size || !find_gzip_subfield(bytes + 12, xlen, BGZF_ID1, BGZF_ID2, &data, &length) || length != 2) {
+        return 0;
+    }
+    const size_t blockSize = (data[0] | (size_t) data[1] << 8) + 1;
+    if (blockSize < BGZF_MEMBER_OVERHEAD + xlen) {
+        return 0;
+    }
+    *headerSize = 12 + xlen;
+    return blockSize;
+}
+
+static uint32_t loadLittleEndian32(const uint8_t* bytes) {
+    return bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+/**
+ * @brief Scan BGZF Blocks
+ *
+ * Follows the BSIZE fields of a BGZF file held in memory from block to block, without decompressing anything.
+ *
+ * @param data The whole file.
+ * @param size The size of the file.
+ *
+ * @returns SEEK_INDEX* The start of every block (compressedOffset is the start of the gzip member) and its position in
+ * the decompressed data OR NULL if the file isn't made of BGZF blocks. Must be freed with freeSEEK_INDEX.
+ */
+extern SEEK_INDEX* scanBgzfBlocks(const uint8_t* data, const size_t size) {
+    SEEK_INDEX* blocks = initSEEK_INDEX();
+    if (blocks == NULL) {
+        return NULL;
+    }
+    uint64_t position = 0;
+    uint64_t output = 0;
+    bool valid = size > 0;
+    while (valid && position < size) {
+        size_t headerSize = 0;
+        const size_t blockSize = readBgzfBlockSize(data + position, size - position, &headerSize);
+        valid = blockSize > 0 && blockSize <= size - position && addSeekPoint(blocks, position, output);
+        if (valid) {
+            const uint32_t isize = loadLittleEndian32(data + position + blockSize - 4);
+            valid = isize <= BGZF_MAX_BLOCK_SIZE;
+            output += isize;
+            position += blockSize;
+        }
+    }
+    if (!valid) {
+        freeSEEK_INDEX(blocks);
+        return NULL;
+    }
+    blocks->totalOutput = output;
+    blocks->indexOffset = size;
+    return blocks;
+}
+
+static bool readAt(FILE* file, const uint64_t offset, uint8_t* bytes, const size_t length) {
+#if defined(_WIN32)
+    if (_fseeki64(file, (__int64) offset, SEEK_SET) != 0) return false;
+#else
+    if (fseeko(file, (off_t) offset, SEEK_SET) != 0) return false;
+#endif
+    return fread(bytes, 1, length, file) == length;
+}
+
+/**
+ * @brief Read Block At
+ *
+ * Reads the header and the ISIZE of the BGZF block starting at offset.
+ *
+ * @returns size_t The size of the block OR 0 if there is no valid block there.
+ */
+static size_t readBlockAt(FILE* file, const uint64_t offset, const uint64_t fileSize, uint8_t* header, uint32_t* isize) {
+    if (offset + 12 > fileSize || !readAt(file, offset, header, 12)) {
+        return 0;
+    }
+    const size_t xlen = header[10] | (size_t) header[11] << 8;
+    size_t headerSize = 0;
+    uint8_t trailer[4];
+    if (offset + 12 + xlen > fileSize || !readAt(file, offset + 12, header + 12, xlen)) {
+        return 0;
+    }
+    const size_t blockSize = readBgzfBlockSize(header, 12 + xlen, &headerSize);
+    if (blockSize == 0 || offset + blockSize > fileSize || !readAt(file, offset + blockSize - 4, trailer, 4)) {
+        return 0;
+    }
+    *isize = loadLittleEndian32(trailer);
+    return *isize <= BGZF_MAX_BLOCK_SIZE ? blockSize : 0;
+}
+
+/**
+ * @brief Is BGZF File
+ *
+ * @returns bool Whether the file starts with a BGZF block.
+ */
+extern bool isBgzfFile(const char* filename) {
+    struct stat info;
+    FILE* file = stat(filename, &info) == 0 ? fopen(filename, "rb") : NULL;
+    uint8_t* header = (uint8_t*) malloc(12 + 65535);
+    uint32_t isize = 0;
+    const bool bgzf = file != NULL && header != NULL && readBlockAt(file, 0, (uint64_t) info.st_size, header, &isize) > 0;
+    free(header);
+    if (file != NULL) fclose(file);
+    return bgzf;
+}
+
+static char* gziPath(const char* filename) {
+    char* path = (char*) malloc(strlen(filename) + strlen(BGZF_INDEX_EXTENSION) + 2);
+    if (path != NULL) {
+        strcpy(path, filename);
+        strcat(path, ".");
+        strcat(path, BGZF_INDEX_EXTENSION);
+    }
+    return path;
+}
+
+/**
+ * @brief Load Gzi Index
+ *
+ * Reads a .gzi file: the number of entries, then the compressed and uncompressed offset of every block but the first
+ * one, all 64 bit little endian.
+ *
+ * @returns bool false if there is no valid .gzi file for a file of this size.
+ */
+static bool loadGziIndex(const char* filename, const uint64_t fileSize, SEEK_INDEX* blocks) {
+    char* path = gziPath(filename);
+    FILE* file = path != NULL ? fopen(path, "rb") : NULL;
+    free(path);
+    if (file == NULL) {
+        return false;
+    }
+    uint8_t entry[16];
+    bool valid = fread(entry, 1, 8, file) == 8 && addSeekPoint(blocks, 0, 0);
+    uint64_t count = 0;
+    for (int i = 7; valid && i >= 0; i--) {
+        count = count << 8 | entry[i];
+    }
+    for (uint64_t i = 0; valid && i < count; i++) {
+        valid = fread(entry, 1, 16, file) == 16;
+        uint64_t compressedOffset = 0;
+        uint64_t outputOffset = 0;
+        for (int b = 7; valid && b >= 0; b--) {
+            compressedOffset = compressedOffset << 8 | entry[b];
+            outputOffset = outputOffset << 8 | entry[8 + b];
+        }
+        const SEEK_POINT* last = &blocks->points[blocks->count - 1];
+        valid = valid && compressedOffset > last->compressedOffset && compressedOffset < fileSize &&
+                outputOffset >= last->outputOffset && addSeekPoint(blocks, compressedOffset, outputOffset);
+    }
+    fclose(file);
+    return valid;
+}
+
+/**
+ * @brief Find BGZF Blocks
+ *
+ * Finds the blocks of a BGZF file: from its .gzi index if useIndex is set and there is one, otherwise by following the
+ * BSIZE fields of the block headers, which reads only the headers and trailers.
+ *
+ * @returns SEEK_INDEX* The blocks (see scanBgzfBlocks) OR NULL if the file isn't a BGZF file. Must be freed.
+ */
+static SEEK_INDEX* findBgzfBlocks(const char* filename, const bool useIndex) {
+    struct stat info;
+    if (stat(filename, &info) != 0) {
+        return NULL;
+    }
+    const uint64_t fileSize = (uint64_t) info.st_size;
+    FILE* file = fopen(filename, "rb");
+    SEEK_INDEX* blocks = initSEEK_INDEX();
+    uint8_t* header = (uint8_t*) malloc(12 + 65535);
+    uint32_t isize = 0;
+    bool valid = file != NULL && blocks != NULL && header != NULL && readBlockAt(file, 0, fileSize, header, &isize) > 0;
+
+    if (valid && useIndex && loadGziIndex(filename, fileSize, blocks)) {
+        // The last entry is the start of the last block, or of the EOF marker
+        const SEEK_POINT* last = &blocks->points[blocks->count - 1];
+        valid = readBlockAt(file, last->compressedOffset, fileSize, header, &isize) > 0;
+        blocks->totalOutput = last->outputOffset + isize;
+    } else if (valid) {
+        blocks->count = 0;
+        uint64_t position = 0;
+        uint64_t output = 0;
+        while (valid && position < fileSize) {
+            const size_t blockSize = readBlockAt(file, position, fileSize, header, &isize);
+            valid = blockSize > 0 && addSeekPoint(blocks, position, output);
+            output += isize;
+            position += blockSize;
+        }
+        blocks->totalOutput = output;
+    }
+    free(header);
+    if (file != NULL) fclose(file);
+    if (!valid) {
+        freeSEEK_INDEX(blocks);
+        return NULL;
+    }
+    blocks->indexOffset = fileSize;
+    return blocks;
+}
+
+/**
+ * @brief Load BGZF Blocks
+ *
+ * Finds the blocks of a BGZF file, from its .gzi index if there is one.
+ *
+ * @param filename The compressed file.
+ *
+ * @returns SEEK_INDEX* The blocks (see scanBgzfBlocks) OR NULL if the file isn't a BGZF file. Must be freed.
+ *
+ * Maximum memory required:
+ *  - 16 bytes per block, and a 64 KB header buffer
+ */
+extern SEEK_INDEX* loadBgzfBlocks(const char* filename) {
+    return findBgzfBlocks(filename, true);
+}
+
+/**
+ * @brief Save Gzi Index
+ *
+ * Writes the blocks of a BGZF file into "<file>.gzi", in the format of bgzip -i.
+ *
+ * @param blocks The blocks, the first one at offset 0 isn't stored.
+ * @param filename The compressed file.
+ *
+ * @returns STATUS* The result. Must be freed.
+ */
+extern STATUS* saveGziIndex(const SEEK_INDEX* blocks, const char* filename) {
+    STATUS* status = initSTATUS();
+    status->code = COMPRESSION_SUCCESS;
+    createSTATUSMessage(status, "Index saved!");
+
+    char* path = gziPath(filename);
+    FILE* file = path != NULL ? fopen(path, "wb") : NULL;
+    free(path);
+    if (file == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t create the index file!");
+        return status;
+    }
+    uint8_t entry[16];
+    const uint64_t count = blocks->count > 0 ? blocks->count - 1 : 0;
+    for (int b = 0; b < 8; b++) entry[b] = (uint8_t) (count >> (8 * b));
+    bool written = fwrite(entry, 1, 8, file) == 8;
+    for (size_t i = 1; written && i < blocks->count; i++) {
+        for (int b = 0; b < 8; b++) {
+            entry[b] = (uint8_t) (blocks->points[i].compressedOffset >> (8 * b));
+            entry[8 + b] = (uint8_t) (blocks->points[i].outputOffset >> (8 * b));
+        }
+        written = fwrite(entry, 1, 16, file) == 16;
+    }
+    if (fclose(file) != 0 || !written) {
+        status->code = COMPRESSION_FAILED;
+        createSTATUSMessage(status, "Can\'t write the index file!");
+    }
+    return status;
+}
+
+/**
+ * @brief Index BGZF File
+ *
+ * Finds the blocks of a BGZF file from its headers and saves them as "<file>.gzi".
+ *
+ * @param filename The compressed file.
+ *
+ * @returns STATUS* The result. Must be freed.
+ */
+extern STATUS* indexBgzfFile(const char* filename) {
+    SEEK_INDEX* blocks = findBgzfBlocks(filename, false);
+    if (blocks == NULL) {
+        STATUS* status = initSTATUS();
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "Not a BGZF file!");
+        return status;
+    }
+    STATUS* status = saveGziIndex(blocks, filename);
+    if (status->code == COMPRESSION_SUCCESS) {
+        char message[96];
+        snprintf(message, sizeof(message), "Indexed %llu bytes in %llu BGZF blocks!",
+                 (unsigned long long) blocks->totalOutput, (unsigned long long) blocks->count);
+        createSTATUSMessage(status, message);
+    }
+    freeSEEK_INDEX(blocks);
+    return status;
+}
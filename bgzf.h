@@ -0,0 +1,39 @@
+//
+// Created by Attila on 12/21/2025.
+//
+
+#ifndef DEFLATE_BGZF_H
+#define DEFLATE_BGZF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitwriter.h"
+#include "seekable.h"
+#include "status.h"
+
+#define BGZF_BLOCK_INPUT_SIZE 0xFF00 // Input of one block (as bgzip), even stored it fits into BGZF_MAX_BLOCK_SIZE
+#define BGZF_MAX_BLOCK_SIZE 65536    // Upper bound on the size of a block and on its decompressed size
+#define BGZF_HEADER_SIZE 18          // The gzip header of a block with the BC subfield as its only extra field
+#define BGZF_INDEX_EXTENSION "gzi"   // The block index of "data.gz" is "data.gz.gzi", as made by bgzip -i
+
+extern void writeBgzfHeader(BIT_WRITER* bw);
+
+extern void setBgzfBlockSize(uint8_t* block, size_t size);
+
+extern void writeBgzfEof(BIT_WRITER* bw);
+
+extern size_t readBgzfBlockSize(const uint8_t* bytes, size_t size, size_t* headerSize);
+
+extern SEEK_INDEX* scanBgzfBlocks(const uint8_t* data, size_t size);
+
+extern bool isBgzfFile(const char* filename);
+
+extern SEEK_INDEX* loadBgzfBlocks(const char* filename);
+
+extern STATUS* saveGziIndex(const SEEK_INDEX* blocks, const char* filename);
+
+extern STATUS* indexBgzfFile(const char* filename);
+
+#endif //DEFLATE_BGZF_H
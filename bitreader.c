@@ -8,13 +8,20 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef DEFLATE_DEBUGMALLOC
 #include "debugmalloc.h"
+#endif
 
 // --- GZIP Constants ---
 #define GZIP_ID1 0x1f
 #define GZIP_ID2 0x8b
 #define GZIP_CM_DEFLATE 0x08
 
+// --- ZLIB Constants ---
+#define ZLIB_CM_DEFLATE 0x08 // CM field of the zlib CMF byte
+#define ZLIB_MAX_CINFO 7     // log2(window size) - 8, at most a 32K window
+#define ZLIB_FDICT 0x20      // A preset dictionary identifier follows the header
+
 // --- GZIP Flags (FLG byte) ---
 #define FTEXT    0x01 // Header contains text file indication
 #define FHCRC    0x02 // Header CRC16 is present
@@ -24,6 +31,8 @@
 
 
 static int load_next_chunk(BIT_READER *reader) {
+    if (reader->file == NULL) return 0; // A memory reader holds all of its data from the start
+    reader->buffer_offset += reader->buffer_size;
     size_t bytes_read = fread(reader->buffer, 1, BUFFER_SIZE, reader->file);
 
     reader->buffer_index = 0;
@@ -36,19 +45,15 @@ static int load_next_chunk(BIT_READER *reader) {
     return 1;
 }
 
-// Loads the next byte from the memory buffer into the bit accumulator (reader->byte).
-static int load_next_byte(BIT_READER *reader) {
-    // Check if we exhausted the memory buffer
-    if (reader->buffer_index >= reader->buffer_size) {
-        int load_status = load_next_chunk(reader);
-        if (load_status <= 0) return load_status; // EOF or Error
+// Tops up the bit accumulator to at least 57 bits, or until the end of the file.
+static void refill_bits(BIT_READER *reader) {
+    while (reader->bitCount <= 56) {
+        if (reader->buffer_index >= reader->buffer_size) {
+            if (load_next_chunk(reader) <= 0) return; // EOF or Error
+        }
+        reader->bitBuffer |= (uint64_t) reader->buffer[reader->buffer_index++] << reader->bitCount;
+        reader->bitCount += 8;
     }
-
-    // Load byte from memory buffer
-    reader->byte = reader->buffer[reader->buffer_index];
-    reader->buffer_index++;
-    reader->currentPosition = 0;
-    return 1;
 }
 
 // --- Public Functions ---
@@ -66,58 +71,99 @@ BIT_READER* init_bit_reader(const char *filePath) {
     reader->buffer = (uint8_t*) malloc(BUFFER_SIZE);
 
     // Initialize state
-    reader->currentPosition = 8; // Force load_next_byte on first read
+    reader->bitBuffer = 0;
+    reader->bitCount = 0;
     reader->buffer_index = 0;
     reader->buffer_size = 0;
-    reader->byte = 0;
+    reader->buffer_offset = 0;
+    reader->overrun = false;
 
     return reader;
 }
 
-int read_bit(BIT_READER *reader) {
-    // 1. Check if the current byte accumulator is exhausted
-    if (reader->currentPosition >= 8) {
-        int load_status = load_next_byte(reader);
-        if (load_status <= 0) return -1; // EOF or Error
+extern void init_memory_bit_reader(BIT_READER* reader, const uint8_t* data, const size_t size, const uint64_t bitOffset) {
+    reader->file = NULL;
+    reader->buffer = (uint8_t*) data;
+    reader->buffer_size = size;
+    reader->buffer_index = (size_t) (bitOffset >> 3) < size ? (size_t) (bitOffset >> 3) : size;
+    reader->buffer_offset = 0;
+    reader->bitBuffer = 0;
+    reader->bitCount = 0;
+    reader->overrun = false;
+    if ((bitOffset & 7) != 0) {
+        refill_bits(reader);
+        consume_bits(reader, (uint8_t) (bitOffset & 7));
     }
+}
+
+extern uint64_t bit_reader_position(const BIT_READER* reader) {
+    return (reader->buffer_offset + reader->buffer_index) * 8 - reader->bitCount;
+}
+
+extern bool seek_bit_reader(BIT_READER* reader, const uint64_t bitOffset) {
+    if (reader->file == NULL) {
+        init_memory_bit_reader(reader, reader->buffer, reader->buffer_size, bitOffset);
+        return true;
+    }
+#if defined(_WIN32)
+    if (_fseeki64(reader->file, (__int64) (bitOffset >> 3), SEEK_SET) != 0) return false;
+#else
+    if (fseeko(reader->file, (off_t) (bitOffset >> 3), SEEK_SET) != 0) return false;
+#endif
+    reader->buffer_offset = bitOffset >> 3;
+    reader->buffer_index = 0;
+    reader->buffer_size = 0;
+    reader->bitBuffer = 0;
+    reader->bitCount = 0;
+    reader->overrun = false;
+    if ((bitOffset & 7) != 0) {
+        refill_bits(reader);
+        consume_bits(reader, (uint8_t) (bitOffset & 7));
+    }
+    return true;
+}
 
-    // 2. Extract the bit: LSB-first order.
-    uint8_t bit = (reader->byte >> reader->currentPosition) & 1;
+int read_bit(BIT_READER *reader) {
+    if (reader->bitCount == 0) {
+        refill_bits(reader);
+        if (reader->bitCount == 0) {
+            reader->overrun = true;
+            return -1; // EOF or Error
+        }
+    }
 
-    // 3. Advance the position
-    reader->currentPosition++;
+    // LSB-first order.
+    int bit = (int) (reader->bitBuffer & 1);
+    reader->bitBuffer >>= 1;
+    reader->bitCount--;
 
-    return (int)bit;
+    return bit;
 }
 
-// --- REWRITTEN: Function to read multiple bits ---
 uint32_t read_bits(BIT_READER *reader, int numBits) {
     if (numBits < 1 || numBits > 32) {
         fprintf(stderr, "Error: Invalid number of bits requested (%d).\n", numBits);
         return 0xFFFFFFFF; // Error value
     }
 
-    uint32_t result = 0;
-
-    // Read bits one by one, constructing the value in LSB-first order
-    for (int i = 0; i < numBits; i++) {
-        int bit = read_bit(reader);
-
-        if (bit == -1) {
-            // Reached unexpected end of stream
-            fprintf(stderr, "Error: Unexpected EOF while reading %d bits (got %d of %d).\n", numBits, i, numBits);
+    if (reader->bitCount < numBits) {
+        refill_bits(reader);
+        if (reader->bitCount < numBits) {
+            // Reached unexpected end of stream. Memory readers are used to decode speculatively, where this is expected.
+            // Reported once, the decoder stops at its next check of reader->overrun.
+            if (reader->file != NULL && !reader->overrun) fprintf(stderr, "Error: Unexpected EOF while reading %d bits (got %d of %d).\n", numBits, reader->bitCount, numBits);
+            reader->overrun = true;
             return 0xFFFFFFFF; // Error value
         }
-
-        // Place the read bit (0 or 1) into the correct position in the result.
-        // Since DEFLATE header fields and extra bits are read LSB-first,
-        // the first bit read goes to result[0], the second to result[1], and so on.
-        result |= (uint32_t)bit << i;
     }
 
+    // DEFLATE header fields and extra bits are read LSB-first, which is exactly the order of the accumulator.
+    uint32_t result = (uint32_t) (reader->bitBuffer & ((1ULL << numBits) - 1));
+    reader->bitBuffer >>= numBits;
+    reader->bitCount -= numBits;
+
     return result;
 }
-// --------------------------------------------------
 
 void freeBIT_READER(BIT_READER *reader) {
     if (reader->file) fclose(reader->file);
@@ -126,53 +172,100 @@ void freeBIT_READER(BIT_READER *reader) {
 }
 
 
-// Function to peek 'n' bits into the stream without advancing the actual reader
+// Function to peek 'n' bits into the stream without advancing the actual reader.
+// Near the end of the file the missing bits are returned as 0-s, which is what the Huffman decoder needs
+// when the last code is shorter than the peeked width.
 extern uint16_t peek_bits(BIT_READER* reader, uint8_t n) {
     if (n < 1 || n > 16) return 0xFFFF; // Max uint16_t (16 bits)
 
-    // --- 1. State Copy (Memory Only) ---
-
-    // Create a local copy of the reader state variables for calculation
-    uint16_t result = 0;
-
-    // State of the current byte being consumed:
-    uint8_t temp_byte = reader->byte;
-    uint8_t temp_pos = reader->currentPosition;
-
-    // State of the memory buffer:
-    size_t temp_buf_idx = reader->buffer_index;
-    size_t temp_buf_size = reader->buffer_size;
-
-    // --- 2. Calculation Loop (Safe, no file I/O) ---
-
-    for (int i = 0; i < n; i++) {
-        // If current byte accumulator is exhausted, look in the buffer
-        if (temp_pos >= 8) {
-            // Check if buffer is exhausted
-            if (temp_buf_idx >= temp_buf_size) {
-                // If we reach here, we need to read from file, which is unsafe for peek.
-                // We stop and return an error.
-                return 0xFFFF;
-            }
-            // Load next byte from buffer (in memory)
-            temp_byte = reader->buffer[temp_buf_idx];
-            temp_buf_idx++;
-            temp_pos = 0; // Reset bit position
+    if (reader->bitCount < n) {
+        refill_bits(reader);
+    }
+
+    return (uint16_t) (reader->bitBuffer & ((1U << n) - 1));
+}
+
+extern void consume_bits(BIT_READER* reader, uint8_t n) {
+    if (n > reader->bitCount) {
+        // A code was decoded from the zero bits peek_bits returns after the end of the stream
+        n = reader->bitCount;
+        reader->overrun = true;
+    }
+    reader->bitBuffer >>= n;
+    reader->bitCount -= n;
+}
+
+extern void align_to_byte(BIT_READER* reader) {
+    consume_bits(reader, reader->bitCount % 8);
+}
+
+extern size_t read_aligned_bytes(BIT_READER* reader, uint8_t* destination, size_t length) {
+    size_t copied = 0;
+
+    // 1. Bytes already pulled into the bit accumulator.
+    while (copied < length && reader->bitCount >= 8) {
+        destination[copied++] = (uint8_t) reader->bitBuffer;
+        reader->bitBuffer >>= 8;
+        reader->bitCount -= 8;
+    }
+
+    // 2. Bulk copy the rest straight from the read buffer.
+    while (copied < length) {
+        if (reader->buffer_index >= reader->buffer_size) {
+            if (load_next_chunk(reader) <= 0) break; // EOF or Error
         }
+        size_t available = reader->buffer_size - reader->buffer_index;
+        size_t n = length - copied < available ? length - copied : available;
+        memcpy(destination + copied, reader->buffer + reader->buffer_index, n);
+        reader->buffer_index += n;
+        copied += n;
+    }
 
-        // Extract the bit: LSB-first order.
-        uint8_t bit = (temp_byte >> temp_pos) & 1;
-        temp_pos++;
+    return copied;
+}
 
-        // Add bit to result (LSB-first)
-        result |= (uint16_t)bit << i;
+extern bool at_end_of_stream(BIT_READER* reader) {
+    if (reader->bitCount >= 8 || reader->buffer_index < reader->buffer_size) {
+        return false;
     }
+    return load_next_chunk(reader) <= 0;
+}
 
-    return result;
+extern bool at_end_of_gzip_members(BIT_READER* reader) {
+    while (!at_end_of_stream(reader)) {
+        if (peek_bits(reader, 8) != 0) {
+            return false;
+        }
+        consume_bits(reader, 8);
+    }
+    return true;
+}
+
+// Skips a zero terminated string of the gzip header (FNAME, FCOMMENT).
+static bool skip_zero_terminated(BIT_READER *reader) {
+    uint32_t byte;
+    do {
+        byte = read_bits(reader, 8);
+        if (byte == 0xFFFFFFFF) return false;
+    } while (byte != 0);
+    return true;
 }
 
 bool process_gzip_header(BIT_READER *reader) {
-    uint8_t id1, id2, cm, flg, xfl, os;
+    return process_gzip_header_extra(reader, NULL, 0, NULL);
+}
+
+/**
+ * Reads and validates a gzip member header (RFC 1952), keeping its extra field (FEXTRA).
+ * @param reader Pointer to the initialized BIT_READER.
+ * @param extra Receives the first 'capacity' bytes of the extra field, NULL to skip it.
+ * @param capacity The size of extra.
+ * @param extraLength Receives XLEN (0 without an extra field), NULL is allowed.
+ * @return true if the header is valid and the deflate stream follows.
+ */
+bool process_gzip_header_extra(BIT_READER *reader, uint8_t *extra, const size_t capacity, size_t *extraLength) {
+    uint8_t id1, id2, cm, flg;
+    uint32_t xfl, os;
 
     // 1. Check Magic Bytes (ID1, ID2) - 2 bytes
     id1 = read_bits(reader, 8);
@@ -193,39 +286,90 @@ bool process_gzip_header(BIT_READER *reader) {
     // 3. Flags (FLG) - 1 byte
     flg = read_bits(reader, 8);
 
-    // --- BEGIN User's requested simple flag check ---
-    if (flg != 0x00) {
-        fprintf(stderr, "Warning: Only GZIP files with FLAG=0x00 are supported at this stage. Found flag 0x%02x.\n", flg);
-        // For now, we will fail if it's not 0x00, as requested by the user's initial logic.
+    if (flg & 0xE0) {
+        fprintf(stderr, "Error: Reserved GZIP flag bits are set (flag 0x%02x).\n", flg);
         return false;
     }
-    // --- END User's requested simple flag check ---
 
+    // 4. Modification time (MTIME) - 4 bytes
     read_bits(reader,32);
 
     // 5. Extra Flags (XFL) - 1 byte
     xfl = read_bits(reader, 8);
-    if (xfl == 0xFF) return false; // Check for EOF
+    if (xfl == 0xFFFFFFFF) return false; // Check for EOF
 
     // 6. Operating System (OS) - 1 byte
     os = read_bits(reader, 8);
-    if (os == 0xFF) return false; // Check for EOF
+    if (os == 0xFFFFFFFF) return false; // Check for EOF
 
-
-    // --- Handling Optional Fields (Disabled for FLG=0x00) ---
-    /*
+    // --- Optional Fields, in the order of RFC 1952 ---
+    if (extraLength != NULL) *extraLength = 0;
     if (flg & FEXTRA) {
-        // Read 16-bit extra field length (XLEN)
-        uint16_t xlen = read_le_u16(reader);
-        // Skip XLEN bytes
-        for (int i = 0; i < xlen; i++) {
-            if (read_byte_aligned_u8(reader) == 0xFF) return false;
+        // Read 16-bit extra field length (XLEN) and the field, keeping what fits into extra
+        uint32_t xlen = read_bits(reader, 16);
+        if (xlen == 0xFFFFFFFF) return false;
+        for (uint32_t i = 0; i < xlen; i++) {
+            const uint32_t byte = read_bits(reader, 8);
+            if (byte == 0xFFFFFFFF) return false;
+            if (extra != NULL && i < capacity) extra[i] = (uint8_t) byte;
         }
+        if (extraLength != NULL) *extraLength = xlen;
     }
+    if ((flg & FNAME) && !skip_zero_terminated(reader)) return false;
+    if ((flg & FCOMMENT) && !skip_zero_terminated(reader)) return false;
+    if ((flg & FHCRC) && read_bits(reader, 16) == 0xFFFFFFFF) return false;
 
-    // ... logic for FNAME, FCOMMENT, FHCRC would follow here ...
-    */
+    return true;
+}
 
-    printf("GZIP Header successfully processed. Ready for DEFLATE stream.\n");
+/**
+ * Looks up a subfield of a gzip extra field (RFC 1952 2.3.1.1), e.g. the BC subfield of a BGZF block.
+ * @param extra The extra field.
+ * @param length XLEN, the size of the extra field.
+ * @param id1 SI1 of the subfield.
+ * @param id2 SI2 of the subfield.
+ * @param data Receives the data of the subfield.
+ * @param dataLength Receives LEN, the size of the data.
+ * @return true if the subfield is present and fits into the extra field.
+ */
+bool find_gzip_subfield(const uint8_t *extra, const size_t length, const uint8_t id1, const uint8_t id2,
+                        const uint8_t **data, size_t *dataLength) {
+    size_t position = 0;
+    while (position + 4 <= length) {
+        const size_t subfieldLength = extra[position + 2] | (size_t) extra[position + 3] << 8;
+        if (position + 4 + subfieldLength > length) return false;
+        if (extra[position] == id1 && extra[position + 1] == id2) {
+            *data = extra + position + 4;
+            *dataLength = subfieldLength;
+            return true;
+        }
+        position += 4 + subfieldLength;
+    }
+    return false;
+}
+
+/**
+ * Reads and validates the 2 byte zlib header (RFC 1950).
+ * Streams which need a preset dictionary (FDICT) are rejected, since the dictionary is not known here.
+ * @param reader Pointer to the initialized BIT_READER.
+ * @return true if the header is valid and the deflate stream follows.
+ */
+bool process_zlib_header(BIT_READER *reader) {
+    const uint32_t cmf = read_bits(reader, 8);
+    const uint32_t flg = read_bits(reader, 8);
+    if (cmf == 0xFFFFFFFF || flg == 0xFFFFFFFF) return false; // Check for EOF
+
+    if ((cmf & 0x0F) != ZLIB_CM_DEFLATE || (cmf >> 4) > ZLIB_MAX_CINFO) {
+        fprintf(stderr, "Error: Unsupported zlib compression method or window (CMF 0x%02x).\n", cmf);
+        return false;
+    }
+    if ((cmf * 256 + flg) % 31 != 0) {
+        fprintf(stderr, "Error: Invalid zlib header check bits (CMF 0x%02x, FLG 0x%02x).\n", cmf, flg);
+        return false;
+    }
+    if (flg & ZLIB_FDICT) {
+        fprintf(stderr, "Error: zlib streams with a preset dictionary are not supported.\n");
+        return false;
+    }
     return true;
 }
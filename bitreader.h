@@ -10,12 +10,14 @@
 
 typedef struct {
     FILE *file;
-    uint8_t byte;
-    uint8_t currentPosition;
+    uint64_t bitBuffer;       // Bit accumulator, the next bit of the stream is always bit 0
+    uint8_t bitCount;         // Number of valid bits in bitBuffer
 
-    uint8_t *buffer;          // New: Memory buffer
-    size_t buffer_index;      // New: Index in buffer
-    size_t buffer_size;       // New: Size of valid data in buffer
+    uint8_t *buffer;          // Memory buffer
+    size_t buffer_index;      // Index in buffer
+    size_t buffer_size;       // Size of valid data in buffer
+    uint64_t buffer_offset;   // Offset of buffer[0] in the file (0 for a memory reader)
+    bool overrun;             // More bits were asked for than the stream holds (truncated or corrupt input)
 } BIT_READER;
 /**
  * Initializes the BIT_READER structure.
@@ -25,6 +27,31 @@ typedef struct {
  */
 BIT_READER* init_bit_reader(const char *filePath);
 
+/**
+ * Initializes a BIT_READER over a memory buffer instead of a file, e.g. to start decoding at any bit of a compressed
+ * file already in memory. The reader doesn't own the memory and must not be passed to freeBIT_READER.
+ * @param reader The BIT_READER to initialize (usually on the stack).
+ * @param data The compressed data.
+ * @param size The size of the data in bytes.
+ * @param bitOffset The bit of the data to start reading at.
+ */
+extern void init_memory_bit_reader(BIT_READER* reader, const uint8_t* data, size_t size, uint64_t bitOffset);
+
+/**
+ * Returns the position of the next unread bit.
+ * @param reader Pointer to the initialized BIT_READER.
+ * @return The bit offset from the start of the file (or the data of a memory reader).
+ */
+extern uint64_t bit_reader_position(const BIT_READER* reader);
+
+/**
+ * Moves the reader to any bit of the file (or the data of a memory reader), e.g. an access point of an index.
+ * @param reader Pointer to the initialized BIT_READER.
+ * @param bitOffset The bit offset from the start of the file.
+ * @return false if the file can't be positioned there.
+ */
+extern bool seek_bit_reader(BIT_READER* reader, uint64_t bitOffset);
+
 /**
  * Reads a single bit from the stream.
  * Handles reading new bytes from the file when the current byte is exhausted.
@@ -51,8 +78,58 @@ void freeBIT_READER(BIT_READER *reader);
 
 bool process_gzip_header(BIT_READER *reader);
 
+bool process_gzip_header_extra(BIT_READER *reader, uint8_t *extra, size_t capacity, size_t *extraLength);
+
+bool find_gzip_subfield(const uint8_t *extra, size_t length, uint8_t id1, uint8_t id2, const uint8_t **data,
+                        size_t *dataLength);
+
+/**
+ * Reads and validates the 2 byte zlib header (RFC 1950).
+ * @param reader Pointer to the initialized BIT_READER.
+ * @return true if the header is valid, false otherwise (including a preset dictionary).
+ */
+bool process_zlib_header(BIT_READER *reader);
+
 extern uint16_t peek_bits(BIT_READER* reader, uint8_t n);
 
+/**
+ * Drops 'n' bits which were already looked at with peek_bits.
+ * @param reader Pointer to the initialized BIT_READER.
+ * @param n The number of bits to drop (must be <= the bits returned by the last peek_bits).
+ * Dropping more bits than the stream has left sets overrun.
+ */
+extern void consume_bits(BIT_READER* reader, uint8_t n);
+
+/**
+ * Skips the remaining bits of the current byte (used before stored blocks and the gzip trailer).
+ * @param reader Pointer to the initialized BIT_READER.
+ */
+extern void align_to_byte(BIT_READER* reader);
+
+/**
+ * Copies 'length' whole bytes from a byte aligned stream straight out of the read buffer.
+ * @param reader Pointer to the initialized BIT_READER. Must be byte aligned (see align_to_byte).
+ * @param destination The memory to copy to.
+ * @param length The number of bytes to copy.
+ * @return The number of bytes copied, less than length only at the end of the file.
+ */
+extern size_t read_aligned_bytes(BIT_READER* reader, uint8_t* destination, size_t length);
+
+/**
+ * Checks whether a byte aligned stream has no more bytes, e.g. whether another gzip member follows the trailer.
+ * @param reader Pointer to the initialized BIT_READER. Must be byte aligned (see align_to_byte).
+ * @return true if the end of the file is reached.
+ */
+extern bool at_end_of_stream(BIT_READER* reader);
+
+/**
+ * Checks whether a gzip file ends after a member: nothing or only zero bytes follow the trailer (padding of a tape or
+ * block device, which gzip ignores too). The zero bytes are skipped.
+ * @param reader Pointer to the initialized BIT_READER. Must be byte aligned (see align_to_byte).
+ * @return true if no other member follows, false if a non-zero byte does (which must start the next header).
+ */
+extern bool at_end_of_gzip_members(BIT_READER* reader);
+
 
 
 #endif //DEFLATE_BITREADER_H
\ No newline at end of file
@@ -4,16 +4,55 @@
 
 #include "bitwriter.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ADLER_CHECKSUM.h"
+#include "CRC_CHECKSUM.h"
+#include "spsc_queue.h"
 
 #define MAGIC_NUMER 0x8B1F
 #define COMPRESSION_METHOD 0x08 //deflate
 #define FLAG 0b00000000 //RESERVED,RESERVED,RESERVED, FCOMMENT, FNAME, FEXTRA, FHCRC FTEXT
+#define FLAG_FEXTRA 0b00000100 // FLG of a member with an extra field
 #define XFL 0x00
 #define OS 0x03 //FAT filesystem
 
+#define ZLIB_CMF 0x78 // CM = 8 (deflate), CINFO = 7 (32K window)
+#define ZLIB_FLEVEL_DEFAULT 0x80 // FLEVEL = 2, FDICT = 0, FCHECK is added so that (CMF * 256 + FLG) % 31 == 0
+
+#define OUTPUT_THREAD_STOP ((size_t) -1) // Queued instead of a buffer to end the output thread
+
+/**
+ * @brief The output regions of a window BIT_WRITER and the thread writing them.
+ *
+ * Every buffer is either the one the decoder writes into (current), a spare of the decoder, or handed to the output
+ * thread: queued in 'filled', being written, or queued back in 'done'. Only the decoder touches spare and
+ * outstanding, only the output thread touches the checksums and totalBytes of the BIT_WRITER while buffers are out.
+ */
+struct OUTPUT_THREAD {
+    uint8_t** buffers;
+    size_t* lengths;        ///< Bytes after the history to write, per buffer.
+    size_t count;
+    size_t current;         ///< The buffer the decoder writes into (bw->buffer).
+    size_t* spare;          ///< Buffers the decoder owns besides current.
+    size_t spareCount;
+    size_t outstanding;     ///< Buffers handed to the output thread and not yet taken back.
+    SPSC_QUEUE* filled;     ///< Decoder -> output thread: buffers to write.
+    SPSC_QUEUE* done;       ///< Output thread -> decoder: written buffers.
+    pthread_t thread;
+};
+
 /**
  * @brief Reverses the bits of a 16-bit integer.
  * Helper function for writing Huffman codes.
@@ -49,10 +88,280 @@ extern void writeHuffmanCode(BIT_WRITER* bw, uint16_t code, uint8_t length) {
     addBits(bw, reversed, length);
 }
 
+/**
+ * @brief Is Zero Page
+ *
+ * Checks SPARSE_PAGE_SIZE bytes for zeros, 64 bytes at a time (SSE2 where available). Real data almost never starts a
+ * page with 64 zero bytes, so a page of data is rejected after the first step.
+ */
+static bool isZeroPage(const uint8_t* page) {
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < SPARSE_PAGE_SIZE; i += 64) {
+        const __m128i a = _mm_loadu_si128((const __m128i*) (page + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*) (page + i + 16));
+        const __m128i c = _mm_loadu_si128((const __m128i*) (page + i + 32));
+        const __m128i d = _mm_loadu_si128((const __m128i*) (page + i + 48));
+        const __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+    return true;
+#else
+    for (size_t i = 0; i < SPARSE_PAGE_SIZE; i += 64) {
+        uint64_t words[8];
+        memcpy(words, page + i, sizeof(words));
+        if ((words[0] | words[1] | words[2] | words[3] | words[4] | words[5] | words[6] | words[7]) != 0) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Write Sparse
+ *
+ * Writes output to a sparse file: every run of whole, page aligned, all-zero pages is skipped with a seek, which leaves
+ * a hole in the file, and everything else is written. The end of the file is set by finishSparseFile, as a trailing
+ * hole doesn't extend the file by itself. A failed seek or write sets writeError.
+ *
+ * @returns size_t The number of bytes written or skipped.
+ */
+static size_t writeSparse(BIT_WRITER* bw, const uint8_t* data, const size_t length) {
+    size_t position = 0;
+    while (position < length) {
+        const size_t inPage = (size_t) ((bw->fileOffset + position) % SPARSE_PAGE_SIZE);
+        const bool hole = inPage == 0 && length - position >= SPARSE_PAGE_SIZE && isZeroPage(data + position);
+        size_t run = SPARSE_PAGE_SIZE - inPage < length - position ? SPARSE_PAGE_SIZE - inPage : length - position;
+        while (length - (position + run) >= SPARSE_PAGE_SIZE && isZeroPage(data + position + run) == hole) {
+            run += SPARSE_PAGE_SIZE;
+        }
+        if (!hole && length - (position + run) < SPARSE_PAGE_SIZE) {
+            run = length - position; // The partial page at the end is never a hole
+        }
+
+        if (hole) {
+#if defined(_WIN32)
+            const bool moved = _fseeki64(bw->file, (__int64) run, SEEK_CUR) == 0;
+#else
+            const bool moved = fseeko(bw->file, (off_t) run, SEEK_CUR) == 0;
+#endif
+            if (!moved) {
+                bw->writeError = true;
+                return position;
+            }
+        } else if (fwrite(data + position, 1, run, bw->file) != run) {
+            bw->writeError = true;
+            return position;
+        }
+        position += run;
+    }
+    return position;
+}
+
+/**
+ * @brief Finish Sparse File
+ *
+ * Sets the size of a sparse output file to the bytes written and skipped, which creates the hole at its end if the
+ * output ends with zero pages. Without ftruncate (Windows) the file is extended with _chsize_s, where the skipped pages
+ * read back as zeros but take up disk space. A failure sets writeError, as the file doesn't hold the output then.
+ */
+static void finishSparseFile(BIT_WRITER* bw) {
+    if (fflush(bw->file) != 0) {
+        bw->writeError = true;
+    }
+#if defined(_WIN32)
+    if (_chsize_s(_fileno(bw->file), (__int64) bw->fileOffset) != 0) {
+        bw->writeError = true;
+    }
+#else
+    if (ftruncate(fileno(bw->file), (off_t) bw->fileOffset) != 0) {
+        bw->writeError = true;
+    }
+#endif
+}
+
+/**
+ * @brief Write Output
+ *
+ * Adds flushed output to the checksums and the size, hands it to the sink, and writes the part of it selected by
+ * skipBytes and writeLimit to the file. A window without a file only checksums its output (and feeds the sink).
+ *
+ * @returns size_t Elements written to the file.
+ */
+static size_t writeOutput(BIT_WRITER* bw, const uint8_t* data, size_t length) {
+    if (bw->computeCRC) {
+        bw->crc32 = calculate_crc32(bw->crc32, data, length);
+    }
+    if (bw->computeAdler32) {
+        bw->adler32 = calculate_adler32(bw->adler32, data, length);
+    }
+    bw->totalBytes += length;
+    if (bw->sink != NULL) {
+        bw->sink(bw->sinkContext, data, length);
+    }
+    if (bw->file == NULL) {
+        return 0;
+    }
+
+    const size_t skipped = bw->skipBytes < length ? (size_t) bw->skipBytes : length;
+    bw->skipBytes -= skipped;
+    data += skipped;
+    length -= skipped;
+    if (length > bw->writeLimit) {
+        length = (size_t) bw->writeLimit;
+    }
+    bw->writeLimit -= length;
+    if (length == 0) {
+        return 0;
+    }
+    const size_t written = bw->sparse ? writeSparse(bw, data, length) : fwrite(data, 1, length, bw->file);
+    bw->fileOffset += written;
+    if (written != length) {
+        bw->writeError = true; // E.g. the disk is full, the rest of the output is still decoded but the file is lost
+    }
+    return written;
+}
+
+/**
+ * @brief Run Output Thread
+ *
+ * Checksums and writes the buffers handed over by the decoder until OUTPUT_THREAD_STOP.
+ */
+static void* runOutputThread(void* argument) {
+    BIT_WRITER* bw = (BIT_WRITER*) argument;
+    OUTPUT_THREAD* output = bw->outputThread;
+    while (1) {
+        const size_t buffer = spscPop(output->filled);
+        if (buffer == OUTPUT_THREAD_STOP) {
+            return NULL;
+        }
+        writeOutput(bw, output->buffers[buffer] + bw->historySize, output->lengths[buffer]);
+        spscPush(output->done, buffer);
+    }
+}
+
+/**
+ * @brief Hand Off Buffer
+ *
+ * Queues the pending output of the current buffer to the output thread and continues in a spare buffer (waiting for
+ * one only if all of them are still being written). The history is copied to the front of the new buffer.
+ */
+static void handOffBuffer(BIT_WRITER* bw) {
+    OUTPUT_THREAD* output = bw->outputThread;
+    if (bw->index == bw->historySize) {
+        return;
+    }
+    size_t next;
+    if (output->spareCount > 0) {
+        next = output->spare[--output->spareCount];
+    } else {
+        next = spscPop(output->done);
+        output->outstanding--;
+    }
+    memcpy(output->buffers[next], bw->buffer + bw->index - bw->historySize, bw->historySize);
+
+    output->lengths[output->current] = bw->index - bw->historySize;
+    bw->streamStart -= (int64_t) (bw->index - bw->historySize);
+    spscPush(output->filled, output->current);
+    output->outstanding++;
+
+    output->current = next;
+    bw->buffer = output->buffers[next];
+    bw->index = bw->historySize;
+}
+
+/**
+ * @brief Wait For Output Thread
+ *
+ * Takes back every buffer handed to the output thread, after which the checksums and the size are final.
+ */
+static void waitForOutputThread(OUTPUT_THREAD* output) {
+    while (output->outstanding > 0) {
+        output->spare[output->spareCount++] = spscPop(output->done);
+        output->outstanding--;
+    }
+}
+
+/**
+ * @brief Free OUTPUT_THREAD
+ *
+ * Frees the buffers and queues, except the buffer the BIT_WRITER still points to. The thread must be stopped already.
+ */
+static void freeOUTPUT_THREAD(OUTPUT_THREAD* output) {
+    if (output->buffers != NULL) {
+        for (size_t i = 0; i < output->count; i++) {
+            if (i != output->current) free(output->buffers[i]);
+        }
+    }
+    free(output->buffers);
+    free(output->lengths);
+    free(output->spare);
+    freeSPSC_QUEUE(output->filled);
+    freeSPSC_QUEUE(output->done);
+    free(output);
+}
+
+/**
+ * @brief Start Output Thread
+ *
+ * Moves the checksumming and writing of a window BIT_WRITER's output to a thread of its own. When the window slides,
+ * the filled buffer is handed over a lock-free queue and the decoder continues in another one, so it never waits for
+ * fwrite or the checksum unless all buffers are still being written. flushBIT_WRITERBuffer waits for all of them, so
+ * the checksums are final after it as before. Stopped by freeBIT_WRITER.
+ *
+ * @param bw A window BIT_WRITER (see initWindowBIT_WRITER) with its file opened.
+ * @param buffers The number of output regions, at least 2 (OUTPUT_THREAD_BUFFERS).
+ *
+ * @returns bool false if the thread can't be started, the BIT_WRITER then keeps writing on the calling thread.
+ *
+ * Maximum memory required:
+ *  - (buffers - 1) * bufferSize + sizeof(OUTPUT_THREAD) + 3 * 8 * buffers bytes
+ */
+extern bool startOutputThread(BIT_WRITER* bw, const size_t buffers) {
+    OUTPUT_THREAD* output = (OUTPUT_THREAD*) calloc(1, sizeof(OUTPUT_THREAD));
+    if (output == NULL || buffers < 2) {
+        free(output);
+        return false;
+    }
+    output->count = buffers;
+    output->buffers = (uint8_t**) calloc(buffers, sizeof(uint8_t*));
+    output->lengths = (size_t*) malloc(buffers * sizeof(size_t));
+    output->spare = (size_t*) malloc(buffers * sizeof(size_t));
+    output->filled = initSPSC_QUEUE(buffers + 1);
+    output->done = initSPSC_QUEUE(buffers);
+    bool ready = output->buffers != NULL && output->lengths != NULL && output->spare != NULL &&
+                 output->filled != NULL && output->done != NULL;
+    if (ready) {
+        output->buffers[0] = bw->buffer;
+        for (size_t i = 1; i < buffers && ready; i++) {
+            output->buffers[i] = (uint8_t*) malloc(bw->bufferSize);
+            ready = output->buffers[i] != NULL;
+            output->spare[output->spareCount++] = i;
+        }
+    }
+
+    // The checksum tables are built on first use, which must not happen on several threads at once
+    calculate_crc32(CRC32_INITIAL_VALUE, NULL, 0);
+    calculate_adler32(ADLER32_INITIAL_VALUE, NULL, 0);
+    bw->outputThread = output;
+    if (!ready || pthread_create(&output->thread, NULL, runOutputThread, bw) != 0) {
+        bw->outputThread = NULL;
+        freeOUTPUT_THREAD(output);
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief Flush BIT_WRITER Buffer
  *
- * This function dumps all the buffer data into the file, and then sets the BIT_WRITER's current index pointer back to 0.
+ * This function dumps all the pending buffer data into the file, and then sets the BIT_WRITER's current index pointer
+ * back to the end of the history region (0 when the writer keeps no history). For the decompressor's output window the
+ * checksum (CRC32 or Adler-32) and the size of the data is updated here, right before it is written, while it is still
+ * in the cache.
  *
  * @param bw BIT_WRITER* object.
  *
@@ -63,10 +372,18 @@ extern void writeHuffmanCode(BIT_WRITER* bw, uint16_t code, uint8_t length) {
  *  - 64bit systems: 24 bytes
  */
 extern size_t flushBIT_WRITERBuffer(BIT_WRITER* bw) {
-    //printf("index = %d\n",bw->index);
-    size_t elementsWritten = fwrite(bw->buffer,1,bw->index,bw->file);
-    //printf("Elements written to file: %llu \n", elementsWritten);
-    bw->index = 0;
+    if (bw->outputThread != NULL) {
+        const size_t pending = bw->index - bw->historySize;
+        handOffBuffer(bw);
+        waitForOutputThread(bw->outputThread);
+        return pending;
+    }
+    size_t elementsWritten = 0;
+    if (bw->index > bw->historySize) {
+        elementsWritten = writeOutput(bw, bw->buffer + bw->historySize, bw->index - bw->historySize);
+        bw->streamStart -= (int64_t) (bw->index - bw->historySize);
+    }
+    bw->index = bw->historySize;
     return elementsWritten;
 }
 
@@ -87,14 +404,147 @@ extern size_t flushBIT_WRITERBuffer(BIT_WRITER* bw) {
 extern BIT_WRITER* initBIT_WRITER(const size_t bufferSize) {
     BIT_WRITER* bw = (BIT_WRITER*) malloc(sizeof(BIT_WRITER));
     bw->file = NULL; //temp
+    bw->fileName = NULL;
     bw->byte = 0;
     bw->buffer = (uint8_t*) malloc(bufferSize);
     bw->currentPosition = 0;
     bw->bufferSize = bufferSize;
     bw->index = 0;
+    bw->historySize = 0;
+    bw->computeCRC = false;
+    bw->crc32 = CRC32_INITIAL_VALUE;
+    bw->computeAdler32 = false;
+    bw->adler32 = ADLER32_INITIAL_VALUE;
+    bw->totalBytes = 0;
+    bw->growable = false;
+    bw->outputThread = NULL;
+    bw->skipBytes = 0;
+    bw->writeLimit = UINT64_MAX;
+    bw->sparse = false;
+    bw->fileOffset = 0;
+    bw->sink = NULL;
+    bw->sinkContext = NULL;
+    bw->writeError = false;
+    bw->overflow = false;
+    bw->streamStart = 0;
+    return bw;
+}
+
+/**
+ * @brief Initialize Window BIT_WRITER
+ *
+ * This function creates a BIT_WRITER used as the decompressor's output window. The buffer is laid out as
+ * [historySize bytes of history][outputSize bytes of fresh output]. Only the fresh output region is ever written to the
+ * file, always in outputSize sized pieces, and when it fills up only the last historySize bytes are copied back to the
+ * front. So for a 1 MB output region and a 32 KB window the copy overhead is about 3% of the output instead of 50%.
+ *
+ * @param historySize The size of the history kept for back-references (WINDOW_SIZE for deflate).
+ * @param outputSize The size of the region written out in one fwrite call.
+ *
+ * @return BIT_WRITER* The pointer to a BIT_WRITER object OR NULL.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: historySize + outputSize + 24 bytes
+ *  - 64bit systems: historySize + outputSize + 48 bytes
+ */
+extern BIT_WRITER* initWindowBIT_WRITER(const size_t historySize, const size_t outputSize) {
+    BIT_WRITER* bw = initBIT_WRITER(historySize + outputSize);
+    if (bw == NULL || bw->buffer == NULL) {
+        if (bw != NULL) free(bw);
+        return NULL;
+    }
+    // The history of a fresh stream is all zeros, so an invalid back-reference can't read garbage.
+    memset(bw->buffer, 0, historySize);
+    bw->historySize = historySize;
+    bw->index = historySize;
+    bw->streamStart = (int64_t) historySize; // Nothing before the first byte of the output can be referred to
+    bw->computeCRC = true;
+    return bw;
+}
+
+/**
+ * @brief Grow Buffer
+ *
+ * Doubles the buffer of a memory sink BIT_WRITER. If the memory can't be allocated the buffer is kept and the bytes
+ * written so far are dropped, so a failed allocation ends up as a corrupt (but not crashing) output.
+ *
+ * @param bw BIT_WRITER* object created by initMemoryBIT_WRITER.
+ */
+static void growBuffer(BIT_WRITER* bw) {
+    uint8_t* buffer = (uint8_t*) realloc(bw->buffer, bw->bufferSize * 2);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Can't grow the memory BIT_WRITER beyond %llu bytes!\n",
+                (unsigned long long) bw->bufferSize);
+        bw->index = 0;
+        return;
+    }
+    bw->buffer = buffer;
+    bw->bufferSize *= 2;
+}
+
+/**
+ * @brief Initialize Memory BIT_WRITER
+ *
+ * This function creates a BIT_WRITER which collects the output in memory instead of a file (e.g. the compressed
+ * piece of one worker thread). The buffer doubles whenever it fills up, the bytes written so far are buffer[0, index).
+ *
+ * @param initialSize The initial size of the buffer.
+ *
+ * @return BIT_WRITER* The pointer to a BIT_WRITER object OR NULL.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: the largest output rounded up to initialSize * 2^n + 24 bytes
+ *  - 64bit systems: the largest output rounded up to initialSize * 2^n + 48 bytes
+ */
+extern BIT_WRITER* initMemoryBIT_WRITER(const size_t initialSize) {
+    BIT_WRITER* bw = initBIT_WRITER(initialSize);
+    if (bw == NULL || bw->buffer == NULL) {
+        if (bw != NULL) free(bw);
+        return NULL;
+    }
+    bw->growable = true;
     return bw;
 }
 
+/**
+ * @brief Reset Memory BIT_WRITER
+ *
+ * Drops the collected output of a memory sink BIT_WRITER, keeping its buffer for the next piece.
+ *
+ * @param bw BIT_WRITER* object created by initMemoryBIT_WRITER.
+ */
+extern void resetMemoryBIT_WRITER(BIT_WRITER* bw) {
+    bw->index = 0;
+    bw->byte = 0;
+    bw->currentPosition = 0;
+}
+
+/**
+ * @brief Write Raw Bytes
+ *
+ * Writes already encoded bytes (e.g. a byte aligned piece of a deflate stream from a memory BIT_WRITER) to the file of
+ * the BIT_WRITER. The bit stream is padded to a byte boundary first.
+ *
+ * @param bw BIT_WRITER* object with an open file. Without a file nothing is written and writeError is set.
+ * @param data The bytes to write.
+ * @param length The number of bytes.
+ */
+extern void writeRawBytes(BIT_WRITER* bw, const uint8_t* data, const size_t length) {
+    if (bw->file == NULL) {
+        bw->writeError = true;
+        return;
+    }
+    flushBitstreamWriter(bw);
+    flushBIT_WRITERBuffer(bw);
+    if (length > 0) {
+        if (fwrite(data, 1, length, bw->file) != length) {
+            bw->writeError = true;
+            return;
+        }
+        bw->totalBytes += length;
+    }
+}
+
 /**
  * @brief Flush Byte
  *
@@ -113,7 +563,13 @@ static void flushByte(BIT_WRITER* bw) {
     bw->byte = 0;
     bw->currentPosition = 0;
     //printf("%d\t",bw->index);
-    if (bw->index == bw->bufferSize) flushBIT_WRITERBuffer(bw);
+    if (bw->index == bw->bufferSize) {
+        if (bw->growable) {
+            growBuffer(bw);
+        } else {
+            flushBIT_WRITERBuffer(bw);
+        }
+    }
 }
 
 /**
@@ -198,79 +654,192 @@ extern void addBytes(BIT_WRITER* bw, const uint32_t value, const uint8_t bytes)
     }
 }
 
+/**
+ * @brief Splice Bits
+ *
+ * Appends the bits collected by another (memory sink) BIT_WRITER at the current bit position, which doesn't have to be
+ * on a byte boundary: 'length' whole bytes followed by the 'trailingBits' low bits of trailingByte. This is how pieces
+ * of a deflate stream encoded separately (e.g. blocks entropy coded by different threads) are joined without padding.
+ *
+ * @param bw BIT_WRITER* object.
+ * @param data The whole bytes of the piece, the first bit of the piece is bit 0 of data[0].
+ * @param length The number of whole bytes.
+ * @param trailingByte The last, partial byte of the piece (the byte field of its BIT_WRITER).
+ * @param trailingBits The number of valid bits in trailingByte (the currentPosition field of its BIT_WRITER, 0 - 7).
+ */
+extern void spliceBits(BIT_WRITER* bw, const uint8_t* data, size_t length, const uint8_t trailingByte,
+                       const uint8_t trailingBits) {
+    const uint8_t shift = bw->currentPosition;
+    if (shift == 0) {
+        // Byte aligned: copy in bulk
+        while (length > 0) {
+            const size_t space = bw->bufferSize - bw->index;
+            const size_t n = length < space ? length : space;
+            memcpy(bw->buffer + bw->index, data, n);
+            bw->index += n;
+            data += n;
+            length -= n;
+            if (bw->index == bw->bufferSize) {
+                if (bw->growable) {
+                    growBuffer(bw);
+                } else {
+                    flushBIT_WRITERBuffer(bw);
+                }
+            }
+        }
+    } else {
+        // Every byte of the piece is split between the pending byte and the next one
+        for (size_t i = 0; i < length; i++) {
+            bw->byte |= (uint8_t) (data[i] << shift);
+            flushByte(bw);
+            bw->byte = (uint8_t) (data[i] >> (8 - shift));
+            bw->currentPosition = shift;
+        }
+    }
+    addBits(bw, trailingByte, trailingBits);
+}
+
 /**
  * @brief Helper to handle sliding window when the buffer is full.
- * Instead of flushing everything to 0, it keeps the second half of the buffer
- * as history at the beginning of the buffer.
+ *
+ * The whole fresh output region is written in one piece, then only the last historySize bytes are copied to the start
+ * of the buffer, so later back-references still find them.
+ *
+ * A window without history (e.g. the output of one BGZF block) holds the whole output and never slides: running out
+ * of space sets overflow instead, and the next bytes land at the front of the buffer, so nothing is written or read
+ * outside of it before the decoder gives up.
  */
 static void handleBufferSlide(BIT_WRITER* bw) {
-    // We assume the buffer is allocated as 2 * WINDOW_SIZE (e.g. 64KB).
-    // We keep the last half as history (32KB).
-    size_t keepSize = bw->bufferSize / 2;
-    size_t writeSize = bw->index - keepSize;
-    printf("keepSize: %llu, writeSize: %llu\n",keepSize,writeSize);
-    // 1. Write the old data (the first half) to disk
-    if (writeSize > 0) {
-        size_t elementsWrittenToTheFile = fwrite(bw->buffer, 1, writeSize, bw->file);
-        printf("Elements written to the file: %llu\n",elementsWrittenToTheFile);
+    if (bw->historySize == 0) {
+        bw->overflow = true;
+        bw->index = 0;
+        bw->streamStart = 0;
+        return;
     }
+    if (bw->outputThread != NULL) {
+        handOffBuffer(bw);
+        return;
+    }
+    flushBIT_WRITERBuffer(bw);
 
-    // 2. Move the recent data (history) to the start of the buffer
-    memmove(bw->buffer, bw->buffer + writeSize, keepSize);
-
-    // 3. Reset index to point immediately after the kept history
-    // This ensures subsequent writes happen after the history.
-    bw->index = keepSize;
+    if (bw->historySize > 0) {
+        memcpy(bw->buffer, bw->buffer + bw->bufferSize - bw->historySize, bw->historySize);
+    }
 }
 
 extern void addFastByte(BIT_WRITER* bw, const uint8_t byte) {
     bw->buffer[bw->index++] = byte;
-    //printf("%llu\n",bw->index);
     if (bw->index == bw->bufferSize) {
         handleBufferSlide(bw);
     }
 }
 
-// 2. Copies 'length' bytes starting from 'distance' bytes back.
-extern void copyFromBufferHistory(BIT_WRITER* bw, const uint16_t distance, const uint16_t length) {
-    for (uint16_t i = 0; i < length; i++) {
-        // We look back 'distance' bytes from the CURRENT write position.
-        // Even if we just wrote a byte (incremented index), we look back from the new index.
-        int source_index = bw->index - distance;
-
-        // CRITICAL CHECK: Did we fall off the start of the buffer?
-        // This happens if bufferSize is too small for the file being decompressed.
-        if (source_index < 0) {
-            fprintf(stderr, "Error: LZ77 Copy Underflow at index %d, dist %d. Buffer too small/Flushed!\n", bw->index, distance);
-            // In a real app, you would handle this error (e.g. abort).
-            // For now, writing 0 to avoid crash, but output is corrupt.
-            addFastByte(bw, 0);
-            continue;
-        }
+/**
+ * @brief Get Free Window Space
+ *
+ * Returns the place of the next output byte, so bulk data (e.g. a stored block) can be copied straight into the output
+ * window. Must be followed by commitWindowBytes.
+ *
+ * @param bw BIT_WRITER* object.
+ * @param available Output: how many bytes can be written before the window has to slide. Always at least 1.
+ *
+ * @return uint8_t* The first free byte of the window.
+ */
+extern uint8_t* getFreeWindowSpace(BIT_WRITER* bw, size_t* available) {
+    *available = bw->bufferSize - bw->index;
+    return bw->buffer + bw->index;
+}
 
-        // Read the byte from history
-        uint8_t byte = bw->buffer[source_index];
+/**
+ * @brief Commit Window Bytes
+ *
+ * Marks 'count' bytes written through getFreeWindowSpace as output, and slides the window if it got full.
+ *
+ * @param bw BIT_WRITER* object.
+ * @param count The number of bytes written (at most the available bytes returned by getFreeWindowSpace).
+ */
+extern void commitWindowBytes(BIT_WRITER* bw, const size_t count) {
+    bw->index += count;
+    if (bw->index == bw->bufferSize) {
+        handleBufferSlide(bw);
+    }
+}
 
-        // Write it to the current position (this handles overlaps like dist=1 len=10)
-        addFastByte(bw, byte);
+/**
+ * @brief Copy From Buffer History
+ *
+ * Copies 'length' bytes starting from 'distance' bytes back. When the whole match fits before the end of the buffer
+ * (which is almost always the case with a large output region) the copy is done in place without any per byte checks.
+ * Overlapping matches (distance < length, e.g. dist=1 len=10) are copied forward byte by byte, since they repeat the
+ * bytes they have just produced.
+ *
+ * A match reaching back before the first byte of the stream (see startOutputStream) is rejected instead of being read
+ * from the zero filled history, like "invalid distance too far back" in zlib. In a window without history, a match
+ * which doesn't fit the rest of the buffer is rejected as well, and sets overflow.
+ *
+ * @param bw BIT_WRITER* object.
+ * @param distance The distance of the match (1 - 32768).
+ * @param length The length of the match (3 - 258).
+ *
+ * @returns bool false if the distance reaches before the start of the stream or the match overflows a window without
+ * history, nothing is copied then.
+ */
+extern bool copyFromBufferHistory(BIT_WRITER* bw, const uint16_t distance, const uint16_t length) {
+    if (distance == 0 || (int64_t) distance > (int64_t) bw->index - bw->streamStart) {
+        return false;
+    }
+
+    if (bw->index + length < bw->bufferSize) {
+        uint8_t* destination = bw->buffer + bw->index;
+        const uint8_t* source = destination - distance;
+        if (distance >= length) {
+            memcpy(destination, source, length);
+        } else {
+            for (uint16_t i = 0; i < length; i++) destination[i] = source[i];
+        }
+        bw->index += length;
+        return true;
+    }
+
+    // Slow path: the match crosses the end of the buffer, so let addFastByte slide the window when needed.
+    if (bw->historySize == 0) {
+        bw->overflow = true;
+        return false;
+    }
+    for (uint16_t i = 0; i < length; i++) {
+        addFastByte(bw, bw->buffer[bw->index - distance]);
     }
+    return true;
 }
 
 /**
- * @brief Create File
+ * @brief Start Output Stream
+ *
+ * Marks the current position as the start of a new deflate stream (e.g. the next gzip member): its back-references
+ * can't reach the output before it (see copyFromBufferHistory).
+ *
+ * @param bw The output window.
+ */
+extern void startOutputStream(BIT_WRITER* bw) {
+    bw->streamStart = (int64_t) bw->index;
+}
+
+/**
+ * @brief Open Container File
  *
- * This function opens/creates a file with the fileName and extension parameters, and then writes the .gz header information
- * into the opened file.
+ * This function opens/creates a file named fileName plus the extension of the container, without writing anything into
+ * it yet.
  *
  * @param bw The BIT_WRITER object.
  * @param fileName The file name to be created.
- * @param extension The extension of the file.
+ * @param format The container whose extension is appended.
  *
  * Maximum memory required:
  *  - 32bit systems: 20 bytes
  *  - 64bit systems: 40 bytes
  */
-extern void createFile(BIT_WRITER* bw, const char* fileName, const char* extension) {
+extern void openContainerFile(BIT_WRITER* bw, const char* fileName, const CONTAINER_FORMAT format) {
+    const char* extension = getContainerExtension(format);
     char* newFileName = (char*) malloc(strlen(fileName) + strlen(extension) + 2);
     strcpy(newFileName, fileName);
     strcat(newFileName, ".");
@@ -279,24 +848,128 @@ extern void createFile(BIT_WRITER* bw, const char* fileName, const char* extensi
     FILE* file = fopen(newFileName, "wb");
     bw->fileName = newFileName;
     bw->file = file;
+}
+
+/**
+ * @brief Write Container Header
+ *
+ * Writes the header of the container: the 10 byte gzip member header, the 2 byte zlib header, or nothing for raw
+ * deflate. Also used for every member of a multi-member gzip file.
+ *
+ * @param bw The BIT_WRITER object.
+ * @param format The container to write.
+ */
+extern void writeContainerHeader(BIT_WRITER* bw, const CONTAINER_FORMAT format) {
+    if (format == CONTAINER_GZIP) {
+        addBytes(bw, MAGIC_NUMER, 2); //ID1 ID2
+        addBytes(bw, COMPRESSION_METHOD, 1); //CM
+        addBytes(bw, FLAG,1); //FLG
+        addBytes(bw, (uint32_t) time(NULL), 4); //MTIME
+        addBytes(bw, XFL,1); //XFL
+        addBytes(bw, OS, 1);
+    } else if (format == CONTAINER_ZLIB) {
+        const uint8_t flg = ZLIB_FLEVEL_DEFAULT + (31 - (ZLIB_CMF * 256 + ZLIB_FLEVEL_DEFAULT) % 31) % 31;
+        addBytes(bw, ZLIB_CMF, 1); //CMF
+        addBytes(bw, flg, 1); //FLG
+    }
+}
 
+/**
+ * @brief Write Gzip Extra Header
+ *
+ * Writes a gzip member header with the FEXTRA flag set, followed by XLEN and the extra field (RFC 1952 2.3.1.1). The
+ * extra field is a list of subfields (SI1, SI2, LEN, data), which decompressors not knowing them skip.
+ *
+ * @param bw The BIT_WRITER object.
+ * @param extra The extra field, made of whole subfields.
+ * @param extraLength The size of the extra field (XLEN).
+ */
+extern void writeGzipExtraHeader(BIT_WRITER* bw, const uint8_t* extra, const uint16_t extraLength) {
     addBytes(bw, MAGIC_NUMER, 2); //ID1 ID2
     addBytes(bw, COMPRESSION_METHOD, 1); //CM
-    addBytes(bw, FLAG,1); //FLG
+    addBytes(bw, FLAG_FEXTRA, 1); //FLG
     addBytes(bw, (uint32_t) time(NULL), 4); //MTIME
-    addBytes(bw, XFL,1); //XFL
+    addBytes(bw, XFL, 1); //XFL
     addBytes(bw, OS, 1);
+    addBytes(bw, extraLength, 2); //XLEN
+    for (uint16_t i = 0; i < extraLength; i++) {
+        addBytes(bw, extra[i], 1);
+    }
+}
 
-    printf("CurrentPosition: %d\n",bw->currentPosition);
+/**
+ * @brief Create File
+ *
+ * This function opens/creates a file named fileName plus the extension of the container, and then writes the header of
+ * the container (gzip or zlib, nothing for raw deflate) into the opened file.
+ *
+ * @param bw The BIT_WRITER object.
+ * @param fileName The file name to be created.
+ * @param format The container to write.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: 20 bytes
+ *  - 64bit systems: 40 bytes
+ */
+extern void createFile(BIT_WRITER* bw, const char* fileName, const CONTAINER_FORMAT format) {
+    openContainerFile(bw, fileName, format);
+    writeContainerHeader(bw, format);
+}
 
+/**
+ * @brief Get Container Extension
+ *
+ * @param format The container format.
+ *
+ * @returns const char* The file extension of the container, without the dot.
+ */
+extern const char* getContainerExtension(const CONTAINER_FORMAT format) {
+    switch (format) {
+        case CONTAINER_ZLIB: return "zz";
+        case CONTAINER_RAW: return "deflate";
+        case CONTAINER_GZIP:
+        default: return "gz";
+    }
 }
 
 
+/**
+ * @brief Close BIT_WRITER
+ *
+ * Flushes the final bytes, stops the output thread and closes the file. Every write error since the file was opened
+ * (a short fwrite, a failed flush or close, e.g. on a full disk) is reported here, so the caller can fail instead of
+ * claiming success for an incomplete file. Called by freeBIT_WRITER if the caller doesn't.
+ *
+ * @param bw The BIT_WRITER object. Without a file only the earlier errors are reported.
+ *
+ * @returns bool false if any write to the file failed.
+ */
+extern bool closeBIT_WRITER(BIT_WRITER* bw) {
+    if (bw->file != NULL) {
+        flushBitstreamWriter(bw);
+        flushBIT_WRITERBuffer(bw);
+        if (bw->outputThread != NULL) {
+            spscPush(bw->outputThread->filled, OUTPUT_THREAD_STOP);
+            pthread_join(bw->outputThread->thread, NULL);
+            freeOUTPUT_THREAD(bw->outputThread);
+            bw->outputThread = NULL;
+        }
+        if (bw->sparse) {
+            finishSparseFile(bw);
+        }
+        if (fclose(bw->file) != 0) {
+            bw->writeError = true;
+        }
+        bw->file = NULL;
+    }
+    return !bw->writeError;
+}
+
 /**
  * @brief Free BIT_WRITER
  *
  * This is a must called function at the end of the program, since this is accountable for flushing te final bytes and
- * closing the file. And of course frees the allocated memory.
+ * closing the file (see closeBIT_WRITER). And of course frees the allocated memory.
  *
  * @param bw The BIT_WRITER object.
  *
@@ -305,18 +978,8 @@ extern void createFile(BIT_WRITER* bw, const char* fileName, const char* extensi
  *  - 64bit systems: 8 bytes
  */
 extern void freeBIT_WRITER(BIT_WRITER* bw) {
-    printf("belepve\n");
-    flushBitstreamWriter(bw);
-    printf("belepve2\n");
-
-    const size_t flushedBytes = flushBIT_WRITERBuffer(bw);
-    printf("Last 8 byte: ");
-    for (int i = 8; i > 0;i--) {
-        printf("%d\t",bw->buffer[bw->index-i]);
-    }
-    printf("\nFlushed bytes %llu\n",flushedBytes);
+    closeBIT_WRITER(bw);
     free(bw->fileName);
-    fclose(bw->file);
     free(bw->buffer);
     free(bw);
 }
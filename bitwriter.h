@@ -5,9 +5,25 @@
 #ifndef DEFLATE_BIT_WRITER_H
 #define DEFLATE_BIT_WRITER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include "container.h"
+
+#define OUTPUT_THREAD_BUFFERS 4 // Output regions of a window BIT_WRITER with an output thread (one filled by the decoder)
+#define SPARSE_PAGE_SIZE 4096   // Granularity of the holes of a sparse output file, the block size of common file systems
+
+/**
+ * @brief Writes the output of a window BIT_WRITER on a thread of its own (see startOutputThread).
+ */
+typedef struct OUTPUT_THREAD OUTPUT_THREAD;
+
+/**
+ * @brief Receives every piece of flushed output of a BIT_WRITER in order, e.g. to search it (see searchOutput).
+ */
+typedef void (*OUTPUT_SINK)(void* sinkContext, const uint8_t* data, size_t length);
+
 typedef struct {
     FILE *file;
     uint8_t* buffer;
@@ -15,18 +31,61 @@ typedef struct {
     uint8_t currentPosition;
     size_t bufferSize;
     size_t index;
+    size_t historySize; // bytes at the front of the buffer kept as LZ77 history (already written out)
+    bool computeCRC;    // whether flushed data is added to crc32 (decompressor output of a gzip stream)
+    uint32_t crc32;     // running CRC32 of the flushed data (not yet inverted)
+    bool computeAdler32; // whether flushed data is added to adler32 (decompressor output of a zlib stream)
+    uint32_t adler32;   // running Adler-32 of the flushed data
+    uint64_t totalBytes; // number of bytes flushed so far
+    bool growable;      // memory sink: the buffer grows instead of being written to a file
     char* fileName;
+    OUTPUT_THREAD* outputThread; // NULL, or the thread checksumming and writing the flushed output
+    uint64_t skipBytes;  // flushed bytes left out of the file (the output before an extracted range)
+    uint64_t writeLimit; // at most this many flushed bytes go to the file after skipBytes (UINT64_MAX: all)
+    bool sparse;         // all-zero pages of the output are skipped with a seek instead of written (regular files only)
+    uint64_t fileOffset; // position of the next byte in the file, the pages of a sparse output are aligned to it
+    OUTPUT_SINK sink;    // NULL, or called with the flushed output while it is still in the cache
+    bool writeError;     // a write, flush or close of the file failed, the file is incomplete (sticky)
+    int64_t streamStart; // buffer index of the first byte of the current deflate stream (negative once slid out),
+                         // a back-reference can't reach before it (see startOutputStream)
+    bool overflow;       // a window without history got more output than its buffer holds, it never slides: the
+                         // output restarted at the front of the buffer and is invalid (see handleBufferSlide)
+    void* sinkContext;   // passed to sink
 } BIT_WRITER;
 
-extern void copyFromBufferHistory(BIT_WRITER* bw, uint16_t distance, uint16_t length);
+extern bool copyFromBufferHistory(BIT_WRITER* bw, uint16_t distance, uint16_t length);
+
+extern void startOutputStream(BIT_WRITER* bw);
 
 extern BIT_WRITER* initBIT_WRITER(size_t bufferSize);
 
+extern BIT_WRITER* initWindowBIT_WRITER(size_t historySize, size_t outputSize);
+
+extern BIT_WRITER* initMemoryBIT_WRITER(size_t initialSize);
+
+extern void resetMemoryBIT_WRITER(BIT_WRITER* bw);
+
+extern void writeRawBytes(BIT_WRITER* bw, const uint8_t* data, size_t length);
+
+extern void spliceBits(BIT_WRITER* bw, const uint8_t* data, size_t length, uint8_t trailingByte, uint8_t trailingBits);
+
 extern void addFastByte(BIT_WRITER* bw, uint8_t byte);
 
+extern uint8_t* getFreeWindowSpace(BIT_WRITER* bw, size_t* available);
+
+extern void commitWindowBytes(BIT_WRITER* bw, size_t count);
+
 extern void addBits(BIT_WRITER* bw, uint32_t value, uint8_t bitLength);
 
-extern void createFile(BIT_WRITER* bw, const char* fileName, const char* extension);
+extern void createFile(BIT_WRITER* bw, const char* fileName, CONTAINER_FORMAT format);
+
+extern void openContainerFile(BIT_WRITER* bw, const char* fileName, CONTAINER_FORMAT format);
+
+extern void writeContainerHeader(BIT_WRITER* bw, CONTAINER_FORMAT format);
+
+extern void writeGzipExtraHeader(BIT_WRITER* bw, const uint8_t* extra, uint16_t extraLength);
+
+extern bool closeBIT_WRITER(BIT_WRITER* bw);
 
 extern void freeBIT_WRITER(BIT_WRITER* bw);
 
@@ -34,6 +93,10 @@ extern void addBytes(BIT_WRITER* bw, uint32_t value, uint8_t bytes);
 
 extern void flushBitstreamWriter(BIT_WRITER* bw);
 
+extern size_t flushBIT_WRITERBuffer(BIT_WRITER* bw);
+
+extern bool startOutputThread(BIT_WRITER* bw, size_t buffers);
+
 extern void writeHuffmanCode(BIT_WRITER* bw, uint16_t code, uint8_t length);
 
 #endif //DEFLATE_BIT_WRITER_H
\ No newline at end of file
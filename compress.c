@@ -2,12 +2,26 @@
 // Created by Arnóczki Attila on 11/19/2025.
 //
 
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // SEEK_HOLE and SEEK_DATA of lseek
+#endif
+
 #include "compress.h"
+#ifdef DEFLATE_DEBUGMALLOC
 #include "debugmalloc.h"
+#endif
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
+#include "ADLER_CHECKSUM.h"
+#include "bgzf.h"
 #include "bitwriter.h"
 #include "CRC_CHECKSUM.h"
 #include "distance.h"
@@ -15,6 +29,8 @@
 #include "length.h"
 #include "LZ77.h"
 #include "node.h"
+#include "seekable.h"
+#include "spsc_queue.h"
 #include "STATUS.h"
 
 #define HASH_BITS 15
@@ -28,27 +44,35 @@
 #define END_OF_BLOCK 256
 #define DISTANCE_CODE_SIZE 30
 #define CODE_LENGTH_FREQUENCIES 19
+#define MAX_MATCH_LENGTH 258
+#define ZERO_RUN_MIN_LENGTH WINDOW_SIZE // Shorter holes of a sparse input are read like data
+#define ZERO_RUN_BLOCK_MATCHES 32768 // Matches in one block of a zero run, their frequency must fit into uint16_t
 
 #define BYTE uint8_t
 
 /**
- * @brief Subtract Window Size From Hash Table
+ * @brief Subtract Shift From Hash Table
  *
- * When a shift occurs in the buffer (when the buffer's second half gets copied to the first half)
- * we need to subtract the WINDOW_SIZE from all valid entries in the hashTable so that the newly
- * copied data can have a history from the previously processed data.
+ * When a shift occurs in the buffer (the last WINDOW_SIZE bytes get copied to the front of the buffer)
+ * we need to subtract the shift from all valid entries in the hashTable so that the newly
+ * copied data can have a history from the previously processed data. Entries pointing before the
+ * shifted region are dropped.
  *
  * @param uiarrHashTable The hashTable which stores the last occurrence of a 3 byte hash.
+ * @param shift The number of bytes the buffer was shifted by.
  *
  * @returns void
  * Maximum memory required:
- *  - 32bit systems: 8 bytes
- *  - 64bit systems: 16 bytes
+ *  - 32bit systems: 12 bytes
+ *  - 64bit systems: 24 bytes
  */
-static void vfSubtractWindowSizeFromHashTable(uint16_t *uiarrHashTable) {
+static void vfSubtractShiftFromHashTable(uint16_t *uiarrHashTable, const size_t shift) {
     for (int i = 0; i < HASH_SIZE; i++) {
-        if (uiarrHashTable[i] >= WINDOW_SIZE) {
-            uiarrHashTable[i] -= WINDOW_SIZE;
+        if (uiarrHashTable[i] == EMPTY_INDEX) continue;
+        if (uiarrHashTable[i] >= shift) {
+            uiarrHashTable[i] -= (uint16_t) shift;
+        } else {
+            uiarrHashTable[i] = EMPTY_INDEX;
         }
     }
 }
@@ -73,24 +97,6 @@ static uint16_t uifGenerateHashKey(const unsigned char *p) {
     return (uint16_t) ((p[0] << HASH_SHIFT) ^ p[1] ^ p[2]) & HASH_MASK;
 }
 
-/**
- * @brief Init Buffer only allocates BUFFER_SIZE byte unsigned char and returns with its pointer.
- * If the memory allocation fails then it returns with a NULL pointer.
- *
- * @returns unsigned char* The freshly allocated BUFFER_SIZE sized buffer.
- *
- *  Maximum memory required:
- *  - 32bit systems: BUFFER_SIZE+WINDOW_SIZE + 4 bytes
- *  - 64bit systems: BUFFER_SIZE+WINDOW_SIZE + 8 bytes
- */
-static unsigned char *cpInitBuffer(void) {
-    unsigned char *ucpBuffer = (unsigned char *) malloc(BUFFER_SIZE+WINDOW_SIZE);
-    if (ucpBuffer == NULL) {
-        return NULL;
-    };
-    return ucpBuffer;
-}
-
 /**
  * @brief Find Match Length
  *
@@ -194,11 +200,13 @@ extern FILE *ffOpenFile(const char *filename) {
 /**
  * @brief Compress Data
  *
- * This function takes in a BUFFER SIZED buffer containing BYTES from a file, and fills up an LZ77_buffer containing
- * match/literal distance/length codes which will be used later in the processBlock function.
+ * This function takes in a window of BYTES from a file, and fills up an LZ77_buffer containing match/literal
+ * distance/length codes for window[start, end), which will be used later in the processBlock function. The bytes
+ * before start are the history: matches may refer back into them, but no tokens are produced for them.
  *
- * @param ucpBuffer The start of the buffer (pointer).
- * @param bytesRead The bytes processed in this function.
+ * @param ucpWindow The start of the window (pointer). All positions, including the hash table entries, are relative to it.
+ * @param start The first position to compress.
+ * @param end The end of the data to compress (exclusive, at most BUFFER_SIZE).
  * @param hash_table The hash lookup table for matches.
  * @param output_ucpBuffer The LZ77_buffer containing the matches/literals.
  *
@@ -208,28 +216,28 @@ extern FILE *ffOpenFile(const char *filename) {
  *  - 32bit systems: 40 bytes
  *  - 64bit systems: 80 bytes
  */
-extern void compressData(const unsigned char *ucpBuffer, const size_t bytesRead, uint16_t *hash_table,
+extern void compressData(const unsigned char *ucpWindow, const size_t start, const size_t end, uint16_t *hash_table,
                          LZ77_buffer *output_ucpBuffer) {
     // --- Set the End Pointer ---
-    const unsigned char *ucpInputEndPointer = ucpBuffer + bytesRead;
+    const unsigned char *ucpInputEndPointer = ucpWindow + end;
 
     // --- Loop Control ---
-    // Loop only up to (bytesRead - 2) because we need at least 3 bytes to hash/match.
-    int i;
-    for (i = 0; i < (int) bytesRead - 2;) {
-        const uint16_t hashKey = uifGenerateHashKey(ucpBuffer + i);
+    // Loop only up to (end - 2) because we need at least 3 bytes to hash/match.
+    size_t i;
+    for (i = start; i + 2 < end;) {
+        const uint16_t hashKey = uifGenerateHashKey(ucpWindow + i);
         const uint16_t hashIndex = hash_table[hashKey];
 
         int bestLength = 0;
         int bestDistance = 0;
 
-        if (hashIndex != EMPTY_INDEX) {
-            int distance = i - hashIndex;
+        if (hashIndex != EMPTY_INDEX && hashIndex < i) {
+            const size_t distance = i - hashIndex;
 
             // Is distance within the 32KB LZ77 window?
-            if (distance > 0 && distance <= WINDOW_SIZE) {
-                bestLength = iFindMatchLength(ucpBuffer + i, ucpBuffer + hashIndex, ucpInputEndPointer);
-                bestDistance = distance;
+            if (distance <= WINDOW_SIZE) {
+                bestLength = iFindMatchLength(ucpWindow + i, ucpWindow + hashIndex, ucpInputEndPointer);
+                bestDistance = (int) distance;
 
                 if (bestLength < 3) {
                     bestLength = 0; // Discard match if too short
@@ -241,17 +249,13 @@ extern void compressData(const unsigned char *ucpBuffer, const size_t bytesRead,
 
         if (bestLength >= 3) {
             // Output the match token
-            if (bestDistance>40000) {
-                printf("Valamiért van egy 40k-nál nagyobb distance!\n");
-            }
             appendToken(output_ucpBuffer, createMatchLZ77(bestDistance, bestLength));
             i += bestLength;
         } else {
             // NO MATCH (Length < 3) or Invalid distance
 
             // Output the literal byte at the current position 'i'.
-            //printf("Literal: %c\n", ucpBuffer[i]);
-            appendToken(output_ucpBuffer, createLiteralLZ77(ucpBuffer[i]));
+            appendToken(output_ucpBuffer, createLiteralLZ77(ucpWindow[i]));
 
             // Advance the window by 1 byte (Literal case).
             i++;
@@ -259,10 +263,9 @@ extern void compressData(const unsigned char *ucpBuffer, const size_t bytesRead,
     }
 
     // --- 4. HANDLE REMAINING BYTES ---
-    // The loop ended at bytesRead - 2. Handle the last 1 or 2 bytes as literals.
-    for (; i < (int) bytesRead; i++) {
-        //printf("Literal: %c\n", ucpBuffer[i]);
-        appendToken(output_ucpBuffer, createLiteralLZ77(ucpBuffer[i]));
+    // The loop ended at end - 2. Handle the last 1 or 2 bytes as literals.
+    for (; i < end; i++) {
+        appendToken(output_ucpBuffer, createLiteralLZ77(ucpWindow[i]));
     }
 }
 
@@ -481,9 +484,23 @@ static MinHeap *createCodeLengthTree(const uint16_t *codeLengthFrequencies) {
     return codeLengthTree;
 }
 
-//Flag for debug pourposes only.
-static bool flag = true;
-
+/**
+ * @brief Fix Single Leaf Lengths
+ *
+ * A Huffman tree with a single leaf (e.g. a block whose matches all use the same distance code) is its own top, so the
+ * leaf gets a depth of 0. Deflate needs at least one bit per used symbol, so the symbol gets a 1 bit code.
+ *
+ * @param lengths The code lengths found in the tree.
+ * @param frequencies The frequencies the tree was built from.
+ * @param size The number of symbols.
+ */
+static void fixSingleLeafLengths(BYTE *lengths, const uint16_t *frequencies, const int size) {
+    for (int i = 0; i < size; i++) {
+        if (frequencies[i] > 0 && lengths[i] == 0) {
+            lengths[i] = 1;
+        }
+    }
+}
 
 static void generateCanonicalCodes(const uint8_t *lengths, int size, HUFFMAN_CODE *table) {
     uint16_t bl_count[16] = {0};
@@ -572,6 +589,8 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
 
     flattenTree(ll_lengths, LITERAL_LENGTH_SIZE, 15);
     flattenTree(distance_lengths, DISTANCE_CODE_SIZE, 15);
+    fixSingleLeafLengths(ll_lengths, LLFrequency, LITERAL_LENGTH_SIZE);
+    fixSingleLeafLengths(distance_lengths, distanceCodeFrequency, DISTANCE_CODE_SIZE);
 
 
     //combine the two results into one array
@@ -623,6 +642,7 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
     }*/
 
     flattenTree(cl_lengths, 19, 7);
+    fixSingleLeafLengths(cl_lengths, code_length_frequencies, CODE_LENGTH_FREQUENCIES);
 
     /*if (flag) {
         for (int i = 0; i < CODE_LENGTH_FREQUENCIES; i++) {
@@ -633,7 +653,6 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
     // 2. Write the Code Lengths of the Code Lengths (Meta-Tree Definition)
     const BYTE cl_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
     BYTE hclen_value = highestCodeLengthInUse + 4; // This is the total count of symbols (4-19)
-    if (flag) printf("HCLEN: %d\n", hclen_value);
     for (int i = 0; i < hclen_value; ++i) {
         // Each length is 3 bits
         BYTE symbol = cl_order[i];
@@ -641,12 +660,10 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
             printf("Byte before: %d, with a start index of: %d, and a current position of: %d\n", bw->byte, bw->index,bw->currentPosition);
         }*/
         addBits(bw, cl_lengths[symbol], 3);
-        if (flag) { printf("%d %d\n", symbol, cl_lengths[symbol]); }
         /*if (flag) {
             printf(" Byte after: %d, with a start index of: %d, and a current position of: %d\n\n",bw->byte, bw->index, bw->currentPosition);
         }*/
     }
-    if (flag) printf("\n\n");
     HUFFMAN_CODE ll_table[LITERAL_LENGTH_SIZE] = {0};
     HUFFMAN_CODE distance_table[DISTANCE_CODE_SIZE] = {0};
     HUFFMAN_CODE cl_table[CODE_LENGTH_FREQUENCIES] = {0};
@@ -660,8 +677,6 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
             printf("length: %d code:%x \n",distance_table[i].length,distance_table[i].code);
         }
     }*/
-    flag = true;
-
     generateCanonicalCodes(cl_lengths, CODE_LENGTH_FREQUENCIES, cl_table);
 
     //printf("compressed_symbol_count: %llu, - - %llu\n",compressed_symbol_count, total_lengths);
@@ -723,9 +738,8 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
 
     // CHANGE: EOB is a Huffman Code
     writeHuffmanCode(bw, EOB.code, EOB.length);
-    if (lastBlock) {
-        flushBitstreamWriter(bw);
-    }
+    // The last block isn't padded here: a block entropy coded on its own may still be spliced at any bit offset. The
+    // trailer (addBytes) or freeBIT_WRITER pads the stream.
     //printf("End of block. EOB code: %d, EOB length: %d, bw possition: %d\n",EOB.code, EOB.length, bw->currentPosition);
     //Free up memory pointers
     freeTree(clTop);
@@ -739,19 +753,337 @@ extern void processBlock(BIT_WRITER *bw, uint16_t *LLFrequency, uint16_t *distan
 
 
 /**
- * @brief Compress
+ * @brief The state of one deflate stream (or one piece of it), reused from block to block.
+ *
+ * The window is laid out as [WINDOW_SIZE bytes of history][up to WINDOW_SIZE bytes of new input], the positions in the
+ * hash table are relative to its start. Every worker thread of compressParallel owns one.
+ */
+struct COMPRESS_CONTEXT {
+    unsigned char* window;                          ///< BUFFER_SIZE bytes: history, then the input of the next block.
+    uint16_t* hashTable;                            ///< Last position of every 3 byte hash in the window.
+    LZ77_buffer* tokens;                            ///< The tokens of the current block.
+    uint16_t LLFrequency[LITERAL_LENGTH_SIZE];      ///< Literal/length frequencies of the current block.
+    uint16_t distanceCodeFrequency[DISTANCE_CODE_SIZE]; ///< Distance code frequencies of the current block.
+};
+
+/**
+ * @brief Free COMPRESS_CONTEXT
+ *
+ * @param context The context to free. NULL is allowed.
+ */
+extern void freeCOMPRESS_CONTEXT(COMPRESS_CONTEXT* context) {
+    if (context == NULL) {
+        return;
+    }
+    free(context->window);
+    free(context->hashTable);
+    if (context->tokens != NULL) freeLZ77Buffer(context->tokens);
+    free(context);
+}
+
+/**
+ * @brief Prime History
+ *
+ * Starts a new stream (or a new piece of a stream) in the context. The last WINDOW_SIZE bytes of the history become the
+ * dictionary the next blocks may refer back to, like deflateSetDictionary in zlib.
+ *
+ * @param context The context.
+ * @param history The data preceding the next input, NULL if there is none.
+ * @param historyLength The length of the history in bytes.
+ */
+static void primeHistory(COMPRESS_CONTEXT* context, const unsigned char* history, size_t historyLength) {
+    fvpResetHashTable(context->hashTable);
+    memset(context->window, 0, WINDOW_SIZE);
+    if (historyLength > WINDOW_SIZE) {
+        history += historyLength - WINDOW_SIZE;
+        historyLength = WINDOW_SIZE;
+    }
+    if (historyLength == 0) {
+        return;
+    }
+
+    const size_t start = WINDOW_SIZE - historyLength;
+    memcpy(context->window + start, history, historyLength);
+    for (size_t i = start; i + 2 < WINDOW_SIZE; i++) {
+        context->hashTable[uifGenerateHashKey(context->window + i)] = (uint16_t) i;
+    }
+}
+
+/**
+ * @brief Initialize COMPRESS_CONTEXT
+ *
+ * Allocates the window, the hash table and the token buffer used by the compression, and starts an empty stream.
+ *
+ * @returns COMPRESS_CONTEXT* The context OR NULL. Must be freed with freeCOMPRESS_CONTEXT.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: sizeof(COMPRESS_CONTEXT) + BUFFER_SIZE + 2 * HASH_SIZE + the tokens of one block
+ *  - 64bit systems: sizeof(COMPRESS_CONTEXT) + BUFFER_SIZE + 2 * HASH_SIZE + the tokens of one block
+ */
+extern COMPRESS_CONTEXT* initCOMPRESS_CONTEXT(void) {
+    COMPRESS_CONTEXT* context = (COMPRESS_CONTEXT*) malloc(sizeof(COMPRESS_CONTEXT));
+    if (context == NULL) {
+        return NULL;
+    }
+    context->window = (unsigned char*) malloc(BUFFER_SIZE);
+    context->hashTable = initHashTable();
+    context->tokens = initLZ77Buffer();
+    if (context->window == NULL || context->hashTable == NULL || context->tokens == NULL) {
+        freeCOMPRESS_CONTEXT(context);
+        return NULL;
+    }
+    primeHistory(context, NULL, 0);
+    return context;
+}
+
+/**
+ * @brief Match Window
+ *
+ * Finds the LZ77 tokens of the 'length' bytes placed at window + WINDOW_SIZE, then shifts the window so that the last
+ * WINDOW_SIZE bytes become the history of the next block.
+ *
+ * @param context The context, the new input already copied after the history.
+ * @param tokens The buffer receiving the tokens.
+ * @param length The number of new bytes (1 - WINDOW_SIZE).
+ */
+static void matchWindow(COMPRESS_CONTEXT* context, LZ77_buffer* tokens, const size_t length) {
+    compressData(context->window, WINDOW_SIZE, WINDOW_SIZE + length, context->hashTable, tokens);
+
+    memmove(context->window, context->window + length, WINDOW_SIZE);
+    vfSubtractShiftFromHashTable(context->hashTable, length);
+}
+
+/**
+ * @brief Deflate Window
+ *
+ * Compresses the 'length' bytes placed at window + WINDOW_SIZE into one dynamic Huffman block (see matchWindow).
+ *
+ * @param context The context, the new input already copied after the history.
+ * @param bw The BIT_WRITER receiving the block.
+ * @param length The number of new bytes (1 - WINDOW_SIZE).
+ * @param lastBlock Whether the block gets the BFINAL bit.
+ */
+static void deflateWindow(COMPRESS_CONTEXT* context, BIT_WRITER* bw, const size_t length, const bool lastBlock) {
+    matchWindow(context, context->tokens, length);
+    processBlock(bw, context->LLFrequency, context->distanceCodeFrequency, context->tokens, lastBlock);
+    context->tokens->size = 0;
+}
+
+/**
+ * @brief Write Sync Flush
+ *
+ * Ends a piece of the stream on a byte boundary with an empty stored block (BFINAL=0, BTYPE=00, LEN=0, NLEN=0xFFFF),
+ * like Z_SYNC_FLUSH in zlib. Pieces ending this way can simply be concatenated.
+ *
+ * @param bw The BIT_WRITER.
+ */
+static void writeSyncFlush(BIT_WRITER* bw) {
+    addBits(bw, 0b000, 3);
+    addBytes(bw, 0x0000, 2); // addBytes pads the header to a byte boundary first
+    addBytes(bw, 0xFFFF, 2);
+}
+
+/**
+ * @brief Write Empty Final Block
+ *
+ * Writes a final fixed Huffman block holding only the end of block code, the deflate stream of an empty input.
+ *
+ * @param bw The BIT_WRITER.
+ */
+static void writeEmptyFinalBlock(BIT_WRITER* bw) {
+    addBits(bw, (0b01 << 1) | 0b1, 3);
+    addBits(bw, 0, 7); // END_OF_BLOCK is 0000000 in the fixed literal/length code
+    flushBitstreamWriter(bw);
+}
+
+/**
+ * @brief Compress Buffer
  *
- * This is the entry for the whole compression. In this function we initialize the core utilities and start reading the file
- * buffer to buffer.
+ * Compresses a buffer held in memory into a complete raw deflate stream (no container), e.g. a window stored in an
+ * index.
  *
+ * @param context The context, reset for the new stream.
+ * @param input The data.
+ * @param length The length of the data.
+ * @param output A memory sink BIT_WRITER (see initMemoryBIT_WRITER), the stream is appended as whole bytes.
+ */
+extern void compressBuffer(COMPRESS_CONTEXT* context, const unsigned char* input, const size_t length, BIT_WRITER* output) {
+    primeHistory(context, NULL, 0);
+    if (length == 0) {
+        writeEmptyFinalBlock(output);
+        return;
+    }
+    for (size_t offset = 0; offset < length;) {
+        const size_t blockLength = length - offset < WINDOW_SIZE ? length - offset : WINDOW_SIZE;
+        memcpy(context->window + WINDOW_SIZE, input + offset, blockLength);
+        offset += blockLength;
+        deflateWindow(context, output, blockLength, offset == length);
+    }
+    flushBitstreamWriter(output);
+}
+
+/**
+ * @brief Write Trailer
+ *
+ * Writes the trailer of the container: CRC32 and ISIZE (little endian) for gzip, the Adler-32 (big endian) for zlib,
+ * nothing for a raw deflate stream.
+ *
+ * @param bw The BIT_WRITER.
+ * @param format The container.
+ * @param crc32Checksum The finished CRC32 of the input.
+ * @param adler32Checksum The Adler-32 of the input.
+ * @param totalUncompressedSize The size of the input (stored modulo 2^32).
+ */
+static void writeTrailer(BIT_WRITER* bw, const CONTAINER_FORMAT format, const uint32_t crc32Checksum,
+                         const uint32_t adler32Checksum, const uint64_t totalUncompressedSize) {
+    if (format == CONTAINER_GZIP) {
+        addBytes(bw, crc32Checksum, 4);
+        addBytes(bw, (uint32_t) totalUncompressedSize, 4);
+    } else if (format == CONTAINER_ZLIB) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            addBytes(bw, (adler32Checksum >> shift) & 0xFF, 1);
+        }
+    } // A raw deflate stream has no trailer
+}
+
+/**
+ * @brief Returns true if there is nothing left to read, without consuming anything.
+ */
+static bool isAtEndOfFile(FILE* file) {
+    const int c = fgetc(file);
+    if (c == EOF) {
+        return true;
+    }
+    ungetc(c, file);
+    return false;
+}
+
+/**
+ * @brief Find Hole
+ *
+ * Looks for the next hole of a sparse input at or after 'offset' with lseek(SEEK_HOLE / SEEK_DATA), skipping holes
+ * shorter than ZERO_RUN_MIN_LENGTH. A hole is a range of the file the file system holds no data for, it reads as zeros.
+ * The stream is positioned at 'offset' again in every case.
+ *
+ * @param file The input, opened by ffOpenFile.
+ * @param offset The position of the reading.
+ * @param holeStart Receives the start of the hole, UINT64_MAX if there is none.
+ * @param holeEnd Receives the end of the hole (the next data or the end of the file).
+ * @returns bool False if the stream could not be positioned back to 'offset'.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: sizeof(struct stat) + 32 bytes
+ *  - 64bit systems: sizeof(struct stat) + 64 bytes
+ */
+static bool findHole(FILE* file, uint64_t offset, uint64_t* holeStart, uint64_t* holeEnd) {
+    *holeStart = UINT64_MAX;
+    *holeEnd = UINT64_MAX;
+#if defined(SEEK_HOLE) && defined(SEEK_DATA)
+    const int descriptor = fileno(file);
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return true; // Pipes and devices are read as they are, they have no holes to ask for
+    }
+    const uint64_t fileSize = (uint64_t) info.st_size;
+    while (offset < fileSize) {
+        const off_t start = lseek(descriptor, (off_t) offset, SEEK_HOLE);
+        if (start < 0 || (uint64_t) start >= fileSize) {
+            break; // No hole support, or only the implicit hole at the end of the file is left
+        }
+        off_t end = lseek(descriptor, start, SEEK_DATA);
+        if (end < 0) {
+            if (errno != ENXIO) break;
+            end = (off_t) fileSize; // The hole reaches the end of the file
+        }
+        if ((uint64_t) (end - start) >= ZERO_RUN_MIN_LENGTH) {
+            *holeStart = (uint64_t) start;
+            *holeEnd = (uint64_t) end;
+            break;
+        }
+        offset = (uint64_t) end;
+    }
+#endif
+#if defined(_WIN32)
+    return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * @brief Deflate Zero Run
+ *
+ * Compresses 'length' zero bytes (a hole of a sparse input) without hashing or matching them: one literal zero (unless
+ * the history already ends with one), then distance 1 matches of MAX_MATCH_LENGTH. The tokens are known in advance,
+ * so they go out in blocks of ZERO_RUN_BLOCK_MATCHES matches. Afterward the history is all zeros.
+ *
+ * @param context The context.
+ * @param bw The BIT_WRITER receiving the blocks.
+ * @param length The number of zero bytes, at least ZERO_RUN_MIN_LENGTH.
+ * @param streamStarted Whether the stream already holds data the first match may refer back to.
+ * @param lastBlock Whether the last block of the run gets the BFINAL bit.
+ */
+static void deflateZeroRun(COMPRESS_CONTEXT* context, BIT_WRITER* bw, uint64_t length, const bool streamStarted,
+                           const bool lastBlock) {
+    LZ77_buffer* tokens = context->tokens;
+    if (!streamStarted || context->window[WINDOW_SIZE - 1] != 0) {
+        appendToken(tokens, createLiteralLZ77(0));
+        length--;
+    }
+    while (length > 0) {
+        size_t matches = 0;
+        while (length >= 3 && matches < ZERO_RUN_BLOCK_MATCHES) {
+            const uint16_t matchLength = length < MAX_MATCH_LENGTH ? (uint16_t) length : MAX_MATCH_LENGTH;
+            appendToken(tokens, createMatchLZ77(1, matchLength));
+            length -= matchLength;
+            matches++;
+        }
+        if (length < 3) {
+            for (; length > 0; length--) {
+                appendToken(tokens, createLiteralLZ77(0));
+            }
+        }
+        processBlock(bw, context->LLFrequency, context->distanceCodeFrequency, tokens, lastBlock && length == 0);
+        tokens->size = 0;
+    }
+
+    memset(context->window, 0, WINDOW_SIZE);
+    fvpResetHashTable(context->hashTable);
+}
+
+/**
+ * @brief Close Compressed File
+ *
+ * Closes and frees the BIT_WRITER of a compressed file. A failed write (see closeBIT_WRITER) turns a successful
+ * compression into a failure, the compressed file is incomplete.
+ *
+ * @param bw The BIT_WRITER of the output.
+ * @param status The result of the compression, updated on a write error.
+ */
+static void closeCompressedFile(BIT_WRITER* bw, STATUS* status) {
+    if (!closeBIT_WRITER(bw) && status->code == COMPRESSION_SUCCESS) {
+        status->code = COMPRESSION_FAILED;
+        createSTATUSMessage(status, "Can\'t write the output file!");
+    }
+    freeBIT_WRITER(bw);
+}
+
+/**
+ * @brief Compress With Context
+ *
+ * This is the entry for the whole compression. In this function we start reading the file buffer to buffer. Every
+ * WINDOW_SIZE piece of the input becomes one dynamic Huffman block, with the previous WINDOW_SIZE bytes as its history.
+ *
+ * @param context A COMPRESS_CONTEXT from initCOMPRESS_CONTEXT, may be reused for several files.
  * @param filename The file which we want to compress.
+ * @param format The container to wrap the deflate stream in (gzip, zlib or raw).
  * @returns STATUS object
  *
  * Maximum memory required:
- *  - 32bit systems: 24 bytes
- *  - 64bit systems: 44 bytes
+ *  - 32bit systems: 4096 bytes
+ *  - 64bit systems: 4096 bytes
  */
-extern STATUS *compress(char *filename) {
+extern STATUS *compressWithContext(COMPRESS_CONTEXT *context, char *filename, const CONTAINER_FORMAT format) {
     STATUS *status = initSTATUS();
     status->code = COMPRESSION_SUCCESS;
     createSTATUSMessage(status, "File compression succeeded!");
@@ -763,113 +1095,1029 @@ extern STATUS *compress(char *filename) {
         return status;
     }
 
-    uint16_t *hashTable = initHashTable();
+    BIT_WRITER *bw = initBIT_WRITER(4096);
+    createFile(bw, filename, format);
+    if (bw->file == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open output file!");
+        freeBIT_WRITER(bw);
+        fclose(file);
+        return status;
+    }
+    primeHistory(context, NULL, 0);
+
+    uint32_t crc32Checksum = CRC32_INITIAL_VALUE;
+    uint32_t adler32Checksum = ADLER32_INITIAL_VALUE;
+    uint64_t totalUncompressedSize = 0;
+
+    // Holes of a sparse input are never read, they are compressed as zero runs
+    uint64_t holeStart;
+    uint64_t holeEnd;
+    findHole(file, 0, &holeStart, &holeEnd);
+
+    // The input is read right after the history, so no copy is needed
+    unsigned char *input = context->window + WINDOW_SIZE;
+    bool isFinalBlock = false;
+    do {
+        if (totalUncompressedSize == holeStart) {
+            const uint64_t holeLength = holeEnd - holeStart;
+            if (!findHole(file, holeEnd, &holeStart, &holeEnd)) {
+                status->code = COMPRESSION_FAILED;
+                createSTATUSMessage(status, "Can\'t seek past a hole of the input file!");
+                break;
+            }
+            isFinalBlock = isAtEndOfFile(file);
+            if (format == CONTAINER_GZIP) {
+                crc32Checksum = calculate_crc32_zeros(crc32Checksum, holeLength);
+            } else if (format == CONTAINER_ZLIB) {
+                adler32Checksum = calculate_adler32_zeros(adler32Checksum, holeLength);
+            }
+            deflateZeroRun(context, bw, holeLength, totalUncompressedSize > 0, isFinalBlock);
+            totalUncompressedSize += holeLength;
+            continue;
+        }
+
+        const size_t wanted = holeStart - totalUncompressedSize < WINDOW_SIZE
+                                  ? (size_t) (holeStart - totalUncompressedSize)
+                                  : WINDOW_SIZE;
+        const size_t bytesRead = fread(input, 1, wanted, file);
+        isFinalBlock = bytesRead < wanted || isAtEndOfFile(file);
+
+        if (bytesRead == 0) {
+            // Only an empty input gets here, every other input ends with a final block of data
+            writeEmptyFinalBlock(bw);
+            break;
+        }
+
+        // Only the checksum of the chosen container is computed
+        if (format == CONTAINER_GZIP) {
+            crc32Checksum = calculate_crc32(crc32Checksum, input, bytesRead);
+        } else if (format == CONTAINER_ZLIB) {
+            adler32Checksum = calculate_adler32(adler32Checksum, input, bytesRead);
+        }
+        totalUncompressedSize += bytesRead;
+
+        deflateWindow(context, bw, bytesRead, isFinalBlock);
+    } while (!isFinalBlock);
+
+    writeTrailer(bw, format, crc32Checksum ^ CRC32_INITIAL_VALUE, adler32Checksum, totalUncompressedSize);
+
+    fclose(file);
+    closeCompressedFile(bw, status);
+    return status;
+}
 
-    if (hashTable == NULL) {
+/**
+ * @brief Compress
+ *
+ * Compresses a file with a freshly allocated COMPRESS_CONTEXT (see compressWithContext).
+ *
+ * @param filename The file which we want to compress.
+ * @param format The container to wrap the deflate stream in (gzip, zlib or raw).
+ * @returns STATUS object
+ *
+ * Maximum memory required:
+ *  - 32bit systems: sizeof(COMPRESS_CONTEXT) + BUFFER_SIZE + 2 * HASH_SIZE + 4096 + the tokens of one block
+ *  - 64bit systems: sizeof(COMPRESS_CONTEXT) + BUFFER_SIZE + 2 * HASH_SIZE + 4096 + the tokens of one block
+ */
+extern STATUS *compress(char *filename, const CONTAINER_FORMAT format) {
+    COMPRESS_CONTEXT *context = initCOMPRESS_CONTEXT();
+    if (context == NULL) {
+        STATUS *status = initSTATUS();
         status->code = CANT_ALLOCATE_MEMORY;
-        createSTATUSMessage(status, "Can\'t allocate memory for a hash table!");
+        createSTATUSMessage(status, "Can\'t allocate memory for the compress context!");
         return status;
     }
+    STATUS *status = compressWithContext(context, filename, format);
+    freeCOMPRESS_CONTEXT(context);
+    return status;
+}
+
+/**
+ * @brief One chunk of the input of compressParallel, and the compressed piece made from it.
+ */
+typedef struct {
+    unsigned char* data;    ///< [WINDOW_SIZE bytes of history][chunkSize bytes of input]
+    size_t historyLength;   ///< Valid history bytes, right before data + WINDOW_SIZE.
+    size_t length;          ///< Input bytes at data + WINDOW_SIZE.
+    bool last;              ///< The last chunk of the input ends the stream with a final block.
+    bool independent;       ///< The chunk becomes a complete gzip member of its own, without history.
+    bool bgzf;              ///< The member is a BGZF block, whose header holds its size.
+    BIT_WRITER* output;     ///< Memory sink receiving the compressed piece.
+    uint32_t crc32;         ///< Finished CRC32 of the input of the chunk (gzip only).
+} COMPRESS_JOB;
+
+typedef struct COMPRESS_WORKER COMPRESS_WORKER;
+
+/**
+ * @brief The shared state of a worker pool: a ring of jobCount jobs of jobSize bytes, filled by the calling thread and
+ * drained by the workers with runJob.
+ *
+ * Jobs are queued and taken in order, the calling thread waits for them in the same order. A job is identified by its
+ * sequence number, its slot in the ring is the number modulo jobCount.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t jobQueued;   ///< Signalled when a job is queued or the pool shuts down.
+    pthread_cond_t jobDone;     ///< Signalled when a worker finishes a job.
+    unsigned char* jobs;
+    size_t jobSize;
+    size_t jobCount;
+    bool* finished;             ///< Per slot: the worker is done with the job in it.
+    uint64_t queued;            ///< Number of jobs queued so far.
+    uint64_t taken;             ///< Number of jobs taken by the workers so far.
+    bool shutdown;
+    void (*runJob)(COMPRESS_WORKER* worker, void* job);
+    CONTAINER_FORMAT format;
+} COMPRESS_POOL;
+
+struct COMPRESS_WORKER {
+    COMPRESS_POOL* pool;
+    COMPRESS_CONTEXT* context;  ///< Reused by every job the worker runs.
+    pthread_t thread;
+};
+
+/**
+ * @brief Write Stored Block
+ *
+ * Writes the data as a single final stored block (BTYPE=00), at most 65535 bytes.
+ *
+ * @param bw The BIT_WRITER.
+ * @param data The data.
+ * @param length The length of the data.
+ */
+static void writeStoredBlock(BIT_WRITER* bw, const unsigned char* data, const size_t length) {
+    addBits(bw, 0b001, 3);
+    addBytes(bw, (uint32_t) length, 2); // addBytes pads the header to a byte boundary first
+    addBytes(bw, (uint32_t) ~length & 0xFFFF, 2);
+    for (size_t i = 0; i < length; i++) {
+        addBytes(bw, data[i], 1);
+    }
+}
 
-    unsigned char *ucpBuffer = cpInitBuffer();
+/**
+ * @brief Finish BGZF Block
+ *
+ * Stores the input of a BGZF block instead if compressing made it larger, so the block never exceeds
+ * BGZF_MAX_BLOCK_SIZE, then sets BSIZE in its header.
+ */
+static void finishBgzfBlock(COMPRESS_JOB* job) {
+    const unsigned char* input = job->data + WINDOW_SIZE;
+    if (job->output->index > BGZF_HEADER_SIZE + 5 + job->length + 8) {
+        resetMemoryBIT_WRITER(job->output);
+        writeBgzfHeader(job->output);
+        writeStoredBlock(job->output, input, job->length);
+        writeTrailer(job->output, CONTAINER_GZIP, job->crc32, ADLER32_INITIAL_VALUE, job->length);
+    }
+    setBgzfBlockSize(job->output->buffer, job->output->index);
+}
 
-    if (ucpBuffer == NULL) {
+/**
+ * @brief Compresses one chunk primed with the history before it. Every chunk but the last one ends on a sync flush.
+ *
+ * An independent chunk gets no history, ends with a final block and is wrapped in its own gzip header and trailer.
+ */
+static void compressJob(COMPRESS_CONTEXT* context, COMPRESS_JOB* job, const CONTAINER_FORMAT format) {
+    const unsigned char* input = job->data + WINDOW_SIZE;
+    const bool finalPiece = job->last || job->independent;
+    resetMemoryBIT_WRITER(job->output);
+    primeHistory(context, input - job->historyLength, job->historyLength);
+    if (job->bgzf) {
+        writeBgzfHeader(job->output);
+    } else if (job->independent) {
+        writeContainerHeader(job->output, CONTAINER_GZIP);
+    }
+
+    for (size_t offset = 0; offset < job->length;) {
+        const size_t length = job->length - offset < WINDOW_SIZE ? job->length - offset : WINDOW_SIZE;
+        memcpy(context->window + WINDOW_SIZE, input + offset, length);
+        offset += length;
+        deflateWindow(context, job->output, length, finalPiece && offset == job->length);
+    }
+    if (!finalPiece) {
+        writeSyncFlush(job->output);
+    } else {
+        flushBitstreamWriter(job->output); // The pieces are written as whole bytes
+    }
+
+    if (format == CONTAINER_GZIP) {
+        job->crc32 = calculate_crc32(CRC32_INITIAL_VALUE, input, job->length) ^ CRC32_INITIAL_VALUE;
+    }
+    if (job->independent) {
+        writeTrailer(job->output, CONTAINER_GZIP, job->crc32, ADLER32_INITIAL_VALUE, job->length);
+    }
+    if (job->bgzf) {
+        finishBgzfBlock(job);
+    }
+}
+
+static void runCompressJob(COMPRESS_WORKER* worker, void* job) {
+    compressJob(worker->context, (COMPRESS_JOB*) job, worker->pool->format);
+}
+
+static void* compressWorker(void* arg) {
+    COMPRESS_WORKER* worker = arg;
+    COMPRESS_POOL* pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->taken == pool->queued) {
+            pthread_cond_wait(&pool->jobQueued, &pool->lock);
+        }
+        if (pool->taken == pool->queued) {
+            break; // Shut down and nothing left to do
+        }
+        const size_t slot = pool->taken % pool->jobCount;
+        pool->taken++;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->runJob(worker, pool->jobs + slot * pool->jobSize);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finished[slot] = true;
+        pthread_cond_broadcast(&pool->jobDone);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * @brief Start Compress Pool
+ *
+ * Initializes the pool over the given job ring and starts a thread for every worker. The workers must already have
+ * their contexts.
+ *
+ * @returns unsigned The number of threads started, 0 if none could be started (the pool needs no stopping then).
+ */
+static unsigned startCompressPool(COMPRESS_POOL* pool, COMPRESS_WORKER* workers, const unsigned threads, void* jobs,
+                                  const size_t jobSize, const size_t jobCount,
+                                  void (*runJob)(COMPRESS_WORKER* worker, void* job), const CONTAINER_FORMAT format) {
+    pool->finished = (bool*) calloc(jobCount, sizeof(bool));
+    if (pool->finished == NULL) {
+        return 0;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->jobQueued, NULL);
+    pthread_cond_init(&pool->jobDone, NULL);
+    pool->jobs = (unsigned char*) jobs;
+    pool->jobSize = jobSize;
+    pool->jobCount = jobCount;
+    pool->queued = 0;
+    pool->taken = 0;
+    pool->shutdown = false;
+    pool->runJob = runJob;
+    pool->format = format;
+
+    // Build the CRC32 tables before the workers use them concurrently
+    calculate_crc32(CRC32_INITIAL_VALUE, NULL, 0);
+
+    unsigned started = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t].pool = pool;
+        if (pthread_create(&workers[t].thread, NULL, compressWorker, &workers[t]) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        pthread_cond_destroy(&pool->jobDone);
+        pthread_cond_destroy(&pool->jobQueued);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->finished);
+    }
+    return started;
+}
+
+/**
+ * @brief Hands the job in the next slot of the ring (pool->queued % jobCount) to the workers.
+ */
+static void queueCompressJob(COMPRESS_POOL* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->finished[pool->queued % pool->jobCount] = false;
+    pool->queued++;
+    pthread_cond_signal(&pool->jobQueued);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Returns whether the queued job with the given sequence number is finished, waiting for it if wait is set.
+ */
+static bool isCompressJobFinished(COMPRESS_POOL* pool, const uint64_t number, const bool wait) {
+    const size_t slot = number % pool->jobCount;
+    pthread_mutex_lock(&pool->lock);
+    while (wait && !pool->finished[slot]) {
+        pthread_cond_wait(&pool->jobDone, &pool->lock);
+    }
+    const bool finished = pool->finished[slot];
+    pthread_mutex_unlock(&pool->lock);
+    return finished;
+}
+
+/**
+ * @brief Lets the workers finish the queued jobs, then joins them and releases the pool.
+ */
+static void stopCompressPool(COMPRESS_POOL* pool, COMPRESS_WORKER* workers, const unsigned started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->jobQueued);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->jobDone);
+    pthread_cond_destroy(&pool->jobQueued);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->finished);
+}
+
+/**
+ * @brief Frees the jobs and worker contexts of compressParallel. Allocations which failed are skipped.
+ */
+static void freeCompressPool(COMPRESS_JOB* jobs, const size_t jobCount, COMPRESS_WORKER* workers, const unsigned threads) {
+    if (jobs != NULL) {
+        for (size_t i = 0; i < jobCount; i++) {
+            free(jobs[i].data);
+            if (jobs[i].output != NULL) freeBIT_WRITER(jobs[i].output);
+        }
+        free(jobs);
+    }
+    if (workers != NULL) {
+        for (unsigned t = 0; t < threads; t++) {
+            freeCOMPRESS_CONTEXT(workers[t].context);
+        }
+        free(workers);
+    }
+}
+
+/**
+ * @brief How compressWithPool wraps the compressed chunks.
+ */
+typedef enum {
+    LAYOUT_STREAM,  ///< The chunks are pieces of one deflate stream.
+    LAYOUT_MEMBERS, ///< Every chunk is a gzip member of its own.
+    LAYOUT_BGZF     ///< Every chunk is a BGZF block, the blocks are followed by the BGZF end of file marker.
+} CHUNK_LAYOUT;
+
+/**
+ * @brief Compress With Pool
+ *
+ * The body of compressParallel and compressMembers. The calling thread reads the input in chunks of chunkSize bytes and
+ * writes the compressed pieces in order, the worker threads compress the chunks. At most 2 * threads chunks are in
+ * flight, so the memory use is bounded by about 2 * threads * (chunkSize + WINDOW_SIZE) plus the compressed pieces.
+ *
+ * @param filename The file which we want to compress.
+ * @param format The container to wrap the deflate stream in. Must be gzip unless the layout is LAYOUT_STREAM.
+ * @param threads The number of worker threads (1 - COMPRESS_MAX_THREADS).
+ * @param chunkSize The size of the input chunks (COMPRESS_MIN_CHUNK_SIZE - COMPRESS_MAX_CHUNK_SIZE, or
+ * BGZF_BLOCK_INPUT_SIZE for BGZF).
+ * @param layout Whether the chunks are pieces of one stream, gzip members or BGZF blocks.
+ * @param seekIndex NULL, or the flush points of a seekable file: every chunk starts without history, its start is
+ * recorded, and the index is appended after the trailer (see writeSeekIndex). Must be gzip.
+ *
+ * @returns STATUS object
+ */
+static STATUS *compressWithPool(char *filename, const CONTAINER_FORMAT format, const unsigned threads,
+                                const size_t chunkSize, const CHUNK_LAYOUT layout, SEEK_INDEX *seekIndex) {
+    const bool independentMembers = layout != LAYOUT_STREAM;
+    STATUS *status = initSTATUS();
+    status->code = COMPRESSION_SUCCESS;
+    createSTATUSMessage(status, "File compression succeeded!");
+
+    FILE *file = ffOpenFile(filename);
+    if (file == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open input file!");
+        return status;
+    }
+
+    const size_t jobCount = 2 * (size_t) threads;
+    COMPRESS_JOB *jobs = (COMPRESS_JOB *) calloc(jobCount, sizeof(COMPRESS_JOB));
+    COMPRESS_WORKER *workers = (COMPRESS_WORKER *) calloc(threads, sizeof(COMPRESS_WORKER));
+    unsigned char *carry = (unsigned char *) malloc(WINDOW_SIZE);
+    bool allocated = jobs != NULL && workers != NULL && carry != NULL;
+    for (size_t i = 0; allocated && i < jobCount; i++) {
+        jobs[i].data = (unsigned char *) malloc(WINDOW_SIZE + chunkSize);
+        jobs[i].output = initMemoryBIT_WRITER(chunkSize / 2);
+        allocated = jobs[i].data != NULL && jobs[i].output != NULL;
+    }
+    for (unsigned t = 0; allocated && t < threads; t++) {
+        workers[t].context = initCOMPRESS_CONTEXT();
+        allocated = workers[t].context != NULL;
+    }
+    if (!allocated) {
         status->code = CANT_ALLOCATE_MEMORY;
-        createSTATUSMessage(status, "Can\'t allocate memory for a ucpBuffer!");
-        free(hashTable);
+        createSTATUSMessage(status, "Can\'t allocate memory for the compression threads!");
+        freeCompressPool(jobs, jobCount, workers, threads);
+        free(carry);
+        fclose(file);
         return status;
     }
 
+    // The output is opened before the threads start, so a failure has nothing to stop
+    BIT_WRITER *bw = initBIT_WRITER(4096);
+    openContainerFile(bw, filename, format);
+    if (bw->file == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open output file!");
+        freeBIT_WRITER(bw);
+        freeCompressPool(jobs, jobCount, workers, threads);
+        free(carry);
+        fclose(file);
+        return status;
+    }
+    if (!independentMembers) {
+        writeContainerHeader(bw, format); // Otherwise every member writes its own header
+    }
 
-    LZ77_buffer *outputBuffer = initLZ77Buffer();
+    COMPRESS_POOL pool;
+    const unsigned started = startCompressPool(&pool, workers, threads, jobs, sizeof(COMPRESS_JOB), jobCount,
+                                               runCompressJob, format);
+    if (started == 0) {
+        status->code = COMPRESSION_FAILED;
+        createSTATUSMessage(status, "Can\'t start the compression threads!");
+    }
 
-    uint16_t LLFrequency[LITERAL_LENGTH_SIZE] = {0};
-    uint16_t distanceCodeFrequency[DISTANCE_CODE_SIZE] = {0};
+    uint32_t crc32Checksum = 0; // Finished CRC32 of the empty input, extended with combine_crc32
+    uint32_t adler32Checksum = ADLER32_INITIAL_VALUE;
+    uint64_t totalUncompressedSize = 0;
+    uint64_t writtenUncompressedSize = 0;
+    size_t carryLength = 0;
+    uint64_t written = 0;
+    bool endOfInput = started == 0;
+
+    for (;;) {
+        // Read ahead while there are free jobs. A free job isn't touched by the workers until it is queued.
+        while (!endOfInput && pool.queued - written < jobCount) {
+            COMPRESS_JOB *job = &jobs[pool.queued % jobCount];
+            unsigned char *input = job->data + WINDOW_SIZE;
+            job->length = fread(input, 1, chunkSize, file);
+            job->last = job->length < chunkSize || isAtEndOfFile(file);
+            endOfInput = job->last;
+            if (job->length == 0) {
+                // Only an empty input gets here, the BGZF end of file marker alone is an empty BGZF file
+                if (layout == LAYOUT_BGZF) {
+                    break;
+                }
+                if (independentMembers) {
+                    writeContainerHeader(bw, format);
+                }
+                writeEmptyFinalBlock(bw);
+                break;
+            }
 
-    BIT_WRITER *BIT_WRITER = initBIT_WRITER(4096);
-    createFile(BIT_WRITER, filename, "gz"); // Use "gz" extension
+            job->independent = independentMembers;
+            job->bgzf = layout == LAYOUT_BGZF;
+            job->historyLength = independentMembers || seekIndex != NULL ? 0 : carryLength;
+            memcpy(input - job->historyLength, carry, job->historyLength);
+            // Chunks are at least WINDOW_SIZE long, only the last one can be shorter
+            carryLength = job->length < WINDOW_SIZE ? job->length : WINDOW_SIZE;
+            memcpy(carry, input + job->length - carryLength, carryLength);
 
-    uint32_t crc32Checksum = 0xFFFFFFFF; // CRC32 is initialized to all ones
-    uint32_t totalUncompressedSize = 0;
+            if (format == CONTAINER_ZLIB) {
+                adler32Checksum = calculate_adler32(adler32Checksum, input, job->length);
+            }
+            totalUncompressedSize += job->length;
 
-    size_t chunkBytesRead = 0;
-    size_t current_buffer_pos = 0; // Tracks the start of the current compression window
-    bool isFinalBlock = false;
+            queueCompressJob(&pool);
+        }
+        if (written == pool.queued) {
+            break;
+        }
 
+        // Write the oldest job as soon as it is done
+        COMPRESS_JOB *job = &jobs[written % jobCount];
+        isCompressJobFinished(&pool, written, true);
 
-    chunkBytesRead = fread(ucpBuffer, 1, WINDOW_SIZE, file);
+        // The chunk has no history and the one before it ends on a sync flush: a full flush point
+        if (seekIndex != NULL && !addSeekPoint(seekIndex, bw->totalBytes + bw->index, writtenUncompressedSize)) {
+            status->code = CANT_ALLOCATE_MEMORY;
+            createSTATUSMessage(status, "Can\'t allocate memory for the seek index!");
+        }
+        writeRawBytes(bw, job->output->buffer, job->output->index);
+        writtenUncompressedSize += job->length;
+        if (format == CONTAINER_GZIP) {
+            crc32Checksum = combine_crc32(crc32Checksum, job->crc32, job->length);
+        }
+        written++;
+    }
 
-    // Loop continues as long as we read any data.
-    do {
-        // Prepare the next LZ77 compression step
-        size_t bytesToCompress = chunkBytesRead;
+    if (started > 0) {
+        stopCompressPool(&pool, workers, started);
+
+        // Independent members carry their own trailers, only the empty input still needs one
+        if (!independentMembers || (totalUncompressedSize == 0 && layout != LAYOUT_BGZF)) {
+            writeTrailer(bw, format, crc32Checksum, adler32Checksum, totalUncompressedSize);
+        }
+        if (layout == LAYOUT_BGZF) {
+            writeBgzfEof(bw);
+        }
+        if (seekIndex != NULL && status->code == COMPRESSION_SUCCESS) {
+            writeSeekIndex(bw, seekIndex, totalUncompressedSize);
+        }
+    }
+    closeCompressedFile(bw, status);
+
+    freeCompressPool(jobs, jobCount, workers, threads);
+    free(carry);
+    fclose(file);
+    return status;
+}
+
+/**
+ * @brief Compress Parallel
+ *
+ * Compresses a file into a single deflate stream with several threads, like pigz. The input is cut into chunks of
+ * chunkSize bytes, and every chunk is compressed by a worker thread on its own, with the last WINDOW_SIZE bytes of the
+ * previous chunk as its dictionary, so the compression ratio stays close to the single threaded one. Every chunk but
+ * the last ends on a byte aligned sync flush, so the pieces are simply written one after the other. The CRC32 of every
+ * chunk is computed by its worker and merged with combine_crc32.
+ *
+ * @param filename The file which we want to compress.
+ * @param format The container to wrap the deflate stream in (gzip, zlib or raw).
+ * @param threads The number of worker threads (1 - COMPRESS_MAX_THREADS). With 1 this is the same as compress.
+ * @param chunkSize The size of the input chunks (COMPRESS_MIN_CHUNK_SIZE - COMPRESS_MAX_CHUNK_SIZE).
+ *
+ * @returns STATUS object
+ */
+extern STATUS *compressParallel(char *filename, const CONTAINER_FORMAT format, unsigned threads, size_t chunkSize) {
+    if (threads > COMPRESS_MAX_THREADS) threads = COMPRESS_MAX_THREADS;
+    if (chunkSize < COMPRESS_MIN_CHUNK_SIZE) chunkSize = COMPRESS_MIN_CHUNK_SIZE;
+    if (chunkSize > COMPRESS_MAX_CHUNK_SIZE) chunkSize = COMPRESS_MAX_CHUNK_SIZE;
+    if (threads <= 1) {
+        return compress(filename, format);
+    }
+    return compressWithPool(filename, format, threads, chunkSize, LAYOUT_STREAM, NULL);
+}
+
+/**
+ * @brief Compress Members
+ *
+ * Compresses a file into a multi-member gzip file with several threads: every chunk of chunkSize bytes becomes a
+ * complete gzip member with its own header, CRC32 and ISIZE (RFC 1952 2.2). The chunks share no history, so the workers
+ * never wait for each other and any member can be decompressed on its own, at the cost of some compression ratio. Any
+ * gzip decompressor (including decompress) outputs the concatenation of the members.
+ *
+ * @param filename The file which we want to compress.
+ * @param threads The number of worker threads (1 - COMPRESS_MAX_THREADS).
+ * @param chunkSize The size of the input chunks (COMPRESS_MIN_CHUNK_SIZE - COMPRESS_MAX_CHUNK_SIZE).
+ *
+ * @returns STATUS object
+ */
+extern STATUS *compressMembers(char *filename, unsigned threads, size_t chunkSize) {
+    if (threads < 1) threads = 1;
+    if (threads > COMPRESS_MAX_THREADS) threads = COMPRESS_MAX_THREADS;
+    if (chunkSize < COMPRESS_MIN_CHUNK_SIZE) chunkSize = COMPRESS_MIN_CHUNK_SIZE;
+    if (chunkSize > COMPRESS_MAX_CHUNK_SIZE) chunkSize = COMPRESS_MAX_CHUNK_SIZE;
+    return compressWithPool(filename, CONTAINER_GZIP, threads, chunkSize, LAYOUT_MEMBERS, NULL);
+}
+
+/**
+ * @brief Compress BGZF
+ *
+ * Compresses a file into BGZF, the blocked gzip of samtools and htslib: every BGZF_BLOCK_INPUT_SIZE bytes of input
+ * become a gzip member of at most BGZF_MAX_BLOCK_SIZE bytes whose BC extra subfield holds its size, and the file ends
+ * with the BGZF end of file marker. A block which doesn't compress is stored. Any gzip decompressor reads it as a
+ * multi-member gzip file, while a BGZF reader jumps from block to block by the sizes in the headers. The blocks are
+ * compressed by the worker threads.
+ *
+ * @param filename The file which we want to compress.
+ * @param threads The number of worker threads (1 - COMPRESS_MAX_THREADS).
+ *
+ * @returns STATUS object
+ */
+extern STATUS *compressBgzf(char *filename, unsigned threads) {
+    if (threads < 1) threads = 1;
+    if (threads > COMPRESS_MAX_THREADS) threads = COMPRESS_MAX_THREADS;
+    return compressWithPool(filename, CONTAINER_GZIP, threads, BGZF_BLOCK_INPUT_SIZE, LAYOUT_BGZF, NULL);
+}
+
+/**
+ * @brief Compress Seekable
+ *
+ * Compresses a file into a seekable gzip file: a single member with a full flush (a byte aligned sync flush after
+ * which no match reaches back) every interval bytes of input, followed by an index of the flush points kept in the
+ * extra fields of empty members (see writeSeekIndex). Any gzip decompressor reads it as an ordinary gzip file, while
+ * a reader using the index can start decoding at any flush point without a window, e.g. to extract a range or to
+ * decode the parts on several threads. The chunks between the flush points are compressed by the worker threads.
+ *
+ * @param filename The file which we want to compress.
+ * @param threads The number of worker threads (1 - COMPRESS_MAX_THREADS).
+ * @param interval The input bytes between two flush points (COMPRESS_MIN_CHUNK_SIZE - COMPRESS_MAX_CHUNK_SIZE).
+ *
+ * @returns STATUS object
+ *
+ * Maximum memory required:
+ *  - the memory of compressParallel, plus 16 bytes per flush point
+ */
+extern STATUS *compressSeekable(char *filename, unsigned threads, size_t interval) {
+    if (threads < 1) threads = 1;
+    if (threads > COMPRESS_MAX_THREADS) threads = COMPRESS_MAX_THREADS;
+    if (interval < COMPRESS_MIN_CHUNK_SIZE) interval = COMPRESS_MIN_CHUNK_SIZE;
+    if (interval > COMPRESS_MAX_CHUNK_SIZE) interval = COMPRESS_MAX_CHUNK_SIZE;
+    SEEK_INDEX *seekIndex = initSEEK_INDEX();
+    if (seekIndex == NULL) {
+        STATUS *status = initSTATUS();
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the seek index!");
+        return status;
+    }
+    STATUS *status = compressWithPool(filename, CONTAINER_GZIP, threads, interval, LAYOUT_STREAM, seekIndex);
+    freeSEEK_INDEX(seekIndex);
+    return status;
+}
+
+#define PIPELINE_BLOCKS 4 // Blocks in flight in compressPipelined: one per stage plus one spare, so no stage waits for a buffer
+
+/**
+ * @brief One block of compressPipelined travelling from the reader through the matcher to the entropy coder.
+ */
+typedef struct {
+    unsigned char input[WINDOW_SIZE];
+    size_t length;          ///< Bytes in input, 0 only for an empty file.
+    bool last;              ///< The last block of the input.
+    LZ77_buffer* tokens;    ///< The tokens of the input, filled by the matcher.
+} PIPELINE_BLOCK;
+
+/**
+ * @brief A block of compressPipelined entropy coded by a worker thread into a piece of its own.
+ */
+typedef struct {
+    PIPELINE_BLOCK* block;
+    size_t blockIndex;      ///< The index of the block, returned to the free queue once the piece is written.
+    BIT_WRITER* output;     ///< Memory sink receiving the block. Not padded, the last byte may be partial.
+} ENTROPY_JOB;
+
+/**
+ * @brief The shared state of compressPipelined. The block indices go around the free -> read -> matched -> free queues.
+ */
+typedef struct {
+    FILE* file;
+    CONTAINER_FORMAT format;
+    PIPELINE_BLOCK* blocks;
+    size_t blockCount;
+    COMPRESS_CONTEXT* context;  ///< Window and hash table of the matcher.
+    SPSC_QUEUE* freeBlocks;     ///< entropy coder -> reader
+    SPSC_QUEUE* readBlocks;     ///< reader -> matcher
+    SPSC_QUEUE* matchedBlocks;  ///< matcher -> entropy coder
+    uint32_t crc32;             ///< Running CRC32, owned by the reader until it is joined.
+    uint32_t adler32;           ///< Running Adler-32, owned by the reader until it is joined.
+    uint64_t totalUncompressedSize;
+    bool readError;             ///< Reading the input failed, owned by the reader until it is joined.
+    bool stop;                  ///< Set by the entropy stage to make the reader end the input early (see drainPipeline).
+
+    unsigned entropyThreads;    ///< Worker threads of the entropy coding, 0 to code on the calling thread.
+    ENTROPY_JOB* entropyJobs;
+    size_t entropyJobCount;
+    COMPRESS_WORKER* entropyWorkers;
+} PIPELINE;
 
-        if (bytesToCompress > 0) {
-            crc32Checksum = calculate_crc32(
-                crc32Checksum,
-                ucpBuffer + current_buffer_pos,
-                bytesToCompress
-            );
-            totalUncompressedSize += (uint32_t) bytesToCompress;
+/**
+ * @brief Stage 1: reads the input block by block and updates the checksum of the container.
+ */
+static void* pipelineReader(void* arg) {
+    PIPELINE* pipeline = arg;
+    bool last = false;
+    while (!last) {
+        const size_t index = spscPop(pipeline->freeBlocks);
+        PIPELINE_BLOCK* block = &pipeline->blocks[index];
+        if (__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE)) {
+            // The rest of the input is dropped, an empty last block ends the other stages
+            block->length = 0;
+            block->last = true;
+            spscPush(pipeline->readBlocks, index);
+            break;
+        }
+        block->length = fread(block->input, 1, WINDOW_SIZE, pipeline->file);
+        if (ferror(pipeline->file)) {
+            pipeline->readError = true;
         }
+        block->last = last = block->length < WINDOW_SIZE || pipeline->readError || isAtEndOfFile(pipeline->file);
 
+        if (pipeline->format == CONTAINER_GZIP) {
+            pipeline->crc32 = calculate_crc32(pipeline->crc32, block->input, block->length);
+        } else if (pipeline->format == CONTAINER_ZLIB) {
+            pipeline->adler32 = calculate_adler32(pipeline->adler32, block->input, block->length);
+        }
+        pipeline->totalUncompressedSize += block->length;
+        spscPush(pipeline->readBlocks, index);
+    }
+    return NULL;
+}
 
-        compressData(
-            ucpBuffer + current_buffer_pos,
-            bytesToCompress,
-            hashTable,
-            outputBuffer
-        );
+/**
+ * @brief Stage 2: finds the LZ77 tokens of every block, with the previous WINDOW_SIZE bytes as history.
+ */
+static void* pipelineMatcher(void* arg) {
+    PIPELINE* pipeline = arg;
+    COMPRESS_CONTEXT* context = pipeline->context;
+    bool last = false;
+    while (!last) {
+        const size_t index = spscPop(pipeline->readBlocks);
+        PIPELINE_BLOCK* block = &pipeline->blocks[index];
+        last = block->last;
+        if (block->length > 0) {
+            memcpy(context->window + WINDOW_SIZE, block->input, block->length);
+            matchWindow(context, block->tokens, block->length);
+        }
+        spscPush(pipeline->matchedBlocks, index);
+    }
+    return NULL;
+}
 
+/**
+ * @brief Stops the reader at its next block and throws away every block still in flight, up to the last one. Called
+ * instead of the entropy stage, so the reader and matcher threads can be joined.
+ */
+static void drainPipeline(PIPELINE* pipeline) {
+    __atomic_store_n(&pipeline->stop, true, __ATOMIC_RELEASE);
+    bool last = false;
+    while (!last) {
+        const size_t index = spscPop(pipeline->matchedBlocks);
+        last = pipeline->blocks[index].last;
+        pipeline->blocks[index].tokens->size = 0;
+        if (!last) {
+            spscPush(pipeline->freeBlocks, index);
+        }
+    }
+}
 
-        isFinalBlock = (chunkBytesRead < WINDOW_SIZE) || feof(file);
+/**
+ * @brief Stage 3 on a worker thread: builds the trees of one block and writes its bits into the job's memory sink.
+ */
+static void runEntropyJob(COMPRESS_WORKER* worker, void* arg) {
+    ENTROPY_JOB* job = arg;
+    resetMemoryBIT_WRITER(job->output);
+    processBlock(job->output, worker->context->LLFrequency, worker->context->distanceCodeFrequency, job->block->tokens,
+                 job->block->last);
+}
 
-        processBlock(
-            BIT_WRITER,
-            LLFrequency,
-            distanceCodeFrequency,
-            outputBuffer,
-            isFinalBlock
-        );
+/**
+ * @brief Frees what initPipeline allocated. Allocations which failed are skipped.
+ */
+static void freePipeline(PIPELINE* pipeline) {
+    if (pipeline->blocks != NULL) {
+        for (size_t i = 0; i < pipeline->blockCount; i++) {
+            if (pipeline->blocks[i].tokens != NULL) freeLZ77Buffer(pipeline->blocks[i].tokens);
+        }
+        free(pipeline->blocks);
+    }
+    if (pipeline->entropyJobs != NULL) {
+        for (size_t i = 0; i < pipeline->entropyJobCount; i++) {
+            if (pipeline->entropyJobs[i].output != NULL) freeBIT_WRITER(pipeline->entropyJobs[i].output);
+        }
+        free(pipeline->entropyJobs);
+    }
+    if (pipeline->entropyWorkers != NULL) {
+        for (unsigned t = 0; t < pipeline->entropyThreads; t++) {
+            freeCOMPRESS_CONTEXT(pipeline->entropyWorkers[t].context);
+        }
+        free(pipeline->entropyWorkers);
+    }
+    freeCOMPRESS_CONTEXT(pipeline->context);
+    freeSPSC_QUEUE(pipeline->freeBlocks);
+    freeSPSC_QUEUE(pipeline->readBlocks);
+    freeSPSC_QUEUE(pipeline->matchedBlocks);
+}
 
-        freeLZ77Buffer(outputBuffer);
-        outputBuffer = initLZ77Buffer();
+/**
+ * @brief Allocates the blocks, queues, matcher context and entropy jobs of compressPipelined, with every block in the
+ * free queue.
+ *
+ * With entropy threads every job slot can hold a block besides the ones of the first two stages, so the matcher never
+ * runs out of blocks while the workers are busy.
+ *
+ * @returns bool false if an allocation failed, the pipeline must still be freed with freePipeline.
+ */
+static bool initPipeline(PIPELINE* pipeline, FILE* file, const CONTAINER_FORMAT format, const unsigned entropyThreads) {
+    memset(pipeline, 0, sizeof(PIPELINE));
+    pipeline->file = file;
+    pipeline->format = format;
+    pipeline->crc32 = CRC32_INITIAL_VALUE;
+    pipeline->adler32 = ADLER32_INITIAL_VALUE;
+    pipeline->entropyThreads = entropyThreads;
+    pipeline->entropyJobCount = 2 * (size_t) entropyThreads;
+    pipeline->blockCount = PIPELINE_BLOCKS + pipeline->entropyJobCount;
+
+    pipeline->blocks = (PIPELINE_BLOCK*) calloc(pipeline->blockCount, sizeof(PIPELINE_BLOCK));
+    pipeline->context = initCOMPRESS_CONTEXT();
+    pipeline->freeBlocks = initSPSC_QUEUE(pipeline->blockCount);
+    pipeline->readBlocks = initSPSC_QUEUE(pipeline->blockCount);
+    pipeline->matchedBlocks = initSPSC_QUEUE(pipeline->blockCount);
+    if (pipeline->blocks == NULL || pipeline->context == NULL || pipeline->freeBlocks == NULL ||
+        pipeline->readBlocks == NULL || pipeline->matchedBlocks == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < pipeline->blockCount; i++) {
+        pipeline->blocks[i].tokens = initLZ77Buffer();
+        if (pipeline->blocks[i].tokens == NULL) {
+            return false;
+        }
+        spscPush(pipeline->freeBlocks, i);
+    }
 
-        // Shift the window: The new window starts where the compressed data ended.
-        // We only need to keep the history (the previous WINDOW_SIZE) in ucpBuffer.
-        // In this setup, we compress the entire current window and then slide it.
+    if (entropyThreads == 0) {
+        return true;
+    }
+    pipeline->entropyJobs = (ENTROPY_JOB*) calloc(pipeline->entropyJobCount, sizeof(ENTROPY_JOB));
+    pipeline->entropyWorkers = (COMPRESS_WORKER*) calloc(entropyThreads, sizeof(COMPRESS_WORKER));
+    if (pipeline->entropyJobs == NULL || pipeline->entropyWorkers == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < pipeline->entropyJobCount; i++) {
+        pipeline->entropyJobs[i].output = initMemoryBIT_WRITER(WINDOW_SIZE);
+        if (pipeline->entropyJobs[i].output == NULL) {
+            return false;
+        }
+    }
+    for (unsigned t = 0; t < entropyThreads; t++) {
+        pipeline->entropyWorkers[t].context = initCOMPRESS_CONTEXT();
+        if (pipeline->entropyWorkers[t].context == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        if (!isFinalBlock) {
-            memmove(ucpBuffer, ucpBuffer + WINDOW_SIZE, WINDOW_SIZE);
-            vfSubtractWindowSizeFromHashTable(hashTable);
+/**
+ * @brief Splices the piece of a finished entropy job into the output and returns its block to the reader.
+ */
+static void writeEntropyJob(PIPELINE* pipeline, BIT_WRITER* bw, const ENTROPY_JOB* job) {
+    const BIT_WRITER* piece = job->output;
+    spliceBits(bw, piece->buffer, piece->index, piece->byte, piece->currentPosition);
+    job->block->tokens->size = 0;
+    if (!job->block->last) {
+        spscPush(pipeline->freeBlocks, job->blockIndex);
+    }
+}
 
-            chunkBytesRead = fread(ucpBuffer + WINDOW_SIZE, 1, WINDOW_SIZE, file);
+/**
+ * @brief Stage 3 with entropy threads: hands every matched block to the pool and splices the pieces into the output in
+ * order, at whatever bit offset the previous block ended. The calling thread only waits for a piece when every job slot
+ * is taken, so the matcher keeps getting free blocks. Once writing the output fails, no more blocks are handed out and
+ * the rest of the input is drained instead.
+ */
+static void entropyCodeInParallel(PIPELINE* pipeline, COMPRESS_POOL* pool, BIT_WRITER* bw) {
+    uint64_t dispatched = 0;
+    uint64_t written = 0;
+    bool last = false;
+    while (!last && !bw->writeError) {
+        // Write the pieces which are already done, in order
+        while (written < dispatched &&
+               isCompressJobFinished(pool, written, dispatched - written == pipeline->entropyJobCount)) {
+            writeEntropyJob(pipeline, bw, &pipeline->entropyJobs[written % pipeline->entropyJobCount]);
+            written++;
+        }
 
-            current_buffer_pos = WINDOW_SIZE;
-        } else {
-            chunkBytesRead = 0;
+        const size_t index = spscPop(pipeline->matchedBlocks);
+        PIPELINE_BLOCK* block = &pipeline->blocks[index];
+        last = block->last;
+        if (block->length == 0) {
+            // Only an empty input gets here, every other input ends with a final block of data
+            writeEmptyFinalBlock(bw);
+            break;
         }
-    } while (chunkBytesRead > 0);
+        ENTROPY_JOB* job = &pipeline->entropyJobs[dispatched % pipeline->entropyJobCount];
+        job->block = block;
+        job->blockIndex = index;
+        queueCompressJob(pool);
+        dispatched++;
+    }
+    for (; written < dispatched; written++) {
+        isCompressJobFinished(pool, written, true);
+        writeEntropyJob(pipeline, bw, &pipeline->entropyJobs[written % pipeline->entropyJobCount]);
+    }
+    if (!last) {
+        drainPipeline(pipeline);
+    }
+}
 
-    crc32Checksum = crc32Checksum ^ 0xFFFFFFFF;
-    printf("%d\n", (int) (crc32Checksum >> 0) & 0x000000FF);
-    printf("%d\n", (int) (crc32Checksum >> 8) & 0x000000FF);
-    printf("%d\n", (int) (crc32Checksum >> 16) & 0x000000FF);
-    printf("%d\n", (int) (crc32Checksum >> 24) & 0x000000FF);
+/**
+ * @brief Compress Pipelined
+ *
+ * Compresses a file into the same single deflate stream as compress, but overlaps the three parts of the work on
+ * separate threads:
+ *  1. a reader thread reads WINDOW_SIZE blocks and computes the CRC32 or Adler-32,
+ *  2. a matcher thread finds the LZ77 tokens of every block, keeping the window and hash table,
+ *  3. the calling thread builds the Huffman trees of every block and writes its bits.
+ * The blocks are handed over through bounded lock-free single producer single consumer queues. PIPELINE_BLOCKS input
+ * and token buffers go around, so every stage has a block to work on while the next one is already filled.
+ *
+ * Matching has to run in order, entropy coding doesn't: with entropyThreads the third stage hands the matched blocks to
+ * a worker pool, every block is coded into a bit buffer of its own, and the calling thread splices the buffers into the
+ * output in order at arbitrary bit offsets (see spliceBits). The output is the same either way.
+ *
+ * @param filename The file which we want to compress.
+ * @param format The container to wrap the deflate stream in (gzip, zlib or raw).
+ * @param entropyThreads Worker threads of the entropy coding (0 - COMPRESS_MAX_THREADS), 0 or 1 codes on the calling
+ * thread.
+ * @returns STATUS object
+ *
+ * Maximum memory required:
+ *  - 32bit systems: (1 + entropyThreads) * sizeof(COMPRESS_CONTEXT) + (PIPELINE_BLOCKS + 2 * entropyThreads) * (WINDOW_SIZE + the tokens and bits of one block)
+ *  - 64bit systems: (1 + entropyThreads) * sizeof(COMPRESS_CONTEXT) + (PIPELINE_BLOCKS + 2 * entropyThreads) * (WINDOW_SIZE + the tokens and bits of one block)
+ */
+extern STATUS *compressPipelined(char *filename, const CONTAINER_FORMAT format, unsigned entropyThreads) {
+    if (entropyThreads > COMPRESS_MAX_THREADS) entropyThreads = COMPRESS_MAX_THREADS;
+    if (entropyThreads == 1) entropyThreads = 0; // A single worker would only add a hand over
 
-    addBytes(BIT_WRITER, crc32Checksum, 4);
-    addBytes(BIT_WRITER, totalUncompressedSize, 4);
-    printf("%d\n", (int) (totalUncompressedSize >> 0) & 0x000000FF);
-    printf("%d\n", (int) (totalUncompressedSize >> 8) & 0x000000FF);
-    printf("%d\n", (int) (totalUncompressedSize >> 16) & 0x000000FF);
-    printf("%d\n", (int) (totalUncompressedSize >> 24) & 0x000000FF);
+    FILE *file = ffOpenFile(filename);
+    if (file == NULL) {
+        STATUS *status = initSTATUS();
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open input file!");
+        return status;
+    }
 
-    fclose(file);
+    PIPELINE pipeline;
+    if (!initPipeline(&pipeline, file, format, entropyThreads)) {
+        STATUS *status = initSTATUS();
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the compression pipeline!");
+        freePipeline(&pipeline);
+        fclose(file);
+        return status;
+    }
+
+    // Build the CRC32 tables before the reader uses them
+    calculate_crc32(CRC32_INITIAL_VALUE, NULL, 0);
+
+    pthread_t matcher;
+    pthread_t reader;
+    if (pthread_create(&matcher, NULL, pipelineMatcher, &pipeline) != 0) {
+        freePipeline(&pipeline);
+        fclose(file);
+        return compress(filename, format);
+    }
+    if (pthread_create(&reader, NULL, pipelineReader, &pipeline) != 0) {
+        // Nothing was read yet: stop the matcher with an empty last block and compress without threads
+        const size_t index = spscPop(pipeline.freeBlocks);
+        pipeline.blocks[index].length = 0;
+        pipeline.blocks[index].last = true;
+        spscPush(pipeline.readBlocks, index);
+        pthread_join(matcher, NULL);
+        freePipeline(&pipeline);
+        fclose(file);
+        return compress(filename, format);
+    }
 
-    free(hashTable);
-    free(ucpBuffer);
-    freeLZ77Buffer(outputBuffer);
-    printf("Done\n");
-    freeBIT_WRITER(BIT_WRITER);
+    STATUS *status = initSTATUS();
+    BIT_WRITER *bw = initBIT_WRITER(4096);
+    createFile(bw, filename, format);
+    if (bw->file == NULL) {
+        drainPipeline(&pipeline);
+        pthread_join(reader, NULL);
+        pthread_join(matcher, NULL);
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open output file!");
+        freeBIT_WRITER(bw);
+        freePipeline(&pipeline);
+        fclose(file);
+        return status;
+    }
+    status->code = COMPRESSION_SUCCESS;
+    createSTATUSMessage(status, "File compression succeeded!");
+
+    // Without entropy workers (or if none can be started) the calling thread codes the blocks itself
+    COMPRESS_POOL pool;
+    unsigned started = 0;
+    if (entropyThreads > 0) {
+        started = startCompressPool(&pool, pipeline.entropyWorkers, entropyThreads, pipeline.entropyJobs,
+                                    sizeof(ENTROPY_JOB), pipeline.entropyJobCount, runEntropyJob, format);
+    }
+
+    if (started > 0) {
+        entropyCodeInParallel(&pipeline, &pool, bw);
+        stopCompressPool(&pool, pipeline.entropyWorkers, started);
+    } else {
+        // Stage 3: entropy coding in input order
+        bool last = false;
+        while (!last) {
+            const size_t index = spscPop(pipeline.matchedBlocks);
+            PIPELINE_BLOCK *block = &pipeline.blocks[index];
+            last = block->last;
+            if (block->length == 0) {
+                // Only an empty input gets here, every other input ends with a final block of data
+                writeEmptyFinalBlock(bw);
+            } else {
+                processBlock(bw, pipeline.context->LLFrequency, pipeline.context->distanceCodeFrequency, block->tokens,
+                             last);
+                block->tokens->size = 0;
+            }
+            if (!last) {
+                spscPush(pipeline.freeBlocks, index);
+            }
+        }
+    }
+
+    pthread_join(reader, NULL);
+    pthread_join(matcher, NULL);
+    if (pipeline.readError) {
+        status->code = COMPRESSION_FAILED;
+        createSTATUSMessage(status, "Can\'t read input file!");
+    }
+
+    writeTrailer(bw, format, pipeline.crc32 ^ CRC32_INITIAL_VALUE, pipeline.adler32, pipeline.totalUncompressedSize);
+    closeCompressedFile(bw, status);
+
+    freePipeline(&pipeline);
+    fclose(file);
     return status;
 }
@@ -10,7 +10,27 @@
 #include "bitwriter.h"
 #include "status.h"
 
-extern STATUS* compress(char* fileName);
+#define COMPRESS_MAX_THREADS 256 // Upper bound on the worker threads of compressParallel
+#define COMPRESS_MIN_CHUNK_SIZE (64 * 1024)
+#define COMPRESS_MAX_CHUNK_SIZE (64 * 1024 * 1024)
+#define COMPRESS_DEFAULT_CHUNK_SIZE (256 * 1024) // Input chunk compressed by one thread of compressParallel
+
+/**
+ * @brief The state of one deflate stream: window, hash table and token buffer. Reusable for any number of streams.
+ */
+typedef struct COMPRESS_CONTEXT COMPRESS_CONTEXT;
+
+extern COMPRESS_CONTEXT* initCOMPRESS_CONTEXT(void);
+extern void freeCOMPRESS_CONTEXT(COMPRESS_CONTEXT* context);
+
+extern void compressBuffer(COMPRESS_CONTEXT* context, const unsigned char* input, size_t length, BIT_WRITER* output);
+extern STATUS* compressWithContext(COMPRESS_CONTEXT* context, char* fileName, CONTAINER_FORMAT format);
+extern STATUS* compress(char* fileName, CONTAINER_FORMAT format);
+extern STATUS* compressParallel(char* fileName, CONTAINER_FORMAT format, unsigned threads, size_t chunkSize);
+extern STATUS* compressMembers(char* fileName, unsigned threads, size_t chunkSize);
+extern STATUS* compressBgzf(char* fileName, unsigned threads);
+extern STATUS* compressSeekable(char* fileName, unsigned threads, size_t interval);
+extern STATUS* compressPipelined(char* fileName, CONTAINER_FORMAT format, unsigned entropyThreads);
 extern FILE* ffOpenFile(const char* filename);
 extern size_t flushBitWriterBuffer(BIT_WRITER* bw);
 
@@ -0,0 +1,22 @@
+//
+// Created by Attila on 12/14/2025.
+//
+
+#ifndef DEFLATE_CONTAINER_H
+#define DEFLATE_CONTAINER_H
+
+/**
+ * @brief The wrapper around the deflate stream, used in both directions.
+ */
+typedef enum {
+    CONTAINER_GZIP, ///< RFC 1952: gzip header, deflate stream, CRC32 and ISIZE trailer (.gz).
+    CONTAINER_ZLIB, ///< RFC 1950: 2 byte header, deflate stream, big endian Adler-32 trailer (.zz).
+    CONTAINER_RAW,  ///< RFC 1951: the bare deflate stream, no header and no checksum (.deflate).
+} CONTAINER_FORMAT;
+
+/**
+ * @brief Returns the file extension (without the dot) used for the given container.
+ */
+extern const char* getContainerExtension(CONTAINER_FORMAT format);
+
+#endif //DEFLATE_CONTAINER_H
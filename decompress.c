@@ -10,11 +10,21 @@
 #include "compress.h"
 #include "decompress.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
-#include "debug.h"
+#include "CRC_CHECKSUM.h"
+#include "bgzf.h"
 #include "HUFFMAN_TABLE.h"
+#include "seekable.h"
 
 #define ID 0x1F8B
 #define CM 0x08
@@ -25,7 +35,28 @@
 #define WORD uint16_t
 
 #define WINDOW_SIZE 32768
-#define BUFFER_SIZE (WINDOW_SIZE * 2)
+
+// Size of the output region written with one fwrite call. Can be overridden at build time (e.g. -DOUTPUT_BUFFER_SIZE=4194304).
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+#endif
+
+// Output region of the window when only verifying: nothing is written, so a small window which stays in the L2 cache
+// is enough, and the history copy on every slide is still only 1/8 of the output.
+#define VERIFY_OUTPUT_SIZE (256 * 1024)
+
+// What a block header costs against INFLATE_CHECK_INTERVAL: a header and its tables take about as long as decoding this
+// many bytes, so a stream of tiny blocks is checked as often as a stream of large ones.
+#define INFLATE_BLOCK_COST 4096
+
+// Compressed bytes per chunk of decompressParallel, every thread starts decoding at a guessed block in one of them.
+#ifndef PARALLEL_INFLATE_CHUNK_SIZE
+#define PARALLEL_INFLATE_CHUNK_SIZE (2 * 1024 * 1024)
+#endif
+// Decoded bytes after which a chunk stops at its next block boundary, bounds the memory of very compressible data.
+#define PARALLEL_INFLATE_MAX_OUTPUT (16 * 1024 * 1024)
+// Symbol INFLATE_MARKER + i of a speculative chunk stands for byte i of the (not yet known) window before the chunk.
+#define INFLATE_MARKER 256
 
 // --- DEFLATE Tables (RFC 1951) ---
 
@@ -75,276 +106,2015 @@ static const int dist_base[30] = {
     16385, 24577            // 28-29
 };
 
-static BIT_WRITER* openBIT_WRITER(const char* filename) {
-    BIT_WRITER* bw = initBIT_WRITER(BUFFER_SIZE);
-    const size_t fileNameLen = strlen(filename);
+/**
+ * @brief Open BIT_WRITER
+ *
+ * Creates the output window and opens the output file next to the input: the input name without the extension of the
+ * container (e.g. "data.gz" -> "data"), or the input name with ".out" appended if it has a different extension. The
+ * window computes the checksum the container's trailer is checked against, on its output thread if it could be
+ * started (see startOutputThread). The output is written as a sparse file (see BIT_WRITER.sparse).
+ *
+ * @param filename The compressed input file.
+ * @param format The container of the input.
+ *
+ * @returns BIT_WRITER* The output window OR NULL.
+ */
+static BIT_WRITER* openBIT_WRITER(const char* filename, const CONTAINER_FORMAT format) {
+    BIT_WRITER* bw = initWindowBIT_WRITER(WINDOW_SIZE, OUTPUT_BUFFER_SIZE);
+    if (bw == NULL) {
+        return NULL;
+    }
+    bw->computeCRC = format == CONTAINER_GZIP;
+    bw->computeAdler32 = format == CONTAINER_ZLIB;
 
-    bw->fileName = (char*) malloc(sizeof(char)*(fileNameLen-3+1)); //subtract the .gz and then add one byte for the '\0'
+    const char* extension = getContainerExtension(format);
+    const size_t fileNameLen = strlen(filename);
+    const size_t extensionLen = strlen(extension);
+    size_t baseLen = fileNameLen;
+    const char* suffix = ".out";
+    if (fileNameLen > extensionLen + 1 && filename[fileNameLen - extensionLen - 1] == '.' &&
+        strcmp(filename + fileNameLen - extensionLen, extension) == 0) {
+        baseLen = fileNameLen - extensionLen - 1;
+        suffix = "";
+    }
 
+    bw->fileName = (char*) malloc(baseLen + strlen(suffix) + 1);
     if (bw->fileName == NULL) {
-        freeBIT_WRITER(bw);
+        free(bw->buffer);
+        free(bw);
         return NULL;
     }
+    memcpy(bw->fileName, filename, baseLen);
+    strcpy(bw->fileName + baseLen, suffix);
 
-    for (size_t i = 0; i < fileNameLen-3; i++) {
-        bw->fileName[i] = filename[i];
-    }
-
-    bw->fileName[fileNameLen-3] = '\0';
     FILE* output = fopen(bw->fileName,"wb");
-
     if (output==NULL) {
-        freeBIT_WRITER(bw);
         free(bw->fileName);
+        free(bw->buffer);
+        free(bw);
         return NULL;
     }
 
+    // The output window already batches the data into OUTPUT_BUFFER_SIZE pieces, stdio buffering would only split them.
+    setvbuf(output, NULL, _IONBF, 0);
     bw->file = output;
+
+    // Zero pages (e.g. the free space of a disk image) become holes of the file instead of being written
+    struct stat info;
+    bw->sparse = fstat(fileno(output), &info) == 0 && S_ISREG(info.st_mode);
+
+    // The checksum and fwrite run on a thread of their own while the next piece is decoded. Without the thread the
+    // window writes on this thread, as before.
+    startOutputThread(bw, OUTPUT_THREAD_BUFFERS);
     return bw;
 }
 
+/**
+ * @brief Open Verify BIT_WRITER
+ *
+ * Creates an output window without a file: the decoded data only passes through the window (the history the matches
+ * copy from) and the checksum, nothing is written anywhere.
+ *
+ * @param format The container of the input.
+ *
+ * @returns BIT_WRITER* The output window OR NULL.
+ */
+static BIT_WRITER* openVerifyBIT_WRITER(const CONTAINER_FORMAT format) {
+    BIT_WRITER* bw = initWindowBIT_WRITER(WINDOW_SIZE, VERIFY_OUTPUT_SIZE);
+    if (bw == NULL) {
+        return NULL;
+    }
+    bw->computeCRC = format == CONTAINER_GZIP;
+    bw->computeAdler32 = format == CONTAINER_ZLIB;
+    return bw;
+}
+
+/**
+ * @brief Open Output
+ *
+ * @returns BIT_WRITER* The output window of decompressing (see openBIT_WRITER) or verifying (see openVerifyBIT_WRITER).
+ */
+static BIT_WRITER* openOutput(const char* filename, const CONTAINER_FORMAT format, const bool verifyOnly) {
+    return verifyOnly ? openVerifyBIT_WRITER(format) : openBIT_WRITER(filename, format);
+}
+
+/**
+ * @brief Close Output
+ *
+ * Closes and frees the output window. A failed write (see closeBIT_WRITER) turns a successful decompression into a
+ * failure. The output file of a failed decompression (corrupt or truncated input, a limit, a write error) is
+ * incomplete, so it is deleted, as gzip does.
+ *
+ * @param bw The output window from openOutput.
+ * @param status The result of the decompression, updated on a write error.
+ */
+static void closeOutput(BIT_WRITER* bw, STATUS* status) {
+    if (!closeBIT_WRITER(bw) && status->code == DECOMPRESS_SUCCESS) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "Can\'t write the output file!");
+    }
+    // Only a regular output file (the ones written sparse) is deleted, not e.g. a device the output name links to
+    if (status->code != DECOMPRESS_SUCCESS && bw->fileName != NULL && bw->sparse) {
+        remove(bw->fileName);
+    }
+    freeBIT_WRITER(bw);
+}
+
+/**
+ * @brief Copy Inflate Limits
+ *
+ * Copies the caps a caller passed for a file, e.g. for untrusted uploads.
+ *
+ * @param destination Receives the caps.
+ * @param limits The caps, NULL or all 0 for no caps.
+ */
+static void copyInflateLimits(INFLATE_LIMITS* destination, const INFLATE_LIMITS* limits) {
+    if (limits == NULL) {
+        memset(destination, 0, sizeof(INFLATE_LIMITS));
+    } else {
+        *destination = *limits;
+    }
+}
+
+/**
+ * @brief CPU Seconds
+ *
+ * @param wholeProcess Whether the time of all threads counts (a file decoded by several threads) or only the time of
+ * the calling one (a file decoded by one thread, while others may decode other files).
+ *
+ * @returns double The CPU time used so far in seconds.
+ */
+static double cpuSeconds(const bool wholeProcess) {
+#if defined(_WIN32)
+    (void) wholeProcess;
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec now;
+    if (clock_gettime(wholeProcess ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return (double) clock() / CLOCKS_PER_SEC;
+    }
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * @brief Exceeds Inflate Limits
+ *
+ * Compares the progress of a file with its caps.
+ *
+ * @param limits The caps.
+ * @param input Compressed bytes read so far.
+ * @param output Bytes decompressed so far.
+ * @param startTime The CPU time when the file started (see cpuSeconds).
+ * @param wholeProcess Passed to cpuSeconds.
+ * @param status Set to DECOMPRESS_LIMIT_EXCEEDED if a cap is exceeded, may be NULL.
+ *
+ * @returns bool true if a cap is exceeded.
+ */
+static bool exceedsInflateLimits(const INFLATE_LIMITS* limits, const uint64_t input, const uint64_t output,
+                                 const double startTime, const bool wholeProcess, STATUS* status) {
+    const char* message = NULL;
+    if (limits->maxOutput > 0 && output > limits->maxOutput) {
+        message = "The decompressed data exceeds the output limit!";
+    } else if (limits->maxRatio > 0 && output >= INFLATE_CHECK_INTERVAL && output / limits->maxRatio > input) {
+        message = "The compression ratio exceeds the ratio limit!";
+    } else if (limits->maxSeconds > 0 && cpuSeconds(wholeProcess) - startTime > limits->maxSeconds) {
+        message = "Decompression exceeds the time limit!";
+    }
+    if (message != NULL && status != NULL) {
+        status->code = DECOMPRESS_LIMIT_EXCEEDED;
+        createSTATUSMessage(status, message);
+    }
+    return message != NULL;
+}
+
+/**
+ * @brief Start Inflate Limits
+ *
+ * Resets the progress of a context at the start of a file, its caps stay.
+ *
+ * @param context The INFLATE_CONTEXT.
+ */
+static void startInflateLimits(INFLATE_CONTEXT* context) {
+    context->checkInterval = INFLATE_CHECK_INTERVAL;
+    context->checkCountdown = INFLATE_CHECK_INTERVAL;
+    context->produced = 0;
+    context->startTime = context->limits.maxSeconds > 0 ? cpuSeconds(false) : 0;
+}
+
+/**
+ * @brief Check Inflate Limits
+ *
+ * Runs whenever checkCountdown runs out (every checkInterval bytes of output) and at block headers after the
+ * input ended: stops the decoder if the input was truncated or a cap of the file is exceeded. The decode loops only
+ * count down, so this costs nothing per symbol.
+ *
+ * @param reader The BIT_READER of the file.
+ * @param context The INFLATE_CONTEXT, its checkCountdown is restarted.
+ * @param status Set to DECOMPRESS_FAILED or DECOMPRESS_LIMIT_EXCEEDED if the decoder has to stop.
+ *
+ * @returns bool false if the decoder has to stop.
+ */
+static bool checkInflateLimits(const BIT_READER* reader, INFLATE_CONTEXT* context, STATUS* status) {
+    context->produced += (uint64_t) (context->checkInterval - context->checkCountdown);
+    context->checkCountdown = context->checkInterval;
+    if (reader->overrun) {
+        // The zero bits after the end of the input decode to symbols, which would produce output forever
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "Unexpected end of the compressed data!");
+        return false;
+    }
+    return !exceedsInflateLimits(&context->limits, bit_reader_position(reader) / 8, context->produced,
+                                 context->startTime, false, status);
+}
+
+/**
+ * @brief Inflate Stored Block
+ *
+ * Decodes a stored block (BTYPE=00). The LEN bytes following the byte aligned LEN/NLEN header are copied in bulk from
+ * the read buffer straight into the output window.
+ *
+ * @param reader The BIT_READER positioned right after the block header bits.
+ * @param bw The output window.
+ * @param context The INFLATE_CONTEXT counting the output.
+ *
+ * @returns bool false if the block is corrupt or truncated.
+ */
+static bool inflateStoredBlock(BIT_READER* reader, BIT_WRITER* bw, INFLATE_CONTEXT* context) {
+    align_to_byte(reader);
+    const uint32_t LEN = read_bits(reader, 16);
+    const uint32_t NLEN = read_bits(reader, 16);
+    if (LEN == 0xFFFFFFFF || NLEN == 0xFFFFFFFF || (LEN ^ 0xFFFF) != NLEN) {
+        return false;
+    }
+    context->checkCountdown -= LEN;
+
+    size_t remaining = LEN;
+    while (remaining > 0) {
+        if (bw->overflow) {
+            return false;
+        }
+        size_t available;
+        uint8_t* destination = getFreeWindowSpace(bw, &available);
+        const size_t n = remaining < available ? remaining : available;
+        if (read_aligned_bytes(reader, destination, n) != n) {
+            return false;
+        }
+        commitWindowBytes(bw, n);
+        remaining -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief Inflate Match
+ *
+ * Decodes the extra bits and the distance of a length/distance pair and copies the match from the output history.
+ *
+ * @param reader The BIT_READER positioned right after the length symbol.
+ * @param bw The output window.
+ * @param symbol The length symbol (257-285).
+ * @param T_D_Tree The distance tree.
+ * @param status Set to DECOMPRESS_FAILED if the distance reaches before the start of the stream, or the match doesn't
+ * fit an output window without history.
+ *
+ * @returns WORD The length of the match, 0 if the length or distance symbol or the distance is invalid.
+ */
+static WORD inflateMatch(BIT_READER* reader, BIT_WRITER* bw, const WORD symbol, const HuffmanTree* T_D_Tree,
+                         STATUS* status) {
+    if (symbol > 285) {
+        fprintf(stderr, "Error: Invalid length symbol %d\n", symbol);
+        return 0;
+    }
+
+    // A. Decode Length
+    // 1. Get base length
+    int length_idx = symbol - 257;
+    int length = length_base[length_idx];
+
+    // 2. Read extra bits
+    int extra_bits = length_extra_bits[length_idx];
+    if (extra_bits > 0) {
+        int extra = read_bits(reader, extra_bits);
+        length += extra;
+    }
+
+    // B. Decode Distance
+    WORD dist_symbol = decode_symbol(reader, T_D_Tree);
+    if (dist_symbol > 29) {
+        fprintf(stderr, "Error: Invalid distance symbol %d\n", dist_symbol);
+        return 0;
+    }
+
+    // 1. Get base distance
+    int dist_base_val = dist_base[dist_symbol];
+
+    // 2. Read extra bits
+    int dist_extra = dist_extra_bits[dist_symbol];
+    int distance = dist_base_val;
+    if (dist_extra > 0) {
+        int extra = read_bits(reader, dist_extra);
+        distance += extra;
+    }
+
+    if (!copyFromBufferHistory(bw, (uint16_t) distance, (uint16_t) length)) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, bw->overflow ? "The output doesn\'t fit the window!" : "Invalid distance too far back!");
+        return 0;
+    }
+    return (WORD) length;
+}
+
+/**
+ * @brief Inflate Block Data
+ *
+ * The main decompression loop of a Huffman coded block (BTYPE=01 or BTYPE=10): decodes literals and length/distance
+ * pairs with the given trees until the end of block symbol. The output is counted down in a local copy of the
+ * context's checkCountdown, and checkInflateLimits runs whenever it runs out.
+ *
+ * @param reader The BIT_READER positioned at the first symbol of the block.
+ * @param bw The output window.
+ * @param context The INFLATE_CONTEXT counting the output.
+ * @param T_LL_Tree The literal/length tree.
+ * @param T_D_Tree The distance tree.
+ * @param status Set by checkInflateLimits if the decoder has to stop.
+ *
+ * @returns bool false if an invalid symbol was found, the decoder has to stop or a window without history overflowed.
+ */
+static bool inflateBlockData(BIT_READER* reader, BIT_WRITER* bw, INFLATE_CONTEXT* context, const HuffmanTree* T_LL_Tree,
+                             const HuffmanTree* T_D_Tree, STATUS* status) {
+    int64_t countdown = context->checkCountdown;
+    while (1) {
+        if (countdown <= 0) {
+            context->checkCountdown = countdown;
+            if (bw->overflow || !checkInflateLimits(reader, context, status)) return false;
+            countdown = context->checkCountdown;
+        }
+        WORD symbol = decode_symbol(reader, T_LL_Tree);
+        if (symbol <= 255) {
+            // Literal
+            addFastByte(bw,(BYTE)symbol);
+            countdown--;
+        } else if (symbol == 256) {
+            // EOB
+            context->checkCountdown = countdown;
+            return true;
+        } else {
+            const WORD length = inflateMatch(reader, bw, symbol, T_D_Tree, status);
+            if (length == 0) return false;
+            countdown -= length;
+        }
+    }
+}
+
+/**
+ * @brief Inflate Block Data Multi Literal
+ *
+ * Same as inflateBlockData, but literals are looked up MULTI_BITS at a time, so one lookup can emit two literals.
+ * Anything else (lengths, end of block, long codes) falls back to decode_symbol.
+ *
+ * @param reader The BIT_READER positioned at the first symbol of the block.
+ * @param bw The output window.
+ * @param context The INFLATE_CONTEXT counting the output.
+ * @param multiTable The multi literal table built from T_LL_Tree.
+ * @param T_LL_Tree The literal/length tree.
+ * @param T_D_Tree The distance tree.
+ * @param status Set by checkInflateLimits if the decoder has to stop.
+ *
+ * @returns bool false if an invalid symbol was found, the decoder has to stop or a window without history overflowed.
+ */
+static bool inflateBlockDataMultiLiteral(BIT_READER* reader, BIT_WRITER* bw, INFLATE_CONTEXT* context,
+                                         const MultiLiteralEntry* multiTable, const HuffmanTree* T_LL_Tree,
+                                         const HuffmanTree* T_D_Tree, STATUS* status) {
+    int64_t countdown = context->checkCountdown;
+    while (1) {
+        if (countdown <= 0) {
+            context->checkCountdown = countdown;
+            if (bw->overflow || !checkInflateLimits(reader, context, status)) return false;
+            countdown = context->checkCountdown;
+        }
+        const MultiLiteralEntry entry = multiTable[peek_bits(reader, MULTI_BITS)];
+        if (entry.count > 0) {
+            consume_bits(reader, entry.bits);
+            addFastByte(bw, entry.literals[0]);
+            if (entry.count == 2) addFastByte(bw, entry.literals[1]);
+            countdown -= entry.count;
+            continue;
+        }
+
+        WORD symbol = decode_symbol(reader, T_LL_Tree);
+        if (symbol <= 255) {
+            // Literal with a code longer than MULTI_BITS
+            addFastByte(bw,(BYTE)symbol);
+            countdown--;
+        } else if (symbol == 256) {
+            // EOB
+            context->checkCountdown = countdown;
+            return true;
+        } else {
+            const WORD length = inflateMatch(reader, bw, symbol, T_D_Tree, status);
+            if (length == 0) return false;
+            countdown -= length;
+        }
+    }
+}
+
+/**
+ * @brief Hash Code Lengths
+ *
+ * FNV-1a hash of a dynamic block header's HLIT, HDIST and raw code lengths, the key of the table cache.
+ */
+static uint32_t hashCodeLengths(const WORD HLIT, const WORD HDIST, const BYTE* lengths) {
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ HLIT) * 16777619u;
+    hash = (hash ^ HDIST) * 16777619u;
+    for (WORD i = 0; i < HLIT + HDIST; i++) {
+        hash = (hash ^ lengths[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Get Cached Tables
+ *
+ * Looks up the tables of a dynamic block header in the context's cache. On a miss the least recently used entry is
+ * rebuilt from the header, on a hit nothing is built at all.
+ *
+ * @param context The INFLATE_CONTEXT holding the cache, all_lengths must hold the header's code lengths.
+ * @param HLIT Number of literal/length code lengths.
+ * @param HDIST Number of distance code lengths.
+ *
+ * @returns INFLATE_TABLES* The tables to decode the block with.
+ */
+static INFLATE_TABLES* getCachedTables(INFLATE_CONTEXT* context, const WORD HLIT, const WORD HDIST) {
+    const BYTE* all_lengths = context->all_lengths;
+    const uint32_t hash = hashCodeLengths(HLIT, HDIST, all_lengths);
+    context->blockCounter++;
+
+    INFLATE_TABLES* victim = &context->tableCache[0];
+    for (int i = 0; i < INFLATE_TABLE_CACHE_SIZE; i++) {
+        INFLATE_TABLES* entry = &context->tableCache[i];
+        if (entry->valid && entry->hash == hash && entry->HLIT == HLIT && entry->HDIST == HDIST &&
+            memcmp(entry->lengths, all_lengths, HLIT + HDIST) == 0) {
+            entry->lastUse = context->blockCounter;
+            return entry;
+        }
+        if (!entry->valid || (victim->valid && entry->lastUse < victim->lastUse)) {
+            victim = entry;
+        }
+    }
+
+    victim->valid = true;
+    victim->hash = hash;
+    victim->lastUse = context->blockCounter;
+    victim->HLIT = HLIT;
+    victim->HDIST = HDIST;
+    memcpy(victim->lengths, all_lengths, HLIT + HDIST);
+
+    buildDecodeTree(all_lengths, HLIT, &victim->literalTree);
+    buildDecodeTree(all_lengths + HLIT, HDIST, &victim->distanceTree);
+
+    // Multi Literal Table, only if the literal code lengths make it pay off
+    victim->useMultiLiteralTable = isMultiLiteralTableProfitable(all_lengths);
+    if (victim->useMultiLiteralTable) {
+        buildMultiLiteralTable(&victim->literalTree, victim->multiLiteralTable);
+    }
+    return victim;
+}
+
+/**
+ * @brief Is Complete Code
+ *
+ * Checks the Kraft sum of a set of code lengths: every bit pattern must decode to a symbol. A single code (e.g. the only
+ * distance of a block) and no codes at all are accepted too, as zlib does.
+ *
+ * @param lengths The code lengths (0-15).
+ * @param count The number of code lengths.
+ *
+ * @returns bool true if the code is complete.
+ */
+static bool isCompleteCode(const BYTE* lengths, const WORD count) {
+    uint32_t space = 0; // In units of 2^-MAX_BITS
+    WORD codes = 0;
+    for (WORD i = 0; i < count; i++) {
+        if (lengths[i] > 0) {
+            space += 1u << (MAX_BITS - lengths[i]);
+            codes++;
+        }
+    }
+    return space == 1u << MAX_BITS || codes <= 1;
+}
+
+/**
+ * @brief Read Dynamic Header
+ *
+ * Reads the header of a dynamic Huffman block (BTYPE=10) and points the context's current tables to the ones built
+ * from it (see getCachedTables).
+ *
+ * @param reader The BIT_READER positioned right after the block header bits.
+ * @param context The INFLATE_CONTEXT whose current tables are set.
+ * @param strict Whether to also reject codes which are over-subscribed or incomplete (see isCompleteCode), which zlib
+ * never produces. Used when looking for block headers at guessed positions.
+ *
+ * @returns bool false if the header is corrupt.
+ */
+static bool readDynamicHeader(BIT_READER* reader, INFLATE_CONTEXT* context, const bool strict) {
+    static const BYTE cl_order[CL_SYMBOLS] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    const WORD HLIT = read_bits(reader, 5) + 257;
+    const WORD HDIST = read_bits(reader, 5) + 1;
+    const WORD HCLEN = read_bits(reader, 4) + 4;
+    if (HLIT > 286 || HDIST > 32) {
+        return false;
+    }
+
+    // --- 1. Build Code Length Tree ---
+    // Code lengths not listed in this block's header are 0, not whatever the previous block used.
+    memset(context->cl_lengths, 0, sizeof(context->cl_lengths));
+    for (WORD i = 0; i < HCLEN; i++) {
+        const uint32_t length = read_bits(reader, 3);
+        if (length == 0xFFFFFFFF) {
+            return false;
+        }
+        context->cl_lengths[cl_order[i]] = (BYTE) length;
+    }
+    buildDecodeTree(context->cl_lengths, CL_SYMBOLS, &context->codeLengthTree);
+
+    // --- 2. Decode Literal/Length and Distance Tree Lengths ---
+    BYTE* all_lengths = context->all_lengths;
+    const WORD total_lengths = HLIT + HDIST;
+    WORD current_len_index = 0;
+
+    while (current_len_index < total_lengths) {
+        const WORD symbol = decode_symbol(reader, &context->codeLengthTree);
+        BYTE value = 0;
+        uint32_t repeat_count = 1;
+        if (symbol <= 15) {
+            value = (BYTE) symbol;
+        } else if (symbol == 16) {
+            if (current_len_index == 0) return false; // Nothing to repeat
+            value = all_lengths[current_len_index - 1];
+            repeat_count = read_bits(reader, 2) + 3;
+        } else if (symbol == 17) {
+            repeat_count = read_bits(reader, 3) + 3;
+        } else if (symbol == 18) {
+            repeat_count = read_bits(reader, 7) + 11;
+        } else {
+            // Invalid code length code, the header is corrupt
+            return false;
+        }
+        if (current_len_index + repeat_count > total_lengths) {
+            return false;
+        }
+        memset(all_lengths + current_len_index, value, repeat_count);
+        current_len_index += repeat_count;
+    }
+
+    // The end of block symbol must be decodable.
+    if (all_lengths[256] == 0) {
+        return false;
+    }
+    if (strict && (!isCompleteCode(all_lengths, HLIT) || !isCompleteCode(all_lengths + HLIT, HDIST))) {
+        return false;
+    }
+
+    // --- 3. Literal/Length Tree (T_LL) and Distance Tree (T_D), built only if not cached ---
+    context->tables = getCachedTables(context, HLIT, HDIST);
+    return true;
+}
+
+/**
+ * @brief Read Big Endian 32
+ *
+ * Assembles a 32 bit value stored most significant byte first, as in the zlib container.
+ */
+static uint32_t readBigEndian32(const BYTE* bytes) {
+    return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | (uint32_t) bytes[3];
+}
+
+/**
+ * @brief Read Little Endian 32
+ *
+ * Assembles a 32 bit value stored least significant byte first, as in the gzip trailer.
+ */
+static uint32_t readLittleEndian32(const BYTE* bytes) {
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+/**
+ * @brief Verify Trailer
+ *
+ * Flushes the rest of the output (which also finishes the checksum computed on the fly) and compares it with the trailer
+ * of the container: CRC32 and ISIZE for gzip, the big endian Adler-32 for zlib. A raw deflate stream has no trailer.
+ *
+ * @param reader The BIT_READER positioned right after the final block.
+ * @param bw The output window.
+ * @param format The container of the input.
+ * @param status Set to DECOMPRESS_CRC_MISMATCH, DECOMPRESS_SIZE_MISMATCH, DECOMPRESS_ADLER32_MISMATCH or
+ * DECOMPRESS_FAILED on error.
+ */
+extern void verifyTrailer(BIT_READER* reader, BIT_WRITER* bw, const CONTAINER_FORMAT format, STATUS* status) {
+    flushBIT_WRITERBuffer(bw);
+    if (format == CONTAINER_RAW) {
+        return;
+    }
+
+    BYTE trailer[8];
+    const size_t trailerSize = format == CONTAINER_GZIP ? 8 : 4;
+    align_to_byte(reader);
+    if (read_aligned_bytes(reader, trailer, trailerSize) != trailerSize) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, format == CONTAINER_GZIP ? "Missing GZIP trailer!" : "Missing ZLIB trailer!");
+        return;
+    }
+
+    if (format == CONTAINER_ZLIB) {
+        if (bw->adler32 != readBigEndian32(trailer)) {
+            status->code = DECOMPRESS_ADLER32_MISMATCH;
+            createSTATUSMessage(status, "Adler-32 mismatch, the decompressed data is corrupt!");
+        }
+        return;
+    }
+
+    const uint32_t expectedCRC = (uint32_t) trailer[0] | (uint32_t) trailer[1] << 8 |
+                                 (uint32_t) trailer[2] << 16 | (uint32_t) trailer[3] << 24;
+    const uint32_t expectedSize = (uint32_t) trailer[4] | (uint32_t) trailer[5] << 8 |
+                                  (uint32_t) trailer[6] << 16 | (uint32_t) trailer[7] << 24;
+
+    if ((uint32_t) (bw->crc32 ^ CRC32_INITIAL_VALUE) != expectedCRC) {
+        status->code = DECOMPRESS_CRC_MISMATCH;
+        createSTATUSMessage(status, "CRC32 mismatch, the decompressed data is corrupt!");
+    } else if ((uint32_t) bw->totalBytes != expectedSize) {
+        status->code = DECOMPRESS_SIZE_MISMATCH;
+        createSTATUSMessage(status, "ISIZE mismatch, the decompressed data is corrupt!");
+    }
+}
 
-extern STATUS* decompress(const char* filename) {
+/**
+ * @brief Inflate Block
+ *
+ * Decodes one block of a deflate stream, header included.
+ *
+ * @param reader The BIT_READER positioned at a block header.
+ * @param bw The output window.
+ * @param context The INFLATE_CONTEXT holding the decode tables.
+ * @param final Output: whether the block had BFINAL set.
+ * @param status Set to DECOMPRESS_FAILED on error, or to DECOMPRESS_LIMIT_EXCEEDED (see INFLATE_CONTEXT.limits).
+ *
+ * @returns bool false if the block is corrupt or the decoder has to stop.
+ */
+extern bool inflateBlock(BIT_READER* reader, BIT_WRITER* bw, INFLATE_CONTEXT* context, bool* final, STATUS* status) {
+    context->checkCountdown -= INFLATE_BLOCK_COST;
+    if ((context->checkCountdown <= 0 || reader->overrun) && !checkInflateLimits(reader, context, status)) {
+        return false;
+    }
+    const STATUS_CODE code = status->code;
+    const BYTE BFINAL = read_bit(reader);
+    const BYTE BYTYPE = read_bits(reader,2);
+    *final = BFINAL == 0b1;
+    if (BYTYPE == 0b00) {
+        // Stored block
+        if (!inflateStoredBlock(reader, bw, context)) {
+            status->code = DECOMPRESS_FAILED;
+            createSTATUSMessage(status, "Found a corrupt stored block!");
+            return false;
+        }
+    } else if (BYTYPE == 0b01) {
+        // Fixed Huffman block, decoded with the shared prebuilt trees
+        if (!inflateBlockData(reader, bw, context, getFixedLiteralTree(), getFixedDistanceTree(), status)) {
+            if (status->code == code) {
+                status->code = DECOMPRESS_FAILED;
+                createSTATUSMessage(status, "Found a corrupt fixed huffman block!");
+            }
+            return false;
+        }
+    } else if (BYTYPE == 0b10) {
+        // Dynamic Huffman block, the header only refills the context's tables
+        bool blockIsValid = readDynamicHeader(reader, context, false) && !reader->overrun;
+        if (blockIsValid) {
+            const INFLATE_TABLES* tables = context->tables;
+            blockIsValid = tables->useMultiLiteralTable
+                ? inflateBlockDataMultiLiteral(reader, bw, context, tables->multiLiteralTable, &tables->literalTree,
+                                               &tables->distanceTree, status)
+                : inflateBlockData(reader, bw, context, &tables->literalTree, &tables->distanceTree, status);
+        }
+        if (!blockIsValid) {
+            if (status->code == code) {
+                status->code = DECOMPRESS_FAILED;
+                createSTATUSMessage(status, "Found a corrupt dynamic huffman block!");
+            }
+            return false;
+        }
+    } else {
+        status->code  = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "Found a block with reserved block type!");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Inflate Stream
+ *
+ * Decodes the blocks of one deflate stream, up to and including the block with BFINAL set.
+ *
+ * @param reader The BIT_READER positioned at the first block header.
+ * @param bw The output window.
+ * @param context The INFLATE_CONTEXT holding the decode tables.
+ * @param status Set to DECOMPRESS_FAILED on error.
+ *
+ * @returns bool false if a corrupt block was found.
+ */
+static bool inflateStream(BIT_READER* reader, BIT_WRITER* bw, INFLATE_CONTEXT* context, STATUS* status) {
+    bool final = false;
+    while (!final) {
+        if (!inflateBlock(reader, bw, context, &final, status)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Initialize INFLATE_CONTEXT
+ *
+ * Allocates the decode tables and scratch arrays used by decompressWithContext. The context has no caps, its owner may
+ * set limits before decoding untrusted files with it.
+ *
+ * @returns INFLATE_CONTEXT* The context OR NULL. Must be freed with freeINFLATE_CONTEXT.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: sizeof(INFLATE_CONTEXT) + 4 bytes
+ *  - 64bit systems: sizeof(INFLATE_CONTEXT) + 8 bytes
+ */
+extern INFLATE_CONTEXT* initINFLATE_CONTEXT(void) {
+    INFLATE_CONTEXT* context = (INFLATE_CONTEXT*) malloc(sizeof(INFLATE_CONTEXT));
+    if (context == NULL) {
+        return NULL;
+    }
+    memset(context, 0, sizeof(INFLATE_CONTEXT));
+    startInflateLimits(context);
+    return context;
+}
+
+/**
+ * @brief Free INFLATE_CONTEXT
+ *
+ * @param context The context to free. NULL is allowed.
+ */
+extern void freeINFLATE_CONTEXT(INFLATE_CONTEXT* context) {
+    free(context);
+}
+
+/**
+ * @brief Inflate File
+ *
+ * The body of decompressWithContext, verifyWithContext and scanWithContext: decodes every member of the file into the
+ * output window and checks every trailer. The caps of the context apply to the whole file.
+ *
+ * @param context An INFLATE_CONTEXT from initINFLATE_CONTEXT, may be reused for several files.
+ * @param filename The file to decompress.
+ * @param format The container of the file.
+ * @param verifyOnly Whether the output is only checked against the trailers instead of written to a file.
+ * @param sink NULL, or receives every piece of the output (see OUTPUT_SINK).
+ * @param sinkContext Passed to the sink.
+ *
+ * @returns STATUS* The result. Must be freed.
+ */
+static STATUS* inflateFile(INFLATE_CONTEXT* context, const char* filename, const CONTAINER_FORMAT format,
+                           const bool verifyOnly, const OUTPUT_SINK sink, void* sinkContext) {
 
     STATUS* status = initSTATUS();
     status->code = DECOMPRESS_SUCCESS;
-    createSTATUSMessage(status,"Decompression succeeded!");
+    createSTATUSMessage(status, verifyOnly ? "Verification succeeded!" : "Decompression succeeded!");
 
     BIT_READER* reader = init_bit_reader(filename);
-    BIT_WRITER* bw = openBIT_WRITER(filename);
+    if (reader == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open input file!");
+        return status;
+    }
+    startInflateLimits(context);
 
-    if (process_gzip_header(reader)) {
-        printf("Valid header!\n");
+    if (format == CONTAINER_GZIP && !process_gzip_header(reader)) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "Invalid GZIP header!");
+        freeBIT_READER(reader);
+        return status;
+    }
+    if (format == CONTAINER_ZLIB && !process_zlib_header(reader)) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "Invalid ZLIB header!");
+        freeBIT_READER(reader);
+        return status;
     }
 
-    const BYTE cl_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
-    WORD cl_lengths[19] = {0};
+    BIT_WRITER* bw = openOutput(filename, format, verifyOnly);
+    if (bw == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open output file!");
+        freeBIT_READER(reader);
+        return status;
+    }
+    bw->sink = sink;
+    bw->sinkContext = sinkContext;
 
-    BYTE BFINAL;
-    BYTE BYTYPE;
-    size_t blockCount = 0;
+    // A gzip file may hold several members, their outputs are concatenated (RFC 1952 2.2)
+    bool nextMember;
     do {
-        BFINAL = read_bit(reader);
-        BYTYPE = read_bits(reader,2);
-        if (BYTYPE != 0b10) {
-            status->code  = DECOMPRESS_FAILED;
-            createSTATUSMessage(status, "Found a block with not fixed huffman!");
-            free(reader);
-            freeBIT_WRITER(bw);
-            return status;
-        }
-        blockCount++;
-        WORD HLIT = read_bits(reader, 5) + 257;
-        WORD HDIST = read_bits(reader, 5) + 1;
-        WORD HCLEN = read_bits(reader, 4) + 4;
-        printf("HCLEN: %d\n",HCLEN);
-
-        for (WORD i = 0; i < HCLEN; i++) {
-            cl_lengths[cl_order[i]] = read_bits(reader,3);
-            printf("%d %d\n",cl_order[i],cl_lengths[cl_order[i]]);
-        }
-        printf("\n\n");
-        // --- 1. Build Code Length Tree ---
-        WORD bl_count[MAX_BITS + 1] = {0};
-        for (BYTE i = 0; i < CL_SYMBOLS; i++) {
-            if (cl_lengths[i] > 0) bl_count[cl_lengths[i]]++;
-        }
-
-        WORD next_code[MAX_BITS + 1];
-        WORD code = 0;
-        next_code[0] = 0;
-
-        for (int L = 1; L <= MAX_BITS; L++) {
-            code = (code + bl_count[L - 1]) << 1;
-            next_code[L] = code;
-        }
-
-        HUFFMAN_CODE* cl_canonical_codes = (HUFFMAN_CODE*) malloc(sizeof(HUFFMAN_CODE)*CL_SYMBOLS);
-
-        for (int i = 0; i < CL_SYMBOLS; i++) {
-            BYTE length = cl_lengths[i];
-            if (length > 0) {
-                cl_canonical_codes[i].code = next_code[length];
-                cl_canonical_codes[i].length = length;
-                next_code[length]++;
-            } else {
-                cl_canonical_codes[i].length = 0;
+        nextMember = false;
+        if (inflateStream(reader, bw, context, status)) {
+            verifyTrailer(reader, bw, format, status);
+        }
+        if (status->code == DECOMPRESS_SUCCESS && format == CONTAINER_GZIP && !at_end_of_gzip_members(reader)) {
+            if (!process_gzip_header(reader)) {
+                status->code = DECOMPRESS_FAILED;
+                createSTATUSMessage(status, "Invalid GZIP header after the end of a member!");
+                break;
             }
+            // Every member has its own CRC32 and ISIZE, and starts a new stream
+            bw->crc32 = CRC32_INITIAL_VALUE;
+            bw->totalBytes = 0;
+            startOutputStream(bw);
+            nextMember = true;
         }
+    } while (nextMember);
 
-        HuffmanTree* T_CL_Tree = (HuffmanTree*) malloc(sizeof(HuffmanTree));
-        T_CL_Tree->total_symbols = CL_SYMBOLS;
-        memcpy(T_CL_Tree->codes_list, cl_canonical_codes, sizeof(HUFFMAN_CODE)*CL_SYMBOLS);
+    freeBIT_READER(reader);
+    closeOutput(bw, status);
 
-        buildFastLookupTable(cl_canonical_codes, CL_SYMBOLS, T_CL_Tree->lookup_table);
+    return status;
+}
 
-        // --- 2. Decode Literal/Length and Distance Tree Lengths ---
-        WORD total_lengths = HLIT + HDIST;
-        BYTE* all_lengths = (BYTE*) calloc(total_lengths, sizeof(BYTE));
-        WORD current_len_index = 0;
-        BYTE previous_len = 0;
+/**
+ * @brief Decompress With Context
+ *
+ * Decompresses a gzip, zlib or raw deflate file next to itself (without the container's extension), using the decode
+ * tables of the given context.
+ *
+ * @param context An INFLATE_CONTEXT from initINFLATE_CONTEXT, may be reused for several files.
+ * @param filename The file to decompress.
+ * @param format The container of the file.
+ *
+ * @returns STATUS* The result of the decompression. Must be freed.
+ */
+extern STATUS* decompressWithContext(INFLATE_CONTEXT* context, const char* filename, const CONTAINER_FORMAT format) {
+    return inflateFile(context, filename, format, false, NULL, NULL);
+}
 
-        while (current_len_index < total_lengths) {
-            uint32_t symbol = decode_symbol(reader, T_CL_Tree);
-            if (symbol <= 15) {
-                all_lengths[current_len_index++] = (BYTE)symbol;
-                previous_len = (BYTE)symbol;
-            } else if (symbol == 16) {
-                uint32_t repeat_count = read_bits(reader, 2) + 3;
-                for (int j = 0; j < repeat_count && current_len_index < total_lengths; j++) {
-                    all_lengths[current_len_index++] = previous_len;
-                }
-            } else if (symbol == 17) {
-                uint32_t repeat_count = read_bits(reader, 3) + 3;
-                for (int j = 0; j < repeat_count && current_len_index < total_lengths; j++) {
-                    all_lengths[current_len_index++] = 0;
-                }
-                previous_len = 0;
-            } else if (symbol == 18) {
-                uint32_t repeat_count = read_bits(reader, 7) + 11;
-                for (int j = 0; j < repeat_count && current_len_index < total_lengths; j++) {
-                    all_lengths[current_len_index++] = 0;
-                }
-                previous_len = 0;
+/**
+ * @brief Verify With Context
+ *
+ * Checks the integrity of a gzip, zlib or raw deflate file like gzip -t: the whole stream is decoded and every checksum
+ * and ISIZE is compared with the trailers, but the output only passes through a VERIFY_OUTPUT_SIZE window and nothing
+ * is written. A raw deflate stream has no checksum, so only its blocks are checked.
+ *
+ * @param context An INFLATE_CONTEXT from initINFLATE_CONTEXT, may be reused for several files.
+ * @param filename The file to check.
+ * @param format The container of the file.
+ *
+ * @returns STATUS* DECOMPRESS_SUCCESS if the file is intact. Must be freed.
+ *
+ * Maximum memory required:
+ *  - the INFLATE_CONTEXT, a 4 KB read buffer and WINDOW_SIZE + VERIFY_OUTPUT_SIZE bytes of window
+ */
+extern STATUS* verifyWithContext(INFLATE_CONTEXT* context, const char* filename, const CONTAINER_FORMAT format) {
+    return inflateFile(context, filename, format, true, NULL, NULL);
+}
+
+/**
+ * @brief Scan With Context
+ *
+ * Decodes a file like verifyWithContext, checking every trailer without writing anything, and hands each
+ * VERIFY_OUTPUT_SIZE piece of the output to the sink right after it is decoded, while it is still in the cache. The
+ * data of a gzip file with several members reaches the sink as one stream.
+ *
+ * @param context An INFLATE_CONTEXT from initINFLATE_CONTEXT, may be reused for several files.
+ * @param filename The file to scan.
+ * @param format The container of the file.
+ * @param sink Receives the output in order.
+ * @param sinkContext Passed to the sink.
+ *
+ * @returns STATUS* DECOMPRESS_SUCCESS if the file is intact. Must be freed.
+ *
+ * Maximum memory required:
+ *  - the INFLATE_CONTEXT, a 4 KB read buffer and WINDOW_SIZE + VERIFY_OUTPUT_SIZE bytes of window
+ */
+extern STATUS* scanWithContext(INFLATE_CONTEXT* context, const char* filename, const CONTAINER_FORMAT format,
+                               const OUTPUT_SINK sink, void* sinkContext) {
+    return inflateFile(context, filename, format, true, sink, sinkContext);
+}
+
+/**
+ * @brief Inflate File Alone
+ *
+ * The body of decompress and verify, and of the serial fallback of inflateFileParallel: inflateFile with a freshly
+ * allocated INFLATE_CONTEXT.
+ *
+ * @param filename The file to decompress.
+ * @param format The container of the file.
+ * @param verifyOnly Whether the output is only checked against the trailers instead of written to a file.
+ * @param limits The caps on the file, NULL for none.
+ *
+ * @returns STATUS* The result. Must be freed.
+ */
+static STATUS* inflateFileAlone(const char* filename, const CONTAINER_FORMAT format, const bool verifyOnly,
+                                const INFLATE_LIMITS* limits) {
+    INFLATE_CONTEXT* context = initINFLATE_CONTEXT();
+    if (context == NULL) {
+        STATUS* status = initSTATUS();
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the inflate context!");
+        return status;
+    }
+    copyInflateLimits(&context->limits, limits);
+    STATUS* status = inflateFile(context, filename, format, verifyOnly, NULL, NULL);
+    freeINFLATE_CONTEXT(context);
+    return status;
+}
+
+/**
+ * @brief Decompress
+ *
+ * Decompresses a file with a freshly allocated INFLATE_CONTEXT, without caps.
+ *
+ * @param filename The file to decompress.
+ * @param format The container of the file.
+ *
+ * @returns STATUS* The result of the decompression. Must be freed.
+ */
+extern STATUS* decompress(const char* filename, const CONTAINER_FORMAT format) {
+    return inflateFileAlone(filename, format, false, NULL);
+}
+
+/**
+ * @brief Verify
+ *
+ * Checks the integrity of a file (see verifyWithContext) with a freshly allocated INFLATE_CONTEXT, without caps.
+ *
+ * @param filename The file to check.
+ * @param format The container of the file.
+ *
+ * @returns STATUS* DECOMPRESS_SUCCESS if the file is intact. Must be freed.
+ */
+extern STATUS* verify(const char* filename, const CONTAINER_FORMAT format) {
+    return inflateFileAlone(filename, format, true, NULL);
+}
+
+// --- Parallel inflate: speculative decoding of one member, after rapidgzip and pugz ---
+
+/**
+ * @brief How the decoding of a chunk ended.
+ */
+typedef enum {
+    CHUNK_EMPTY,        ///< No block header found in the search range, nothing decoded.
+    CHUNK_DECODING,     ///< Started, still decoding.
+    CHUNK_FAILED,       ///< Hit corrupt data: the start was a false positive (or the file is corrupt).
+    CHUNK_LANDED,       ///< Reached the start of a later chunk at a block boundary.
+    CHUNK_STOPPED,      ///< Stopped at a block boundary at the end of the round or at PARALLEL_INFLATE_MAX_OUTPUT.
+    CHUNK_STREAM_END    ///< Decoded the block with BFINAL set.
+} INFLATE_CHUNK_END;
+
+/**
+ * @brief A piece of the compressed member decoded by one thread.
+ *
+ * The decoding doesn't need the data before the chunk: the window is filled with markers, so a back-reference into it
+ * produces INFLATE_MARKER + (its position in the window) instead of a byte. Once the window is known the markers are
+ * replaced by bytes (resolveChunk).
+ */
+typedef struct {
+    uint64_t searchBit;         ///< The first bit where a block header is looked for.
+    uint64_t searchEndBit;      ///< The search range ends here (the searchBit of the next chunk).
+    bool started;               ///< Whether a start was found, set before any chunk checks for landings.
+    uint64_t startBit;          ///< The block boundary the decoding started at.
+    uint64_t endBit;            ///< The block boundary the decoding ended at.
+    INFLATE_CHUNK_END end;
+    size_t landedChunk;         ///< The chunk reached, if end is CHUNK_LANDED.
+    uint16_t* output;           ///< WINDOW_SIZE window symbols followed by the decoded symbols, bytes once resolved.
+    size_t size;                ///< Symbols in output, including the window.
+    size_t capacity;            ///< Symbols output can hold.
+    size_t windowLength;        ///< Bytes of the window back-references may reach (less at the start of a stream).
+    BYTE window[WINDOW_SIZE];   ///< The real window before the chunk, known before resolveChunk.
+    BIT_READER reader;          ///< Memory reader over the whole file, kept between the search and the decode phase.
+    INFLATE_CONTEXT* context;   ///< Decode tables of the chunk.
+    bool overLimit;             ///< Failed because its output passed the output or ratio cap (see growChunkOutput).
+} INFLATE_CHUNK;
+
+/**
+ * @brief The parallel step the workers of a round are running.
+ */
+typedef enum {
+    PHASE_SEARCH,   ///< Find the start of every chunk but the first and decode its first block.
+    PHASE_DECODE,   ///< Decode every started chunk to its end.
+    PHASE_RESOLVE   ///< Replace the markers of the chunks on the chain with bytes.
+} INFLATE_PHASE;
+
+/**
+ * @brief State of decompressParallel, shared by all threads.
+ */
+typedef struct {
+    const BYTE* data;           ///< The whole compressed file.
+    size_t size;
+    const SEEK_INDEX* seekIndex; ///< The full flush points of a seekable file (see compressSeekable) OR NULL.
+    INFLATE_CHUNK* chunks;      ///< One chunk per thread in every round.
+    size_t chunkCount;
+    uint64_t roundEndBit;       ///< Chunks stop at the first block boundary after this.
+    size_t* chain;              ///< The chunks holding the real output of the round, in order.
+    size_t chainLength;
+    BYTE history[WINDOW_SIZE];  ///< The last WINDOW_SIZE bytes of output, history[WINDOW_SIZE - 1] is the newest.
+    size_t historyLength;       ///< Bytes of history which exist.
+    INFLATE_PHASE phase;
+    size_t nextTask;            ///< The next chunk (or chain entry) a worker takes.
+    pthread_mutex_t lock;
+    pthread_t* threads;
+    unsigned threadCount;
+    INFLATE_LIMITS limits;      ///< Caps on the file, also set in the context of every chunk.
+    uint64_t produced;          ///< Output written so far, for the caps.
+    double startTime;           ///< CPU time of the process when the file started, if a time cap is set.
+} PARALLEL_INFLATE;
+
+/**
+ * @brief Grow Chunk Output
+ *
+ * Doubles the output of a chunk. A chunk is never grown past the output or ratio cap of its context, so a single
+ * block expanding without bounds (a decompression bomb) fails its chunk instead of exhausting the memory.
+ *
+ * @returns bool false if the memory can't be allocated or a cap is exceeded.
+ */
+static bool growChunkOutput(INFLATE_CHUNK* chunk) {
+    INFLATE_LIMITS sizeLimits = chunk->context->limits;
+    sizeLimits.maxSeconds = 0;
+    const uint64_t input = (bit_reader_position(&chunk->reader) - chunk->startBit) / 8;
+    if (exceedsInflateLimits(&sizeLimits, input, chunk->size - WINDOW_SIZE, 0, true, NULL)) {
+        chunk->overLimit = true;
+        return false;
+    }
+    uint16_t* output = (uint16_t*) realloc(chunk->output, chunk->capacity * 2 * sizeof(uint16_t));
+    if (output == NULL) {
+        return false;
+    }
+    chunk->output = output;
+    chunk->capacity *= 2;
+    return true;
+}
+
+/**
+ * @brief Inflate Chunk Stored Block
+ *
+ * inflateStoredBlock for a chunk: the bytes are widened to symbols.
+ *
+ * @returns bool false if the block is corrupt or truncated.
+ */
+static bool inflateChunkStoredBlock(INFLATE_CHUNK* chunk) {
+    BIT_READER* reader = &chunk->reader;
+    align_to_byte(reader);
+    const uint32_t LEN = read_bits(reader, 16);
+    const uint32_t NLEN = read_bits(reader, 16);
+    if (LEN == 0xFFFFFFFF || NLEN == 0xFFFFFFFF || (LEN ^ 0xFFFF) != NLEN) {
+        return false;
+    }
+    while (chunk->capacity - chunk->size < LEN) {
+        if (!growChunkOutput(chunk)) return false;
+    }
+
+    BYTE bytes[4096];
+    size_t remaining = LEN;
+    while (remaining > 0) {
+        const size_t n = remaining < sizeof(bytes) ? remaining : sizeof(bytes);
+        if (read_aligned_bytes(reader, bytes, n) != n) {
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            chunk->output[chunk->size + i] = bytes[i];
+        }
+        chunk->size += n;
+        remaining -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief Inflate Chunk Symbols
+ *
+ * inflateBlockData and inflateBlockDataMultiLiteral for a chunk: literals and matches are written as 16 bit symbols, so
+ * matches reaching into the window copy its markers. Unlike the serial decoder it also fails on running out of data
+ * and on back-references before the start of the stream, as a false positive start easily produces both.
+ *
+ * @param chunk The chunk, its reader positioned at the first symbol of the block.
+ * @param multiTable The multi literal table built from T_LL_Tree, or NULL.
+ * @param T_LL_Tree The literal/length tree.
+ * @param T_D_Tree The distance tree.
+ *
+ * @returns bool false if the block is corrupt.
+ */
+static bool inflateChunkSymbols(INFLATE_CHUNK* chunk, const MultiLiteralEntry* multiTable, const HuffmanTree* T_LL_Tree,
+                                const HuffmanTree* T_D_Tree) {
+    BIT_READER* reader = &chunk->reader;
+    uint16_t* output = chunk->output;
+    size_t size = chunk->size;
+    const size_t firstValid = WINDOW_SIZE - chunk->windowLength;
+
+    while (1) {
+        if (chunk->capacity - size < 258) {
+            chunk->size = size;
+            if (!growChunkOutput(chunk)) return false;
+            output = chunk->output;
+        }
+        if (reader->bitCount == 0 && reader->buffer_index >= reader->buffer_size) {
+            return false;
+        }
+
+        if (multiTable != NULL) {
+            const MultiLiteralEntry entry = multiTable[peek_bits(reader, MULTI_BITS)];
+            if (entry.count > 0) {
+                consume_bits(reader, entry.bits);
+                output[size++] = entry.literals[0];
+                if (entry.count == 2) output[size++] = entry.literals[1];
+                continue;
             }
         }
 
-        // --- 3. Build Literal/Length Tree (T_LL) ---
-        WORD ll_bl_count[MAX_BITS + 1] = {0};
-        for (WORD i = 0; i < HLIT; i++) {
-            if (all_lengths[i] > 0) ll_bl_count[all_lengths[i]]++;
+        const WORD symbol = decode_symbol(reader, T_LL_Tree);
+        if (symbol <= 255) {
+            output[size++] = symbol;
+            continue;
+        }
+        if (symbol == 256) {
+            break;
+        }
+        if (symbol > 285) {
+            return false;
         }
 
-        WORD ll_next_code[MAX_BITS + 1];
-        WORD ll_code = 0;
-        ll_next_code[0] = 0;
-        for (int L = 1; L <= MAX_BITS; L++) {
-            ll_code = (ll_code + ll_bl_count[L - 1]) << 1;
-            ll_next_code[L] = ll_code;
+        uint32_t length = length_base[symbol - 257];
+        if (length_extra_bits[symbol - 257] > 0) {
+            const uint32_t extra = read_bits(reader, length_extra_bits[symbol - 257]);
+            if (extra == 0xFFFFFFFF) return false;
+            length += extra;
+        }
+        const WORD dist_symbol = decode_symbol(reader, T_D_Tree);
+        if (dist_symbol > 29) {
+            return false;
+        }
+        uint32_t distance = dist_base[dist_symbol];
+        if (dist_extra_bits[dist_symbol] > 0) {
+            const uint32_t extra = read_bits(reader, dist_extra_bits[dist_symbol]);
+            if (extra == 0xFFFFFFFF) return false;
+            distance += extra;
+        }
+        if (distance > size - firstValid) {
+            return false;
         }
 
-        HUFFMAN_CODE* ll_canonical_codes = (HUFFMAN_CODE*) malloc(HLIT * sizeof(HUFFMAN_CODE));
-        for (WORD i = 0; i < HLIT; i++) {
-            BYTE length = all_lengths[i];
-            if (length > 0) {
-                ll_canonical_codes[i].code = ll_next_code[length];
-                ll_canonical_codes[i].length = length;
-                ll_next_code[length]++;
-            } else {
-                ll_canonical_codes[i].length = 0;
-            }
+        const uint16_t* source = output + size - distance;
+        for (uint32_t i = 0; i < length; i++) {
+            output[size + i] = source[i];
+        }
+        size += length;
+    }
+    chunk->size = size;
+    return true;
+}
+
+/**
+ * @brief Inflate Chunk Block
+ *
+ * Decodes one block of a chunk, header included.
+ *
+ * @param chunk The chunk, its reader positioned at a block header.
+ * @param strict Whether to reject dynamic blocks with incomplete codes (see readDynamicHeader).
+ * @param final Output: whether the block had BFINAL set.
+ *
+ * @returns bool false if the block is corrupt.
+ */
+static bool inflateChunkBlock(INFLATE_CHUNK* chunk, const bool strict, bool* final) {
+    BIT_READER* reader = &chunk->reader;
+    const int BFINAL = read_bit(reader);
+    const uint32_t BTYPE = read_bits(reader, 2);
+    if (BFINAL < 0 || BTYPE == 0xFFFFFFFF) {
+        return false;
+    }
+    *final = BFINAL == 1;
+
+    if (BTYPE == 0b00) {
+        return inflateChunkStoredBlock(chunk);
+    }
+    if (BTYPE == 0b01) {
+        return inflateChunkSymbols(chunk, NULL, getFixedLiteralTree(), getFixedDistanceTree());
+    }
+    if (BTYPE == 0b10 && readDynamicHeader(reader, chunk->context, strict)) {
+        const INFLATE_TABLES* tables = chunk->context->tables;
+        return inflateChunkSymbols(chunk, tables->useMultiLiteralTable ? tables->multiLiteralTable : NULL,
+                                   &tables->literalTree, &tables->distanceTree);
+    }
+    return false;
+}
+
+/**
+ * @brief Peek Bits At
+ *
+ * Returns at least 57 bits of the data starting at any bit, the bits after the end of the data are 0.
+ */
+static uint64_t peekBitsAt(const BYTE* data, const size_t size, const uint64_t bit) {
+    const size_t byte = (size_t) (bit >> 3);
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8 && byte + i < size; i++) {
+        value |= (uint64_t) data[byte + i] << (8 * i);
+    }
+    return value >> (bit & 7);
+}
+
+/**
+ * @brief Is Dynamic Header Candidate
+ *
+ * Cheap check whether a dynamic block header (BTYPE=10, not the final block) may start at the given bit: HLIT and
+ * HDIST in range and a complete code length code. Rules out almost every position before the header is decoded.
+ */
+static bool isDynamicHeaderCandidate(const BYTE* data, const size_t size, const uint64_t bit) {
+    const uint64_t header = peekBitsAt(data, size, bit);
+    if ((header & 7) != 0b100 || ((header >> 3) & 31) > 29 || ((header >> 8) & 31) > 29) {
+        return false;
+    }
+    const unsigned HCLEN = (unsigned) ((header >> 13) & 15) + 4;
+    const uint64_t lengths = peekBitsAt(data, size, bit + 17);
+    uint32_t space = 0; // In units of 2^-7, the longest code length code
+    for (unsigned i = 0; i < HCLEN; i++) {
+        const unsigned length = (unsigned) (lengths >> (3 * i)) & 7;
+        if (length > 0) space += 128u >> length;
+    }
+    return space == 128;
+}
+
+/**
+ * @brief Start At Seek Point
+ *
+ * Starts the chunk at the first full flush point of its search range, if there is one. Nothing before a full flush
+ * point is referenced, so the chunk starts with an empty window and can't produce markers.
+ */
+static void startAtSeekPoint(const SEEK_INDEX* seekIndex, INFLATE_CHUNK* chunk, const BYTE* data, const size_t size) {
+    size_t low = 0;
+    size_t high = seekIndex->count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (seekIndex->points[middle].compressedOffset * 8 < chunk->searchBit) {
+            low = middle + 1;
+        } else {
+            high = middle;
         }
+    }
+    if (low == seekIndex->count || seekIndex->points[low].compressedOffset * 8 >= chunk->searchEndBit) {
+        return;
+    }
+    chunk->windowLength = 0;
+    chunk->size = WINDOW_SIZE;
+    chunk->startBit = seekIndex->points[low].compressedOffset * 8;
+    init_memory_bit_reader(&chunk->reader, data, size, chunk->startBit);
+    chunk->started = true;
+    chunk->end = CHUNK_DECODING;
+}
 
-        HuffmanTree* T_LL_Tree = (HuffmanTree*) malloc(sizeof(HuffmanTree));
-        T_LL_Tree->total_symbols = HLIT;
-        memcpy(T_LL_Tree->codes_list, ll_canonical_codes, HLIT * sizeof(HUFFMAN_CODE));
-        buildFastLookupTable(ll_canonical_codes, HLIT, T_LL_Tree->lookup_table);
-        print_debug_tree(T_CL_Tree,"Literal/Length");
-        // --- 4. Build Distance Tree (T_D) ---
-        WORD dist_bl_count[MAX_BITS + 1] = {0};
-        for (WORD i = 0; i < HDIST; i++) {
-            BYTE length = all_lengths[HLIT + i];
-            if (length > 0) dist_bl_count[length]++;
-        }
-
-        WORD* distanceNextCode = (WORD*) malloc(sizeof(WORD)*(MAX_BITS + 1));
-        WORD dist_code = 0;
-        distanceNextCode[0] = 0;
-        for (int L = 1; L <= MAX_BITS; L++) {
-            dist_code = (dist_code + dist_bl_count[L - 1]) << 1;
-            distanceNextCode[L] = dist_code;
-        }
-
-        HUFFMAN_CODE* distanceCanonicalCodes = (HUFFMAN_CODE*) malloc(HDIST*sizeof(HUFFMAN_CODE));
-        for (WORD i = 0; i < HDIST; i++) {
-            BYTE length = all_lengths[HLIT + i];
-            if (length > 0) {
-                distanceCanonicalCodes[i].code = distanceNextCode[length];
-                distanceCanonicalCodes[i].length = length;
-                distanceNextCode[length]++;
-            } else {
-                distanceCanonicalCodes[i].length = 0;
+/**
+ * @brief Search Chunk Start
+ *
+ * Looks for the first position of the chunk's search range where a dynamic block header passes the strict checks and
+ * the whole block decodes. The block stays decoded, the chunk continues after it in the decode phase. A seekable file
+ * needs no search, its chunks start at the known full flush points.
+ */
+static void searchChunkStart(const PARALLEL_INFLATE* inflater, INFLATE_CHUNK* chunk) {
+    if (inflater->seekIndex != NULL) {
+        startAtSeekPoint(inflater->seekIndex, chunk, inflater->data, inflater->size);
+        return;
+    }
+    for (size_t i = 0; i < WINDOW_SIZE; i++) {
+        chunk->output[i] = (uint16_t) (INFLATE_MARKER + i);
+    }
+    chunk->windowLength = WINDOW_SIZE;
+
+    for (uint64_t bit = chunk->searchBit; bit < chunk->searchEndBit; bit++) {
+        if (!isDynamicHeaderCandidate(inflater->data, inflater->size, bit)) {
+            continue;
+        }
+        chunk->size = WINDOW_SIZE;
+        chunk->startBit = bit;
+        init_memory_bit_reader(&chunk->reader, inflater->data, inflater->size, bit);
+        bool final = false;
+        if (inflateChunkBlock(chunk, true, &final)) {
+            chunk->started = true;
+            chunk->end = CHUNK_DECODING;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Decode Chunk
+ *
+ * Decodes a started chunk block by block until it reaches the start of a later chunk (which then holds the rest of
+ * the data), the end of the round, the output limit or the end of the stream.
+ */
+static void decodeChunk(const PARALLEL_INFLATE* inflater, const size_t index) {
+    INFLATE_CHUNK* chunk = &inflater->chunks[index];
+    if (chunk->end != CHUNK_DECODING) {
+        return;
+    }
+    while (1) {
+        const uint64_t position = bit_reader_position(&chunk->reader);
+        if (position != chunk->startBit) {
+            if (position >= inflater->roundEndBit || chunk->size - WINDOW_SIZE >= PARALLEL_INFLATE_MAX_OUTPUT) {
+                chunk->end = CHUNK_STOPPED;
+                chunk->endBit = position;
+                return;
             }
+            for (size_t j = index + 1; j < inflater->chunkCount; j++) {
+                if (inflater->chunks[j].started && inflater->chunks[j].startBit == position) {
+                    chunk->end = CHUNK_LANDED;
+                    chunk->endBit = position;
+                    chunk->landedChunk = j;
+                    return;
+                }
+            }
+        }
+        bool final = false;
+        if (!inflateChunkBlock(chunk, false, &final)) {
+            chunk->end = CHUNK_FAILED;
+            return;
         }
+        if (final) {
+            chunk->end = CHUNK_STREAM_END;
+            chunk->endBit = bit_reader_position(&chunk->reader);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Next Chunk Window
+ *
+ * Resolves the last WINDOW_SIZE symbols of a chunk (window included) with the chunk's window, which gives the window of
+ * the data after it.
+ */
+static void nextChunkWindow(const INFLATE_CHUNK* chunk, BYTE* next) {
+    const uint16_t* symbols = chunk->output + chunk->size - WINDOW_SIZE;
+    for (size_t i = 0; i < WINDOW_SIZE; i++) {
+        next[i] = symbols[i] < INFLATE_MARKER ? (BYTE) symbols[i] : chunk->window[symbols[i] - INFLATE_MARKER];
+    }
+}
 
-        HuffmanTree* T_D_Tree = (HuffmanTree*) malloc(sizeof(HuffmanTree));
-        T_D_Tree->total_symbols = HDIST;
-        memcpy(T_D_Tree->codes_list, distanceCanonicalCodes, HDIST * sizeof(HUFFMAN_CODE));
-        buildFastLookupTable(distanceCanonicalCodes, HDIST, T_D_Tree->lookup_table);
+/**
+ * @brief Resolve Chunk
+ *
+ * Replaces the markers of a chunk with the bytes of its window, in place: byte i of the output overwrites a symbol
+ * which was already read.
+ */
+static void resolveChunk(INFLATE_CHUNK* chunk) {
+    const uint16_t* symbols = chunk->output;
+    BYTE* bytes = (BYTE*) chunk->output;
+    for (size_t i = WINDOW_SIZE; i < chunk->size; i++) {
+        bytes[i - WINDOW_SIZE] = symbols[i] < INFLATE_MARKER ? (BYTE) symbols[i] : chunk->window[symbols[i] - INFLATE_MARKER];
+    }
+}
 
-        // --- 5. Main Decompression Loop ---
-        size_t count = 0;
+/**
+ * @brief Run Inflate Phase
+ *
+ * Worker loop: takes chunks (or chain entries) one by one and runs the current phase on them.
+ */
+static void* runInflatePhase(void* argument) {
+    PARALLEL_INFLATE* inflater = (PARALLEL_INFLATE*) argument;
+    const size_t tasks = inflater->phase == PHASE_RESOLVE ? inflater->chainLength : inflater->chunkCount;
+    while (1) {
+        pthread_mutex_lock(&inflater->lock);
+        const size_t task = inflater->nextTask++;
+        pthread_mutex_unlock(&inflater->lock);
+        if (task >= tasks) {
+            return NULL;
+        }
+        if (inflater->phase == PHASE_SEARCH) {
+            if (task > 0) searchChunkStart(inflater, &inflater->chunks[task]);
+        } else if (inflater->phase == PHASE_DECODE) {
+            decodeChunk(inflater, task);
+        } else {
+            resolveChunk(&inflater->chunks[inflater->chain[task]]);
+        }
+    }
+}
+
+/**
+ * @brief Run Phase
+ *
+ * Runs a phase on all threads, the calling thread included, and waits for the end of it. If no thread can be created
+ * the calling thread does all the work.
+ */
+static void runPhase(PARALLEL_INFLATE* inflater, const INFLATE_PHASE phase) {
+    inflater->phase = phase;
+    inflater->nextTask = 0;
+    unsigned started = 0;
+    for (unsigned t = 1; t < inflater->threadCount; t++) {
+        if (pthread_create(&inflater->threads[started], NULL, runInflatePhase, inflater) == 0) {
+            started++;
+        }
+    }
+    runInflatePhase(inflater);
+    for (unsigned t = 0; t < started; t++) {
+        pthread_join(inflater->threads[t], NULL);
+    }
+}
+
+/**
+ * @brief Start Round
+ *
+ * Splits the next chunkCount * PARALLEL_INFLATE_CHUNK_SIZE bytes of the stream among the chunks. Only the first chunk
+ * starts at a known block boundary with the known history, the others have to search for theirs.
+ */
+static void startRound(PARALLEL_INFLATE* inflater, const uint64_t startBit) {
+    const uint64_t chunkBits = (uint64_t) PARALLEL_INFLATE_CHUNK_SIZE * 8;
+    const uint64_t totalBits = (uint64_t) inflater->size * 8;
+    for (size_t i = 0; i < inflater->chunkCount; i++) {
+        INFLATE_CHUNK* chunk = &inflater->chunks[i];
+        chunk->searchBit = startBit + i * chunkBits;
+        chunk->searchEndBit = chunk->searchBit + chunkBits < totalBits ? chunk->searchBit + chunkBits : totalBits;
+        chunk->started = false;
+        chunk->end = CHUNK_EMPTY;
+        chunk->size = WINDOW_SIZE;
+        chunk->overLimit = false;
+    }
+    inflater->roundEndBit = startBit + inflater->chunkCount * chunkBits;
+
+    INFLATE_CHUNK* first = &inflater->chunks[0];
+    for (size_t i = 0; i < WINDOW_SIZE; i++) {
+        first->output[i] = inflater->history[i];
+    }
+    first->windowLength = inflater->historyLength;
+    first->startBit = startBit;
+    first->started = true;
+    first->end = CHUNK_DECODING;
+    init_memory_bit_reader(&first->reader, inflater->data, inflater->size, startBit);
+}
+
+/**
+ * @brief Write Bytes
+ *
+ * Copies decoded bytes into the output window, which updates the checksum and writes them out.
+ */
+static void writeBytes(BIT_WRITER* bw, const BYTE* bytes, size_t length) {
+    while (length > 0) {
+        size_t available;
+        BYTE* destination = getFreeWindowSpace(bw, &available);
+        const size_t n = length < available ? length : available;
+        memcpy(destination, bytes, n);
+        commitWindowBytes(bw, n);
+        bytes += n;
+        length -= n;
+    }
+}
+
+/**
+ * @brief Inflate Member Parallel
+ *
+ * Decodes one deflate stream in rounds. In every round each thread decodes a chunk, then the chain of chunks holding
+ * the real output is followed from the first chunk: a chunk ending at the start of another continues there, so chunks
+ * started at a false positive are simply never reached. The windows along the chain are computed one after the other
+ * (WINDOW_SIZE symbols each), then all chunks on the chain are resolved in parallel and written in order.
+ *
+ * @param inflater The shared state.
+ * @param bit Input: the first bit of the stream. Output: the bit after its final block.
+ * @param bw The output window.
+ * @param status Set to DECOMPRESS_FAILED on error.
+ *
+ * @returns bool false if the stream is corrupt.
+ */
+static bool inflateMemberParallel(PARALLEL_INFLATE* inflater, uint64_t* bit, BIT_WRITER* bw, STATUS* status) {
+    memset(inflater->history, 0, WINDOW_SIZE);
+    inflater->historyLength = 0;
+    uint64_t startBit = *bit;
+
+    while (1) {
+        startRound(inflater, startBit);
+        runPhase(inflater, PHASE_SEARCH);
+        runPhase(inflater, PHASE_DECODE);
+
+        inflater->chainLength = 0;
+        size_t current = 0;
         while (1) {
-            WORD symbol = decode_symbol(reader, T_LL_Tree);
-            //printf("%d\n",symbol);
-            if (symbol <= 255) {
-                // Literal
-                // printf("Lit: %c\n", (char)symbol); // Debug
-                addFastByte(bw,(BYTE)symbol);
-                count++;
-            } else if (symbol == 256) {
-                // EOB
-                printf("EOB reached at count: %llu\n", count);
-                break;
-            } else {
-                // Length/Distance Pair
-                if (symbol > 285) {
-                    printf("Error: Invalid length symbol %d\n", symbol);
-                    break;
-                }
+            inflater->chain[inflater->chainLength++] = current;
+            if (inflater->chunks[current].end != CHUNK_LANDED) break;
+            current = inflater->chunks[current].landedChunk;
+        }
+        const INFLATE_CHUNK* last = &inflater->chunks[current];
+        if (last->end != CHUNK_STOPPED && last->end != CHUNK_STREAM_END) {
+            status->code = last->overLimit ? DECOMPRESS_LIMIT_EXCEEDED : DECOMPRESS_FAILED;
+            createSTATUSMessage(status, last->overLimit ? "A block exceeds the output or ratio limit!"
+                                                        : "Found a corrupt block!");
+            return false;
+        }
 
-                // A. Decode Length
-                // 1. Get base length
-                int length_idx = symbol - 257;
-                int length = length_base[length_idx];
+        // The window of every chunk on the chain is the end of the one before it
+        for (size_t k = 0; k < inflater->chainLength; k++) {
+            INFLATE_CHUNK* chunk = &inflater->chunks[inflater->chain[k]];
+            if (k == 0) memcpy(chunk->window, inflater->history, WINDOW_SIZE);
+            BYTE* next = k + 1 < inflater->chainLength ? inflater->chunks[inflater->chain[k + 1]].window : inflater->history;
+            nextChunkWindow(chunk, next);
+            const size_t produced = chunk->size - WINDOW_SIZE;
+            inflater->historyLength = inflater->historyLength + produced < WINDOW_SIZE ? inflater->historyLength + produced : WINDOW_SIZE;
+        }
 
-                // 2. Read extra bits
-                int extra_bits = length_extra_bits[length_idx];
-                if (extra_bits > 0) {
-                    int extra = read_bits(reader, extra_bits);
-                    length += extra;
-                }
+        runPhase(inflater, PHASE_RESOLVE);
+        for (size_t k = 0; k < inflater->chainLength; k++) {
+            const INFLATE_CHUNK* chunk = &inflater->chunks[inflater->chain[k]];
+            writeBytes(bw, (const BYTE*) chunk->output, chunk->size - WINDOW_SIZE);
+            inflater->produced += chunk->size - WINDOW_SIZE;
+        }
+        if (exceedsInflateLimits(&inflater->limits, last->endBit / 8, inflater->produced, inflater->startTime, true, status)) {
+            return false;
+        }
 
-                // B. Decode Distance
-                WORD dist_symbol = decode_symbol(reader, T_D_Tree);
-                if (dist_symbol > 29) {
-                    printf("Error: Invalid distance symbol %d\n", dist_symbol);
-                    //break;
-                }
+        if (last->end == CHUNK_STREAM_END) {
+            *bit = last->endBit;
+            return true;
+        }
+        startBit = last->endBit;
+    }
+}
 
-                // 1. Get base distance
-                int dist_base_val = dist_base[dist_symbol];
+/**
+ * @brief Map Whole File
+ *
+ * Maps the file read-only into memory, so the chunks read it straight from the page cache instead of a copy on the
+ * heap, and only the pages the threads touch are ever read.
+ *
+ * @returns const BYTE* The content of the file OR NULL if it can't be opened or mapped (always on Windows, and for an
+ * empty file). Must be released with unmapWholeFile.
+ */
+static const BYTE* mapWholeFile(const char* filename, size_t* size) {
+#if defined(_WIN32)
+    (void) filename;
+    (void) size;
+    return NULL;
+#else
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0 ||
+        (uint64_t) info.st_size > (uint64_t) SIZE_MAX) {
+        close(fd);
+        return NULL;
+    }
+    *size = (size_t) info.st_size;
+    void* data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid without the descriptor
+    return data == MAP_FAILED ? NULL : (const BYTE*) data;
+#endif
+}
 
-                // 2. Read extra bits
-                int dist_extra = dist_extra_bits[dist_symbol];
-                int distance = dist_base_val;
-                if (dist_extra > 0) {
-                    int extra = read_bits(reader, dist_extra);
-                    distance += extra;
-                }
+/**
+ * @brief Unmap Whole File
+ *
+ * @param data The content from mapWholeFile.
+ * @param size Its size.
+ */
+static void unmapWholeFile(const BYTE* data, const size_t size) {
+#if defined(_WIN32)
+    (void) data;
+    (void) size;
+#else
+    munmap((void*) data, size);
+#endif
+}
+
+/**
+ * @brief Free PARALLEL_INFLATE
+ *
+ * @param inflater The state to free, NULL is allowed.
+ */
+static void freePARALLEL_INFLATE(PARALLEL_INFLATE* inflater) {
+    if (inflater == NULL) {
+        return;
+    }
+    if (inflater->chunks != NULL) {
+        for (size_t i = 0; i < inflater->chunkCount; i++) {
+            free(inflater->chunks[i].output);
+            freeINFLATE_CONTEXT(inflater->chunks[i].context);
+        }
+        free(inflater->chunks);
+    }
+    free(inflater->chain);
+    free(inflater->threads);
+    pthread_mutex_destroy(&inflater->lock);
+    free(inflater);
+}
 
-                // printf("Len: %d, Dist: %d\n", length, distance); // Debug
+/**
+ * @brief Initialize PARALLEL_INFLATE
+ *
+ * @param data The compressed file.
+ * @param size The size of the file.
+ * @param threads The number of threads, also the number of chunks per round.
+ *
+ * @returns PARALLEL_INFLATE* The state OR NULL. Must be freed with freePARALLEL_INFLATE.
+ */
+static PARALLEL_INFLATE* initPARALLEL_INFLATE(const BYTE* data, const size_t size, const unsigned threads) {
+    PARALLEL_INFLATE* inflater = (PARALLEL_INFLATE*) calloc(1, sizeof(PARALLEL_INFLATE));
+    if (inflater == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&inflater->lock, NULL);
+    inflater->data = data;
+    inflater->size = size;
+    inflater->threadCount = threads;
+    inflater->chunkCount = threads;
+    inflater->chunks = (INFLATE_CHUNK*) calloc(threads, sizeof(INFLATE_CHUNK));
+    inflater->chain = (size_t*) malloc(threads * sizeof(size_t));
+    inflater->threads = (pthread_t*) malloc(threads * sizeof(pthread_t));
+    if (inflater->chunks == NULL || inflater->chain == NULL || inflater->threads == NULL) {
+        freePARALLEL_INFLATE(inflater);
+        return NULL;
+    }
+    for (size_t i = 0; i < threads; i++) {
+        INFLATE_CHUNK* chunk = &inflater->chunks[i];
+        chunk->capacity = WINDOW_SIZE + 2 * (size_t) PARALLEL_INFLATE_CHUNK_SIZE;
+        chunk->output = (uint16_t*) malloc(chunk->capacity * sizeof(uint16_t));
+        chunk->context = initINFLATE_CONTEXT();
+        if (chunk->output == NULL || chunk->context == NULL) {
+            freePARALLEL_INFLATE(inflater);
+            return NULL;
+        }
+    }
+    return inflater;
+}
 
-                copyFromBufferHistory(bw,distance,length);
-                count += length;
+// --- BGZF: every block is a gzip member of its own, so the blocks are decoded on any thread ---
+
+#define BGZF_BLOCKS_PER_THREAD 16 // Blocks decoded per thread in one round of inflateBgzfBlocks
+
+/**
+ * @brief One BGZF block of a round and its decoded data.
+ */
+typedef struct {
+    uint64_t offset;        ///< Position of the block in the file.
+    size_t size;            ///< Size of the block.
+    BIT_WRITER* output;     ///< Window BIT_WRITER without a file and history, holding the decoded block.
+    bool valid;             ///< The block decoded and matched its CRC32 and ISIZE.
+} BGZF_BLOCK;
+
+/**
+ * @brief State of inflateBgzfBlocks, shared by all threads.
+ */
+typedef struct {
+    const BYTE* data;       ///< The whole compressed file.
+    BGZF_BLOCK* blocks;     ///< The blocks of the current round.
+    size_t blockCount;
+    size_t nextTask;        ///< The next block a worker takes.
+    pthread_mutex_t lock;
+} BGZF_INFLATE;
+
+/**
+ * @brief Inflate BGZF Block
+ *
+ * Decodes one block into its output and checks it against the CRC32 and ISIZE of its trailer. The output holds
+ * BGZF_MAX_BLOCK_SIZE + 1 bytes and has no history, so it never slides: a block decoding to more than that overflows
+ * it (see handleBufferSlide) and is rejected at the next check of the decoder, which runs at least once per buffer
+ * of output.
+ */
+static void inflateBgzfBlock(const BYTE* data, BGZF_BLOCK* block, INFLATE_CONTEXT* context, STATUS* status) {
+    const BYTE* member = data + block->offset;
+    size_t headerSize = 0;
+    readBgzfBlockSize(member, block->size, &headerSize);
+    BIT_WRITER* output = block->output;
+    output->index = 0;
+    output->overflow = false;
+    startOutputStream(output);
+    context->checkInterval = (int64_t) output->bufferSize;
+    context->checkCountdown = context->checkInterval;
+
+    BIT_READER reader;
+    init_memory_bit_reader(&reader, member, block->size - 8, (uint64_t) headerSize * 8);
+    bool final = false;
+    block->valid = true;
+    while (block->valid && !final && !output->overflow) {
+        block->valid = inflateBlock(&reader, output, context, &final, status);
+    }
+    const BYTE* trailer = member + block->size - 8;
+    const uint32_t crc = (uint32_t) (calculate_crc32(CRC32_INITIAL_VALUE, output->buffer, output->index) ^
+                                     CRC32_INITIAL_VALUE);
+    block->valid = block->valid && !output->overflow && output->index == readLittleEndian32(trailer + 4) &&
+                   crc == readLittleEndian32(trailer);
+}
+
+/**
+ * @brief Run BGZF Round
+ *
+ * Worker loop: takes the blocks of the round one by one and decodes them, with decode tables of its own.
+ */
+static void* runBgzfRound(void* argument) {
+    BGZF_INFLATE* inflater = (BGZF_INFLATE*) argument;
+    INFLATE_CONTEXT* context = initINFLATE_CONTEXT();
+    STATUS* status = initSTATUS();
+    while (1) {
+        pthread_mutex_lock(&inflater->lock);
+        const size_t task = inflater->nextTask++;
+        pthread_mutex_unlock(&inflater->lock);
+        if (task >= inflater->blockCount) {
+            break;
+        }
+        if (context == NULL) {
+            inflater->blocks[task].valid = false;
+        } else {
+            inflateBgzfBlock(inflater->data, &inflater->blocks[task], context, status);
+        }
+    }
+    freeINFLATE_CONTEXT(context);
+    free(status->message);
+    free(status);
+    return NULL;
+}
+
+/**
+ * @brief Inflate BGZF Blocks
+ *
+ * Decodes the blocks of a BGZF file in rounds of threads * BGZF_BLOCKS_PER_THREAD blocks: the threads (the calling
+ * one included) decode the blocks of a round in any order, then they are written out in order.
+ *
+ * @param data The whole compressed file.
+ * @param blocks The blocks of the file (see scanBgzfBlocks).
+ * @param bw The output window.
+ * @param threads The number of threads.
+ * @param limits The caps on the file, checked after every round (a block is too small to pass one by itself).
+ * @param status Set to DECOMPRESS_FAILED or CANT_ALLOCATE_MEMORY on error, or to DECOMPRESS_LIMIT_EXCEEDED after a
+ * round passing a cap.
+ *
+ * Maximum memory required:
+ *  - threads * BGZF_BLOCKS_PER_THREAD * (BGZF_MAX_BLOCK_SIZE + 1) bytes of block output
+ */
+static void inflateBgzfBlocks(const BYTE* data, const SEEK_INDEX* blocks, BIT_WRITER* bw, const unsigned threads,
+                              const INFLATE_LIMITS* limits, STATUS* status) {
+    BGZF_INFLATE inflater;
+    inflater.data = data;
+    const size_t slots = (size_t) threads * BGZF_BLOCKS_PER_THREAD;
+    inflater.blocks = (BGZF_BLOCK*) calloc(slots, sizeof(BGZF_BLOCK));
+    pthread_t* workers = (pthread_t*) malloc(threads * sizeof(pthread_t));
+    bool allocated = inflater.blocks != NULL && workers != NULL;
+    for (size_t i = 0; allocated && i < slots; i++) {
+        inflater.blocks[i].output = initWindowBIT_WRITER(0, BGZF_MAX_BLOCK_SIZE + 1);
+        allocated = inflater.blocks[i].output != NULL;
+        if (allocated) inflater.blocks[i].output->computeCRC = false;
+    }
+    if (!allocated) {
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the blocks!");
+    }
+    pthread_mutex_init(&inflater.lock, NULL);
+
+    // The fixed trees and the CRC table are built on first use, which must not happen on several threads at once
+    getFixedLiteralTree();
+    getFixedDistanceTree();
+    calculate_crc32(CRC32_INITIAL_VALUE, NULL, 0);
+
+    const double startTime = limits->maxSeconds > 0 ? cpuSeconds(true) : 0;
+    uint64_t produced = 0;
+    for (size_t first = 0; allocated && status->code == DECOMPRESS_SUCCESS && first < blocks->count; first += slots) {
+        inflater.blockCount = blocks->count - first < slots ? blocks->count - first : slots;
+        for (size_t i = 0; i < inflater.blockCount; i++) {
+            const uint64_t end = first + i + 1 < blocks->count ? blocks->points[first + i + 1].compressedOffset : blocks->indexOffset;
+            inflater.blocks[i].offset = blocks->points[first + i].compressedOffset;
+            inflater.blocks[i].size = (size_t) (end - inflater.blocks[i].offset);
+        }
+        inflater.nextTask = 0;
+        unsigned started = 0;
+        for (unsigned t = 1; t < threads; t++) {
+            if (pthread_create(&workers[started], NULL, runBgzfRound, &inflater) == 0) {
+                started++;
             }
         }
-        printf("block count: %llu\n",blockCount);
-        if (BFINAL == 0b01) printf("final block\n");
-        // Cleanup
-        free(cl_canonical_codes);
-        free(T_LL_Tree);
-        free(T_CL_Tree);
-        free(T_D_Tree);
-        free(all_lengths);
-        free(distanceCanonicalCodes);
-        free(distanceNextCode);
-        free(ll_canonical_codes); // Don't forget this one
-    } while (BFINAL != 0b1);
-    printf("Kilépve\n");
+        runBgzfRound(&inflater);
+        for (unsigned t = 0; t < started; t++) {
+            pthread_join(workers[t], NULL);
+        }
 
-    freeBIT_READER(reader);
-    freeBIT_WRITER(bw);
+        for (size_t i = 0; i < inflater.blockCount; i++) {
+            if (!inflater.blocks[i].valid) {
+                status->code = DECOMPRESS_FAILED;
+                createSTATUSMessage(status, "Found a corrupt BGZF block!");
+                break;
+            }
+            writeBytes(bw, inflater.blocks[i].output->buffer, inflater.blocks[i].output->index);
+            produced += inflater.blocks[i].output->index;
+        }
+        const BGZF_BLOCK* lastBlock = &inflater.blocks[inflater.blockCount - 1];
+        if (status->code == DECOMPRESS_SUCCESS) {
+            exceedsInflateLimits(limits, lastBlock->offset + lastBlock->size, produced, startTime, true, status);
+        }
+    }
+
+    pthread_mutex_destroy(&inflater.lock);
+    for (size_t i = 0; inflater.blocks != NULL && i < slots; i++) {
+        if (inflater.blocks[i].output != NULL) freeBIT_WRITER(inflater.blocks[i].output);
+    }
+    free(inflater.blocks);
+    free(workers);
+}
+
+/**
+ * @brief Inflate File Parallel
+ *
+ * The body of decompressParallel and verifyParallel.
+ *
+ * Decompresses a single stream (e.g. one large gzip member, made by any compressor) with several threads. Every thread
+ * guesses a block boundary in its own part of the file by searching for a valid dynamic block header, and decodes from
+ * there without knowing the data before it: back-references into the unknown window become markers, which are
+ * replaced once the window is known. A guess which isn't a real block boundary either fails to decode or is never
+ * reached by the chunk before it, so it is dropped. The checksum in the trailer is checked as always. The chunks of a
+ * seekable gzip file (see compressSeekable) start at the full flush points of its index instead of guessing. A BGZF
+ * file (see compressBgzf) is decoded block by block, every block on any thread.
+ *
+ * Small files (less than two chunks), files which can't be mapped (see mapWholeFile) and a single thread use the serial
+ * decompress (or verify).
+ *
+ * @param filename The file to decompress.
+ * @param format The container of the file.
+ * @param threads The number of threads.
+ * @param verifyOnly Whether the output is only checked against the trailers instead of written to a file.
+ * @param limits The caps on the file, NULL for none.
+ *
+ * @returns STATUS* The result of the decompression. Must be freed.
+ *
+ * Maximum memory required:
+ *  - the compressed file, mapped read-only (see mapWholeFile), plus
+ *  - threads * about 2 * (PARALLEL_INFLATE_MAX_OUTPUT + WINDOW_SIZE) bytes of chunk output
+ */
+static STATUS* inflateFileParallel(const char* filename, const CONTAINER_FORMAT format, const unsigned threads,
+                                   const bool verifyOnly, const INFLATE_LIMITS* limits) {
+    if (threads <= 1) {
+        return inflateFileAlone(filename, format, verifyOnly, limits);
+    }
+
+    // Without a mapping (e.g. a pipe or an empty file) the serial path reads the input as a stream
+    size_t size = 0;
+    const BYTE* data = mapWholeFile(filename, &size);
+    if (data == NULL) {
+        return inflateFileAlone(filename, format, verifyOnly, limits);
+    }
+    SEEK_INDEX* bgzfBlocks = format == CONTAINER_GZIP ? scanBgzfBlocks(data, size) : NULL;
+    if (bgzfBlocks == NULL && size < 2 * (size_t) PARALLEL_INFLATE_CHUNK_SIZE) {
+        unmapWholeFile(data, size);
+        return inflateFileAlone(filename, format, verifyOnly, limits);
+    }
+
+    STATUS* status = initSTATUS();
+    status->code = DECOMPRESS_SUCCESS;
+    createSTATUSMessage(status, verifyOnly ? "Verification succeeded!" : "Decompression succeeded!");
+
+    INFLATE_LIMITS fileLimits;
+    copyInflateLimits(&fileLimits, limits);
+    if (bgzfBlocks != NULL) {
+        BIT_WRITER* bw = openOutput(filename, format, verifyOnly);
+        if (bw == NULL) {
+            status->code = CANT_OPEN_FILE;
+            createSTATUSMessage(status, "Can\'t open output file!");
+        } else {
+            bw->computeCRC = false; // Every block is checked against its own trailer
+            inflateBgzfBlocks(data, bgzfBlocks, bw, threads, &fileLimits, status);
+            closeOutput(bw, status);
+        }
+        freeSEEK_INDEX(bgzfBlocks);
+        unmapWholeFile(data, size);
+        return status;
+    }
+
+    BIT_READER reader;
+    init_memory_bit_reader(&reader, data, size, 0);
+    if ((format == CONTAINER_GZIP && !process_gzip_header(&reader)) ||
+        (format == CONTAINER_ZLIB && !process_zlib_header(&reader))) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, format == CONTAINER_GZIP ? "Invalid GZIP header!" : "Invalid ZLIB header!");
+        unmapWholeFile(data, size);
+        return status;
+    }
 
+    BIT_WRITER* bw = openOutput(filename, format, verifyOnly);
+    PARALLEL_INFLATE* inflater = initPARALLEL_INFLATE(data, size, threads);
+    if (bw == NULL || inflater == NULL) {
+        status->code = bw == NULL ? CANT_OPEN_FILE : CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, bw == NULL ? "Can\'t open output file!" : "Can\'t allocate memory for the chunks!");
+        if (bw != NULL) closeOutput(bw, status);
+        freePARALLEL_INFLATE(inflater);
+        unmapWholeFile(data, size);
+        return status;
+    }
+
+    // The fixed trees are built on first use, which must not happen on several threads at once
+    getFixedLiteralTree();
+    getFixedDistanceTree();
+    SEEK_INDEX* seekIndex = format == CONTAINER_GZIP ? readSeekIndex(data, size) : NULL;
+    inflater->seekIndex = seekIndex;
+    inflater->limits = fileLimits;
+    for (unsigned t = 0; t < inflater->chunkCount; t++) {
+        inflater->chunks[t].context->limits = fileLimits;
+    }
+    inflater->startTime = fileLimits.maxSeconds > 0 ? cpuSeconds(true) : 0;
+
+    bool nextMember;
+    do {
+        nextMember = false;
+        uint64_t bit = bit_reader_position(&reader);
+        if (inflateMemberParallel(inflater, &bit, bw, status)) {
+            init_memory_bit_reader(&reader, data, size, bit);
+            verifyTrailer(&reader, bw, format, status);
+        }
+        if (status->code == DECOMPRESS_SUCCESS && format == CONTAINER_GZIP && !at_end_of_gzip_members(&reader)) {
+            if (!process_gzip_header(&reader)) {
+                status->code = DECOMPRESS_FAILED;
+                createSTATUSMessage(status, "Invalid GZIP header after the end of a member!");
+                break;
+            }
+            bw->crc32 = CRC32_INITIAL_VALUE;
+            bw->totalBytes = 0;
+            startOutputStream(bw);
+            nextMember = true;
+        }
+    } while (nextMember);
+
+    freePARALLEL_INFLATE(inflater);
+    freeSEEK_INDEX(seekIndex);
+    closeOutput(bw, status);
+    unmapWholeFile(data, size);
     return status;
 }
+
+/**
+ * @brief Decompress Parallel
+ *
+ * Decompresses a file with several threads (see inflateFileParallel).
+ *
+ * @param filename The file to decompress.
+ * @param format The container of the file.
+ * @param threads The number of threads.
+ * @param limits The caps on the file, NULL for none.
+ *
+ * @returns STATUS* The result of the decompression. Must be freed.
+ */
+extern STATUS* decompressParallel(const char* filename, const CONTAINER_FORMAT format, const unsigned threads,
+                                  const INFLATE_LIMITS* limits) {
+    return inflateFileParallel(filename, format, threads, false, limits);
+}
+
+/**
+ * @brief Verify Parallel
+ *
+ * Checks the integrity of a file (see verifyWithContext) with several threads (see inflateFileParallel).
+ *
+ * @param filename The file to check.
+ * @param format The container of the file.
+ * @param threads The number of threads.
+ * @param limits The caps on the file, NULL for none.
+ *
+ * @returns STATUS* DECOMPRESS_SUCCESS if the file is intact. Must be freed.
+ */
+extern STATUS* verifyParallel(const char* filename, const CONTAINER_FORMAT format, const unsigned threads,
+                              const INFLATE_LIMITS* limits) {
+    return inflateFileParallel(filename, format, threads, true, limits);
+}
+
+/**
+ * @brief Inflate Buffer
+ *
+ * Decodes a complete raw deflate stream held in memory (e.g. a window stored in an index) into memory.
+ *
+ * @param data The raw deflate stream.
+ * @param size The size of the stream.
+ * @param output The memory receiving the decoded bytes.
+ * @param capacity The size of output.
+ * @param produced Output: the number of decoded bytes.
+ *
+ * @returns bool false if the stream is corrupt, truncated or decodes to more than capacity bytes.
+ */
+extern bool inflateBuffer(const uint8_t* data, const size_t size, uint8_t* output, const size_t capacity, size_t* produced) {
+    INFLATE_CHUNK* chunk = (INFLATE_CHUNK*) calloc(1, sizeof(INFLATE_CHUNK));
+    if (chunk == NULL) {
+        return false;
+    }
+    chunk->capacity = WINDOW_SIZE + capacity + 258;
+    chunk->output = (uint16_t*) malloc(chunk->capacity * sizeof(uint16_t));
+    chunk->context = initINFLATE_CONTEXT();
+    bool valid = chunk->output != NULL && chunk->context != NULL;
+    if (valid) {
+        chunk->size = WINDOW_SIZE;
+        init_memory_bit_reader(&chunk->reader, data, size, 0);
+        bool final = false;
+        while (valid && !final) {
+            valid = inflateChunkBlock(chunk, false, &final);
+        }
+        valid = valid && chunk->size - WINDOW_SIZE <= capacity;
+    }
+    if (valid) {
+        *produced = chunk->size - WINDOW_SIZE;
+        for (size_t i = 0; i < *produced; i++) {
+            output[i] = (uint8_t) chunk->output[WINDOW_SIZE + i];
+        }
+    }
+    free(chunk->output);
+    freeINFLATE_CONTEXT(chunk->context);
+    free(chunk);
+    return valid;
+}
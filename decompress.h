@@ -4,5 +4,96 @@
 
 #ifndef DEFLATE_DECOMPRESS_H
 #define DEFLATE_DECOMPRESS_H
-extern STATUS* decompress(const char* filename);
-#endif //DEFLATE_DECOMPRESS_H
\ No newline at end of file
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitwriter.h"
+#include "container.h"
+#include "HUFFMAN_TABLE.h"
+#include "status.h"
+
+#define INFLATE_CL_SYMBOLS 19 // Symbols of the code length alphabet (0-18)
+#define INFLATE_MAX_LENGTHS (286 + 32) // HLIT + HDIST code lengths of a dynamic block header at most
+
+#define INFLATE_TABLE_CACHE_SIZE 4 // Recently built dynamic block tables kept by an INFLATE_CONTEXT
+#define INFLATE_CHECK_INTERVAL (1024 * 1024) // Output bytes between two checks of the limits and of a truncated input
+
+/**
+ * @brief Caps on decompressing one file, for untrusted input (see INFLATE_CONTEXT.limits). A cap of 0 is no cap.
+ *
+ * Exceeding any of them stops the decoder with DECOMPRESS_LIMIT_EXCEEDED. They are checked every
+ * INFLATE_CHECK_INTERVAL bytes of output, so the output may pass maxOutput by less than that before the decoder stops.
+ */
+typedef struct {
+    uint64_t maxOutput;     ///< Decompressed bytes of one file.
+    uint32_t maxRatio;      ///< Decompressed bytes per compressed byte, once the output passed INFLATE_CHECK_INTERVAL.
+    double maxSeconds;      ///< CPU seconds spent on one file.
+} INFLATE_LIMITS;
+
+/**
+ * @brief The decode tables built from one dynamic block header.
+ *
+ * Encoders often emit runs of blocks with the very same code lengths, so the tables are cached together with the
+ * header they were built from, and a repeated header skips the table construction.
+ */
+typedef struct {
+    bool valid;                                 ///< Whether the entry holds tables at all.
+    uint32_t hash;                              ///< Hash of HLIT, HDIST and the raw code lengths.
+    uint32_t lastUse;                           ///< Block counter value of the last hit, for LRU eviction.
+    uint16_t HLIT;                              ///< Number of literal/length code lengths.
+    uint16_t HDIST;                             ///< Number of distance code lengths.
+    uint8_t lengths[INFLATE_MAX_LENGTHS];       ///< The raw code lengths, to rule out hash collisions.
+    HuffmanTree literalTree;                    ///< T_LL built from the lengths.
+    HuffmanTree distanceTree;                   ///< T_D built from the lengths.
+    MultiLiteralEntry multiLiteralTable[MULTI_SIZE]; ///< Two literals per lookup, filled only if profitable.
+    bool useMultiLiteralTable;                  ///< Whether multiLiteralTable is filled.
+} INFLATE_TABLES;
+
+/**
+ * @brief Everything the decoder needs per block, allocated once per stream.
+ *
+ * A dynamic block header only refills these tables, so a stream made of many small blocks causes no allocator
+ * traffic. The same context can be reused for any number of streams.
+ */
+typedef struct {
+    HuffmanTree codeLengthTree;                 ///< T_CL, decodes the code lengths of the other two trees.
+    uint8_t cl_lengths[INFLATE_CL_SYMBOLS];     ///< Code lengths of the code length alphabet.
+    uint8_t all_lengths[INFLATE_MAX_LENGTHS];   ///< HLIT literal/length then HDIST distance code lengths.
+    INFLATE_TABLES tableCache[INFLATE_TABLE_CACHE_SIZE]; ///< Tables of the recently seen dynamic block headers.
+    INFLATE_TABLES* tables;                     ///< The tables of the current dynamic block (points into tableCache).
+    uint32_t blockCounter;                      ///< Number of dynamic blocks seen, the clock of the LRU cache.
+    INFLATE_LIMITS limits;                      ///< Caps on every file decoded with the context, set by its owner.
+    int64_t checkInterval;                      ///< Output bytes between two checks, INFLATE_CHECK_INTERVAL or less.
+    int64_t checkCountdown;                     ///< Output bytes (and block costs) left until the next check.
+    uint64_t produced;                          ///< Output of the current file up to the last check.
+    double startTime;                           ///< CPU time the current file started at, if limits.maxSeconds is set.
+} INFLATE_CONTEXT;
+
+extern INFLATE_CONTEXT* initINFLATE_CONTEXT(void);
+
+extern void freeINFLATE_CONTEXT(INFLATE_CONTEXT* context);
+
+extern STATUS* decompressWithContext(INFLATE_CONTEXT* context, const char* filename, CONTAINER_FORMAT format);
+
+extern STATUS* decompress(const char* filename, CONTAINER_FORMAT format);
+
+extern STATUS* decompressParallel(const char* filename, CONTAINER_FORMAT format, unsigned threads,
+                                  const INFLATE_LIMITS* limits);
+
+extern STATUS* verifyWithContext(INFLATE_CONTEXT* context, const char* filename, CONTAINER_FORMAT format);
+
+extern STATUS* verify(const char* filename, CONTAINER_FORMAT format);
+
+extern STATUS* verifyParallel(const char* filename, CONTAINER_FORMAT format, unsigned threads,
+                              const INFLATE_LIMITS* limits);
+
+extern STATUS* scanWithContext(INFLATE_CONTEXT* context, const char* filename, CONTAINER_FORMAT format,
+                               OUTPUT_SINK sink, void* sinkContext);
+
+extern bool inflateBlock(BIT_READER* reader, BIT_WRITER* bw, INFLATE_CONTEXT* context, bool* final, STATUS* status);
+
+extern void verifyTrailer(BIT_READER* reader, BIT_WRITER* bw, CONTAINER_FORMAT format, STATUS* status);
+
+extern bool inflateBuffer(const uint8_t* data, size_t size, uint8_t* output, size_t capacity, size_t* produced);
+#endif //DEFLATE_DECOMPRESS_H
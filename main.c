@@ -1,7 +1,15 @@
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "bgzf.h"
 #include "compress.h"
 #include "decompress.h"
+#include "random_access.h"
+#include "search.h"
+#include "seekable.h"
 #include "status.h"
 
 #define LIB_NAME        "Deflate"
@@ -35,14 +43,59 @@ static void printHelp(void)
         "Usage:\n"
         "  program help | -h      Show this help message\n"
         "  program version | -v   Show version information\n"
-        "  program compress | -c <file>\n"
-        "                        Compress the given file\n"
-        "  program decompress | -d <file>\n"
-        "                        Decompress the given file\n"
+        "  program compress | -c [options] <file|directory>...\n"
+        "                        Compress the given files, directories recursively\n"
+        "  program decompress | -d [options] <file|directory>...\n"
+        "                        Decompress the given files, directories recursively\n"
+        "  program test | -t [options] <file|directory>...\n"
+        "                        Decode the given files and check their checksums without writing anything\n"
+        "  program index [options] <file>\n"
+        "                        Save an index of access points next to a compressed file (<file>.idx),\n"
+        "                        or the block index of a BGZF file (<file>.gzi)\n"
+        "  program extract [options] <file> <offset> <length>\n"
+        "                        Write bytes [offset, offset + length) of the decompressed data to stdout,\n"
+        "                        decoding from the nearest access point (the index is built if missing)\n"
+        "  program search [options] <pattern> <file|directory>...\n"
+        "                        Print the lines of the decompressed data holding the pattern (or any -e pattern)\n"
+        "                        with their offsets, searched while decoding, nothing is written\n"
+        "\n"
+        "Options:\n"
+        "  --gzip                gzip container, .gz (default)\n"
+        "  --zlib                zlib container, .zz\n"
+        "  --raw                 raw deflate stream without header and checksum, .deflate\n"
+        "  -j <threads>          one file: compress with several threads into one stream,\n"
+        "                        several files: process that many files at once (default 1)\n"
+        "                        with -d, one file is decoded from several guessed blocks at once\n"
+        "  --chunk-size <size>   input chunk per thread with -j, e.g. 128K or 1M (default 256K)\n"
+        "  --independent         with -j, every chunk becomes a gzip member of its own\n"
+        "  --pipeline            read, match and entropy code on separate threads, with -j\n"
+        "                        the blocks are entropy coded by that many threads\n"
+        "  --seekable            gzip with a full flush every 1M of input and an index of the\n"
+        "                        flush points at the end, still readable by any gzip\n"
+        "  --flush-every <size>  input between two full flushes of --seekable (implies it)\n"
+        "  --bgzf                BGZF (blocked gzip of samtools): 64K gzip members carrying their\n"
+        "                        size, compressed and with -d decoded on -j threads\n"
+        "  --span <size>         output between two access points of an index (default 1M)\n"
+        "  --max-output <size>   with -d or -t, stop a file decompressing to more than that, e.g. 10G\n"
+        "  --max-ratio <n>       with -d or -t, stop a file expanding more than n times\n"
+        "  --max-time <seconds>  with -d or -t, stop a file taking more CPU time than that\n"
+        "  -e <pattern>          with search, a literal pattern to look for, may be given several times\n"
         "\n"
         "Examples:\n"
         "  program -c input.txt\n"
+        "  program -c --zlib input.txt\n"
+        "  program -c -j 8 dump.sql\n"
+        "  program -c -j 8 --independent dump.sql\n"
+        "  program -c -j 8 --seekable --flush-every 4M dump.sql\n"
+        "  program -c -j 8 --bgzf reads.sam\n"
         "  program decompress archive.gz\n"
+        "  program -d -j 8 dump.sql.gz\n"
+        "  program -t -j 8 archives/\n"
+        "  program -d --max-output 1G --max-ratio 100 upload.gz\n"
+        "  program -c -j 8 logs/ notes.txt\n"
+        "  program index --span 4M server.log.gz\n"
+        "  program extract server.log.gz 1500M 64K > part.log\n"
+        "  program search -e ERROR -e FATAL logs/\n"
         "\n"
         "Note:\n"
         "  - All commands require valid file paths where appropriate.\n"
@@ -50,9 +103,148 @@ static void printHelp(void)
     );
 }
 
+/**
+ * @brief The options given between the command and the file name.
+ */
+typedef struct {
+    CONTAINER_FORMAT format;
+    unsigned threads;
+    size_t chunkSize;
+    bool independent;
+    bool pipeline;
+    size_t span;
+    bool seekable;
+    size_t flushInterval;
+    bool bgzf;
+    INFLATE_LIMITS limits;
+    const char** patterns;  ///< The -e patterns of search, room for one per argument.
+    size_t patternCount;
+} OPTIONS;
+
+/**
+ * @brief Parses a size with an optional K, M or G suffix (e.g. 128K).
+ *
+ * @returns bool false if the text is not a size.
+ */
+static bool parseSize(const char* text, size_t* size) {
+    char* end = NULL;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) {
+        return false;
+    }
+    if (*end == 'K' || *end == 'k') {
+        *size = (size_t) value * 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        *size = (size_t) value * 1024 * 1024;
+        end++;
+    } else if (*end == 'G' || *end == 'g') {
+        *size = (size_t) value * 1024 * 1024 * 1024;
+        end++;
+    } else {
+        *size = (size_t) value;
+    }
+    return *end == '\0';
+}
+
+/**
+ * @brief Whether an argument is an option rather than a path: anything starting with '-', except "-" itself.
+ */
+static bool isOption(const char* argument) {
+    return argument[0] == '-' && argument[1] != '\0';
+}
+
+/**
+ * @brief Parses the option at argv[*i], advancing *i past its value if it has one.
+ *
+ * @returns bool false if the option is unknown or its value is missing or invalid.
+ */
+static bool parseOption(const int argc, char** argv, int* i, OPTIONS* options) {
+    const char* option = argv[*i];
+    if (strcmp(option, "--gzip") == 0) {
+        options->format = CONTAINER_GZIP;
+    } else if (strcmp(option, "--zlib") == 0) {
+        options->format = CONTAINER_ZLIB;
+    } else if (strcmp(option, "--raw") == 0) {
+        options->format = CONTAINER_RAW;
+    } else if (strcmp(option, "--independent") == 0) {
+        options->independent = true;
+    } else if (strcmp(option, "--pipeline") == 0) {
+        options->pipeline = true;
+    } else if (strcmp(option, "--seekable") == 0) {
+        options->seekable = true;
+    } else if (strcmp(option, "--bgzf") == 0) {
+        options->bgzf = true;
+    } else if (strcmp(option, "-e") == 0) {
+        // A match never spans two lines, so a pattern can't hold a newline
+        if (*i + 1 >= argc || options->patterns == NULL || argv[*i + 1][0] == '\0' || strchr(argv[*i + 1], '\n') != NULL) {
+            return false;
+        }
+        options->patterns[options->patternCount++] = argv[++*i];
+    } else if (strcmp(option, "--max-time") == 0) {
+        if (*i + 1 >= argc) {
+            return false;
+        }
+        char* end = NULL;
+        options->limits.maxSeconds = strtod(argv[++*i], &end);
+        return end != argv[*i] && *end == '\0' && options->limits.maxSeconds > 0;
+    } else if (strcmp(option, "-j") == 0 || strcmp(option, "--chunk-size") == 0 || strcmp(option, "--span") == 0 ||
+               strcmp(option, "--flush-every") == 0 || strcmp(option, "--max-output") == 0 ||
+               strcmp(option, "--max-ratio") == 0) {
+        if (*i + 1 >= argc) {
+            return false;
+        }
+        size_t value = 0;
+        if (!parseSize(argv[++*i], &value) || value == 0) {
+            return false;
+        }
+        if (option[1] == 'j') {
+            options->threads = value > COMPRESS_MAX_THREADS ? COMPRESS_MAX_THREADS : (unsigned) value;
+        } else if (strcmp(option, "--span") == 0) {
+            options->span = value;
+        } else if (strcmp(option, "--flush-every") == 0) {
+            options->seekable = true;
+            options->flushInterval = value;
+        } else if (strcmp(option, "--max-output") == 0) {
+            options->limits.maxOutput = value;
+        } else if (strcmp(option, "--max-ratio") == 0) {
+            options->limits.maxRatio = value > UINT32_MAX ? UINT32_MAX : (uint32_t) value;
+        } else {
+            options->chunkSize = value;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Collects the files of the given paths (directories recursively) and processes them with processBatch.
+ */
+static STATUS* runBatch(char** paths, const int pathCount, const BATCH_MODE mode, const OPTIONS options) {
+    BATCH_LIST* list = initBATCH_LIST();
+    bool collected = list != NULL;
+    for (int i = 0; collected && i < pathCount; i++) {
+        collected = addBatchPath(list, paths[i], mode == BATCH_COMPRESS, options.format);
+    }
+    if (!collected) {
+        freeBATCH_LIST(list);
+        STATUS* status = initSTATUS();
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the file list!");
+        return status;
+    }
+    const BATCH_COMPRESSION compression = {options.bgzf, options.seekable, options.independent, options.pipeline,
+                                           options.chunkSize, options.flushInterval};
+    STATUS* status = processBatch(list, mode, options.format, &compression, &options.limits, options.threads);
+    freeBATCH_LIST(list);
+    return status;
+}
+
 extern int main(const int argc, char** argv) {
     if (argc == 1) {
         printVersion();
+        return 0;
     }
     if (argc == 2) {
         if (strcmp(argv[1], "help") == 0 || strcmp(argv[1], "-h") == 0) {
@@ -65,21 +257,125 @@ extern int main(const int argc, char** argv) {
         }
     }
     STATUS* status = NULL;
+    FILE* messages = stdout;
     if (strcmp(argv[1], "compress") == 0 || strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "decompress") == 0 ||
-        strcmp(argv[1], "-d") == 0) {
+        strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "test") == 0 || strcmp(argv[1], "-t") == 0 ||
+        strcmp(argv[1], "index") == 0 || strcmp(argv[1], "extract") == 0 || strcmp(argv[1], "search") == 0) {
         if (argc == 2) {
             printf("Not enough arguments.\n Please read the provided help before using the program.\n\n");
             printHelp();
-        } else if (argc == 3) {
-            if (strcmp(argv[1],"compress")==0 || strcmp(argv[1], "-c") == 0) {
-                status = compress(argv[2]);
-            } else if (strcmp(argv[1],"decompress")==0 || strcmp(argv[1], "-d") == 0) {
-                status = decompress(argv[2]);
+        } else {
+            // Options and paths may be mixed, "--" ends the options
+            OPTIONS options = {CONTAINER_GZIP, 1, COMPRESS_DEFAULT_CHUNK_SIZE, false, false, ACCESS_DEFAULT_SPAN, false,
+                               SEEKABLE_DEFAULT_INTERVAL, false, {0, 0, 0}, NULL, 0};
+            options.patterns = (const char**) malloc(argc * sizeof(char*));
+            char** paths = (char**) malloc(argc * sizeof(char*));
+            int pathCount = 0;
+            bool optionsEnded = false;
+            for (int i = 2; paths != NULL && i < argc; i++) {
+                if (!optionsEnded && strcmp(argv[i], "--") == 0) {
+                    optionsEnded = true;
+                } else if (!optionsEnded && isOption(argv[i])) {
+                    if (!parseOption(argc, argv, &i, &options)) {
+                        printf("Invalid option: %s\n Please read the provided help before using the program.\n\n", argv[i]);
+                        printHelp();
+                        free(options.patterns);
+                        free(paths);
+                        return 1;
+                    }
+                } else {
+                    paths[pathCount++] = argv[i];
+                }
+            }
+            if (paths == NULL || pathCount == 0) {
+                printf("Not enough arguments.\n Please read the provided help before using the program.\n\n");
+                printHelp();
+                free(options.patterns);
+                free(paths);
+                return 1;
             }
+            if ((options.independent || options.seekable || options.bgzf) && options.format != CONTAINER_GZIP) {
+                printf(options.seekable ? "Only the gzip container can be seekable.\n\n"
+                       : options.bgzf ? "BGZF is a gzip container.\n\n"
+                       : "Only the gzip container can hold independent members.\n\n");
+                free(options.patterns);
+                free(paths);
+                return 1;
+            }
+
+            const bool compressing = strcmp(argv[1],"compress")==0 || strcmp(argv[1], "-c") == 0;
+            const bool verifying = strcmp(argv[1], "test") == 0 || strcmp(argv[1], "-t") == 0;
+            struct stat info;
+            size_t offset = 0;
+            size_t length = 0;
+            if (strcmp(argv[1], "index") == 0 && (options.bgzf || (options.format == CONTAINER_GZIP && isBgzfFile(paths[0])))) {
+                status = indexBgzfFile(paths[0]);
+            } else if (strcmp(argv[1], "index") == 0) {
+                status = indexFile(paths[0], options.format, options.span);
+            } else if (strcmp(argv[1], "extract") == 0) {
+                // The data goes to stdout, so the result is reported on stderr
+                messages = stderr;
+                if (pathCount != 3 || !parseSize(paths[1], &offset) || !parseSize(paths[2], &length)) {
+                    status = initSTATUS();
+                    status->code = DECOMPRESS_FAILED;
+                    createSTATUSMessage(status, "Usage: program extract [options] <file> <offset> <length>");
+                } else {
+                    status = extractRange(paths[0], options.format, offset, length, stdout);
+                }
+            } else if (strcmp(argv[1], "search") == 0) {
+                // The matching lines go to stdout, so the result is reported on stderr. Without -e the first path is
+                // the pattern, like grep.
+                messages = stderr;
+                char** files = paths;
+                int fileCount = pathCount;
+                if (options.patternCount == 0 && options.patterns != NULL && paths[0][0] != '\0' &&
+                    strchr(paths[0], '\n') == NULL) {
+                    options.patterns[options.patternCount++] = paths[0];
+                    files++;
+                    fileCount--;
+                }
+                if (options.patternCount == 0 || fileCount == 0) {
+                    status = initSTATUS();
+                    status->code = DECOMPRESS_FAILED;
+                    createSTATUSMessage(status, "Usage: program search [options] <pattern> <file|directory>...");
+                } else {
+                    status = searchPaths(options.patterns, options.patternCount, files, (size_t) fileCount,
+                                         options.format, &options.limits, stdout);
+                }
+            } else if (pathCount > 1 || (stat(paths[0], &info) == 0 && S_ISDIR(info.st_mode))) {
+                // Many files: -j runs that many files at once, every file is compressed on a single thread in the
+                // layout of the options
+                status = runBatch(paths, pathCount,
+                                  compressing ? BATCH_COMPRESS : verifying ? BATCH_VERIFY : BATCH_DECOMPRESS, options);
+            } else if (compressing && options.bgzf) {
+                status = compressBgzf(paths[0], options.threads);
+            } else if (compressing && options.seekable) {
+                status = compressSeekable(paths[0], options.threads, options.flushInterval);
+            } else if (compressing && options.independent) {
+                status = compressMembers(paths[0], options.threads, options.chunkSize);
+            } else if (compressing && options.pipeline) {
+                status = compressPipelined(paths[0], options.format, options.threads);
+            } else if (compressing) {
+                status = compressParallel(paths[0], options.format, options.threads, options.chunkSize);
+            } else if (verifying) {
+                status = verifyParallel(paths[0], options.format, options.threads, &options.limits);
+            } else {
+                status = decompressParallel(paths[0], options.format, options.threads, &options.limits);
+            }
+            free(options.patterns);
+            free(paths);
         }
     }
+    int exitCode = 0;
     if (status != NULL) {
+        if (status->message != NULL) {
+            fprintf(messages, "%s\n", status->message);
+            free(status->message);
+        }
+        if (status->code != COMPRESSION_SUCCESS && status->code != DECOMPRESS_SUCCESS) {
+            exitCode = 1;
+        }
         free(status);
     }
-    return 0;
+    return exitCode;
 }
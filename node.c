@@ -4,10 +4,13 @@
 
 #include "node.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#ifdef DEFLATE_DEBUGMALLOC
 #include "debugmalloc.h"
+#endif
 
 #define INVALID_NODE_SYMBOL 286
 
@@ -417,4 +420,28 @@ extern void flattenTree(uint8_t* lengths, int num_symbols, int max_depth) {
             break;
         }
     }
+
+    // 4. Demoting can free more than the overflow, leaving an incomplete code which inflaters (zlib) reject.
+    // Give the spare weight back by shortening the longest codes that still fit into it.
+    uint32_t current_weight = 0;
+    for (int i = 0; i < num_symbols; i++) {
+        if (lengths[i] > 0) {
+            current_weight += (1 << (max_depth - lengths[i]));
+        }
+    }
+    while (current_weight < max_capacity) {
+        int best_index = -1;
+        for (int i = 0; i < num_symbols; i++) {
+            // Shortening a code of length L adds (1 << (max_depth - L)) to the weight
+            if (lengths[i] > 1 && current_weight + (1u << (max_depth - lengths[i])) <= max_capacity &&
+                (best_index == -1 || lengths[i] > lengths[best_index])) {
+                best_index = i;
+            }
+        }
+        if (best_index == -1) {
+            break; // Fewer than 2 symbols, nothing to complete
+        }
+        current_weight += 1u << (max_depth - lengths[best_index]);
+        lengths[best_index]--;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,567 @@
+//
+// Created by Attila on 12/19/2025.
+//
+
+#include "random_access.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef DEFLATE_DEBUGMALLOC
+#include "debugmalloc.h"
+#endif
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "compress.h"
+#include "CRC_CHECKSUM.h"
+#include "ADLER_CHECKSUM.h"
+#include "bgzf.h"
+#include "decompress.h"
+#include "seekable.h"
+
+#define WINDOW_SIZE 32768
+#define ACCESS_OUTPUT_SIZE (1024 * 1024) // Output region of the window used while indexing and extracting
+#define ACCESS_INDEX_MAGIC "DFLTIDX1"    // First 8 bytes of a sidecar index
+#define ACCESS_INDEX_INITIAL_CAPACITY 64
+
+/**
+ * @brief Free ACCESS_INDEX
+ *
+ * @param index The index to free. NULL is allowed.
+ */
+extern void freeACCESS_INDEX(ACCESS_INDEX* index) {
+    if (index == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < index->count; i++) {
+        free(index->points[i].window);
+    }
+    free(index->points);
+    free(index);
+}
+
+/**
+ * @brief Index Path
+ *
+ * @returns char* The name of the sidecar index of a compressed file ("data.gz" -> "data.gz.idx") OR NULL. Must be freed.
+ */
+static char* indexPath(const char* filename) {
+    const size_t length = strlen(filename);
+    char* path = (char*) malloc(length + strlen(ACCESS_INDEX_EXTENSION) + 2);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, filename, length);
+    path[length] = '.';
+    strcpy(path + length + 1, ACCESS_INDEX_EXTENSION);
+    return path;
+}
+
+/**
+ * @brief Returns the size of a file in bytes, or UINT64_MAX if it can't be queried.
+ */
+static uint64_t fileSize(const char* filename) {
+    struct stat info;
+    return stat(filename, &info) == 0 ? (uint64_t) info.st_size : UINT64_MAX;
+}
+
+/**
+ * @brief Add Access Point
+ *
+ * Appends an access point, its window compressed into a raw deflate stream.
+ *
+ * @returns bool false if the memory can't be allocated.
+ */
+static bool addAccessPoint(ACCESS_INDEX* index, COMPRESS_CONTEXT* compressor, BIT_WRITER* sink, const uint64_t outputOffset,
+                           const uint64_t bitOffset, const uint8_t* window, const uint32_t windowLength) {
+    if (index->count == index->capacity) {
+        const size_t capacity = index->capacity == 0 ? ACCESS_INDEX_INITIAL_CAPACITY : index->capacity * 2;
+        ACCESS_POINT* points = (ACCESS_POINT*) realloc(index->points, capacity * sizeof(ACCESS_POINT));
+        if (points == NULL) {
+            return false;
+        }
+        index->points = points;
+        index->capacity = capacity;
+    }
+
+    resetMemoryBIT_WRITER(sink);
+    compressBuffer(compressor, window, windowLength, sink);
+    ACCESS_POINT* point = &index->points[index->count];
+    point->window = (uint8_t*) malloc(sink->index > 0 ? sink->index : 1);
+    if (point->window == NULL) {
+        return false;
+    }
+    memcpy(point->window, sink->buffer, sink->index);
+    point->outputOffset = outputOffset;
+    point->bitOffset = bitOffset;
+    point->windowLength = windowLength;
+    point->compressedLength = (uint32_t) sink->index;
+    point->memberStart = false;
+    index->count++;
+    return true;
+}
+
+/**
+ * @brief Build Access Index
+ *
+ * Decompresses a whole file (without writing it anywhere) and records an access point at the first block boundary
+ * after every 'span' bytes of output: the bit offset of the block, its offset in the output and the 32 KB of output
+ * before it, which is all the decoder needs to start there. The checksums of the file are verified on the way.
+ *
+ * @param filename The compressed file.
+ * @param format The container of the file.
+ * @param span Output bytes between two access points (at least 1).
+ * @param result Output: the index OR NULL on error. Must be freed with freeACCESS_INDEX.
+ *
+ * @returns STATUS* The result of the indexing. Must be freed.
+ *
+ * Maximum memory required:
+ *  - the access points: about 32 + (compressed window, at most 33 KB) bytes per 'span' bytes of output, plus
+ *  - an INFLATE_CONTEXT, a COMPRESS_CONTEXT and WINDOW_SIZE + ACCESS_OUTPUT_SIZE bytes of output window
+ */
+extern STATUS* buildAccessIndex(const char* filename, const CONTAINER_FORMAT format, const uint64_t span,
+                                ACCESS_INDEX** result) {
+    *result = NULL;
+    STATUS* status = initSTATUS();
+    status->code = DECOMPRESS_SUCCESS;
+    createSTATUSMessage(status, "Index built!");
+
+    BIT_READER* reader = init_bit_reader(filename);
+    if (reader == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open input file!");
+        return status;
+    }
+    if ((format == CONTAINER_GZIP && !process_gzip_header(reader)) ||
+        (format == CONTAINER_ZLIB && !process_zlib_header(reader))) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, format == CONTAINER_GZIP ? "Invalid GZIP header!" : "Invalid ZLIB header!");
+        freeBIT_READER(reader);
+        return status;
+    }
+
+    ACCESS_INDEX* index = (ACCESS_INDEX*) calloc(1, sizeof(ACCESS_INDEX));
+    BIT_WRITER* bw = initWindowBIT_WRITER(WINDOW_SIZE, ACCESS_OUTPUT_SIZE);
+    BIT_WRITER* sink = initMemoryBIT_WRITER(WINDOW_SIZE);
+    INFLATE_CONTEXT* context = initINFLATE_CONTEXT();
+    COMPRESS_CONTEXT* compressor = initCOMPRESS_CONTEXT();
+    bool valid = index != NULL && bw != NULL && sink != NULL && context != NULL && compressor != NULL;
+    if (!valid) {
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the index!");
+    } else {
+        index->format = format;
+        index->span = span > 0 ? span : 1;
+        index->compressedSize = fileSize(filename);
+        bw->computeCRC = format == CONTAINER_GZIP;
+        bw->computeAdler32 = format == CONTAINER_ZLIB;
+    }
+
+    // Output offsets run on across gzip members, while the size and CRC of the window restart with every member
+    uint64_t memberStart = 0;
+    bool nextMember = valid;
+    while (nextMember) {
+        nextMember = false;
+        bool final = false;
+        while (valid && !final) {
+            const uint64_t output = memberStart + bw->totalBytes + (bw->index - bw->historySize);
+            if (index->count == 0 || output - index->points[index->count - 1].outputOffset >= index->span) {
+                const uint32_t windowLength = output < WINDOW_SIZE ? (uint32_t) output : WINDOW_SIZE;
+                valid = addAccessPoint(index, compressor, sink, output, bit_reader_position(reader),
+                                       bw->buffer + bw->index - windowLength, windowLength);
+                if (!valid) {
+                    status->code = CANT_ALLOCATE_MEMORY;
+                    createSTATUSMessage(status, "Can\'t allocate memory for the index!");
+                    break;
+                }
+            }
+            valid = inflateBlock(reader, bw, context, &final, status);
+        }
+        if (!valid) {
+            break;
+        }
+        verifyTrailer(reader, bw, format, status);
+        if (status->code == DECOMPRESS_SUCCESS && format == CONTAINER_GZIP && !at_end_of_gzip_members(reader)) {
+            if (!process_gzip_header(reader)) {
+                status->code = DECOMPRESS_FAILED;
+                createSTATUSMessage(status, "Invalid GZIP header after the end of a member!");
+                break;
+            }
+            memberStart += bw->totalBytes;
+            bw->crc32 = CRC32_INITIAL_VALUE;
+            bw->totalBytes = 0;
+            startOutputStream(bw);
+            nextMember = true;
+        }
+    }
+
+    if (status->code == DECOMPRESS_SUCCESS) {
+        index->totalOutput = memberStart + bw->totalBytes;
+        *result = index;
+    } else {
+        freeACCESS_INDEX(index);
+    }
+    freeCOMPRESS_CONTEXT(compressor);
+    freeINFLATE_CONTEXT(context);
+    if (sink != NULL) freeBIT_WRITER(sink);
+    if (bw != NULL) freeBIT_WRITER(bw);
+    freeBIT_READER(reader);
+    return status;
+}
+
+/**
+ * @brief Writes a value as 'bytes' little endian bytes.
+ */
+static void writeLittleEndian(FILE* file, const uint64_t value, const int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        fputc((int) (value >> (8 * i)) & 0xFF, file);
+    }
+}
+
+/**
+ * @brief Reads a value of 'bytes' little endian bytes.
+ *
+ * @returns bool false at the end of the file.
+ */
+static bool readLittleEndian(FILE* file, uint64_t* value, const int bytes) {
+    *value = 0;
+    for (int i = 0; i < bytes; i++) {
+        const int byte = fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+        *value |= (uint64_t) byte << (8 * i);
+    }
+    return true;
+}
+
+/**
+ * @brief Save Access Index
+ *
+ * Writes the index next to the compressed file (see ACCESS_INDEX_EXTENSION). All numbers are little endian:
+ *  - "DFLTIDX1", format (4 bytes), span, size of the compressed file, size of the output, number of points (8 bytes each)
+ *  - per point: output offset, bit offset (8 bytes each), window length, compressed window length (4 bytes each), and
+ *    the window as a raw deflate stream
+ *
+ * @param index The index.
+ * @param filename The compressed file the index belongs to.
+ *
+ * @returns STATUS* The result. Must be freed.
+ */
+extern STATUS* saveAccessIndex(const ACCESS_INDEX* index, const char* filename) {
+    STATUS* status = initSTATUS();
+    status->code = DECOMPRESS_SUCCESS;
+    createSTATUSMessage(status, "Index saved!");
+
+    char* path = indexPath(filename);
+    FILE* file = path != NULL ? fopen(path, "wb") : NULL;
+    free(path);
+    if (file == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open the index file!");
+        return status;
+    }
+
+    fwrite(ACCESS_INDEX_MAGIC, 1, 8, file);
+    writeLittleEndian(file, (uint64_t) index->format, 4);
+    writeLittleEndian(file, index->span, 8);
+    writeLittleEndian(file, index->compressedSize, 8);
+    writeLittleEndian(file, index->totalOutput, 8);
+    writeLittleEndian(file, index->count, 8);
+    for (size_t i = 0; i < index->count; i++) {
+        const ACCESS_POINT* point = &index->points[i];
+        writeLittleEndian(file, point->outputOffset, 8);
+        writeLittleEndian(file, point->bitOffset, 8);
+        writeLittleEndian(file, point->windowLength, 4);
+        writeLittleEndian(file, point->compressedLength, 4);
+        fwrite(point->window, 1, point->compressedLength, file);
+    }
+    if (ferror(file)) {
+        status->code = COMPRESSION_FAILED;
+        createSTATUSMessage(status, "Can\'t write the index file!");
+    }
+    fclose(file);
+    return status;
+}
+
+/**
+ * @brief Load Access Index
+ *
+ * Reads the sidecar index of a compressed file written by saveAccessIndex.
+ *
+ * @param filename The compressed file the index belongs to.
+ * @param result Output: the index OR NULL on error. Must be freed with freeACCESS_INDEX.
+ *
+ * @returns STATUS* The result, CANT_OPEN_FILE if there is no index. Must be freed.
+ */
+extern STATUS* loadAccessIndex(const char* filename, ACCESS_INDEX** result) {
+    *result = NULL;
+    STATUS* status = initSTATUS();
+    status->code = DECOMPRESS_SUCCESS;
+    createSTATUSMessage(status, "Index loaded!");
+
+    char* path = indexPath(filename);
+    FILE* file = path != NULL ? fopen(path, "rb") : NULL;
+    free(path);
+    if (file == NULL) {
+        status->code = CANT_OPEN_FILE;
+        createSTATUSMessage(status, "Can\'t open the index file!");
+        return status;
+    }
+
+    char magic[8];
+    uint64_t format = 0;
+    uint64_t count = 0;
+    ACCESS_INDEX* index = (ACCESS_INDEX*) calloc(1, sizeof(ACCESS_INDEX));
+    bool valid = index != NULL && fread(magic, 1, 8, file) == 8 && memcmp(magic, ACCESS_INDEX_MAGIC, 8) == 0 &&
+                 readLittleEndian(file, &format, 4) && format <= CONTAINER_RAW &&
+                 readLittleEndian(file, &index->span, 8) && readLittleEndian(file, &index->compressedSize, 8) &&
+                 readLittleEndian(file, &index->totalOutput, 8) && readLittleEndian(file, &count, 8) && count > 0;
+    if (valid) {
+        index->format = (CONTAINER_FORMAT) format;
+        index->points = (ACCESS_POINT*) calloc((size_t) count, sizeof(ACCESS_POINT));
+        index->capacity = (size_t) count;
+        valid = index->points != NULL;
+    }
+    for (uint64_t i = 0; valid && i < count; i++) {
+        ACCESS_POINT* point = &index->points[i];
+        uint64_t windowLength = 0;
+        uint64_t compressedLength = 0;
+        valid = readLittleEndian(file, &point->outputOffset, 8) && readLittleEndian(file, &point->bitOffset, 8) &&
+                readLittleEndian(file, &windowLength, 4) && readLittleEndian(file, &compressedLength, 4) &&
+                windowLength <= WINDOW_SIZE && compressedLength <= 2 * WINDOW_SIZE &&
+                (i == 0 || point->outputOffset >= index->points[i - 1].outputOffset);
+        if (valid) {
+            point->windowLength = (uint32_t) windowLength;
+            point->compressedLength = (uint32_t) compressedLength;
+            point->window = (uint8_t*) malloc(compressedLength > 0 ? compressedLength : 1);
+            valid = point->window != NULL && fread(point->window, 1, compressedLength, file) == compressedLength;
+            index->count++;
+        }
+    }
+    fclose(file);
+
+    if (!valid) {
+        freeACCESS_INDEX(index);
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "The index file is corrupt!");
+        return status;
+    }
+    *result = index;
+    return status;
+}
+
+/**
+ * @brief Index File
+ *
+ * Builds the index of a compressed file and saves it next to the file.
+ *
+ * @param filename The compressed file.
+ * @param format The container of the file.
+ * @param span Output bytes between two access points.
+ *
+ * @returns STATUS* The result. Must be freed.
+ */
+extern STATUS* indexFile(const char* filename, const CONTAINER_FORMAT format, const uint64_t span) {
+    ACCESS_INDEX* index = NULL;
+    STATUS* status = buildAccessIndex(filename, format, span, &index);
+    if (index == NULL) {
+        return status;
+    }
+    free(status->message);
+    free(status);
+
+    status = saveAccessIndex(index, filename);
+    if (status->code == DECOMPRESS_SUCCESS) {
+        char message[96];
+        snprintf(message, sizeof(message), "Indexed %llu bytes with %llu access points!",
+                 (unsigned long long) index->totalOutput, (unsigned long long) index->count);
+        createSTATUSMessage(status, message);
+    }
+    freeACCESS_INDEX(index);
+    return status;
+}
+
+/**
+ * @brief Find Access Point
+ *
+ * @returns const ACCESS_POINT* The last access point at or before the output offset.
+ */
+static const ACCESS_POINT* findAccessPoint(const ACCESS_INDEX* index, const uint64_t offset) {
+    size_t low = 0;
+    size_t high = index->count;
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
+        if (index->points[middle].outputOffset <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return &index->points[low];
+}
+
+/**
+ * @brief Embedded Access Index
+ *
+ * Turns the index of a seekable gzip file (see compressSeekable) or the blocks of a BGZF file (see loadBgzfBlocks)
+ * into access points. Nothing before a full flush point or a BGZF block is referenced, so the points need no window.
+ *
+ * @returns ACCESS_INDEX* The access points OR NULL if the file is neither. Must be freed.
+ */
+static ACCESS_INDEX* embeddedAccessIndex(const char* filename) {
+    bool memberStart = false;
+    SEEK_INDEX* seekIndex = loadSeekIndex(filename);
+    if (seekIndex == NULL) {
+        seekIndex = loadBgzfBlocks(filename);
+        memberStart = true;
+    }
+    if (seekIndex == NULL || seekIndex->count == 0) {
+        freeSEEK_INDEX(seekIndex);
+        return NULL;
+    }
+    ACCESS_INDEX* index = (ACCESS_INDEX*) calloc(1, sizeof(ACCESS_INDEX));
+    ACCESS_POINT* points = (ACCESS_POINT*) calloc(seekIndex->count, sizeof(ACCESS_POINT));
+    if (index == NULL || points == NULL) {
+        free(index);
+        free(points);
+        freeSEEK_INDEX(seekIndex);
+        return NULL;
+    }
+    for (size_t i = 0; i < seekIndex->count; i++) {
+        points[i].outputOffset = seekIndex->points[i].outputOffset;
+        points[i].bitOffset = seekIndex->points[i].compressedOffset * 8;
+        points[i].memberStart = memberStart;
+    }
+    index->format = CONTAINER_GZIP;
+    index->span = seekIndex->count > 1 ? seekIndex->points[1].outputOffset : seekIndex->totalOutput;
+    index->compressedSize = fileSize(filename);
+    index->totalOutput = seekIndex->totalOutput;
+    index->points = points;
+    index->count = seekIndex->count;
+    index->capacity = seekIndex->count;
+    freeSEEK_INDEX(seekIndex);
+    return index;
+}
+
+/**
+ * @brief Load Or Build Index
+ *
+ * Loads the sidecar index of a file, or builds (and saves) it if there is none or it belongs to another version of the
+ * file (a different size or container). A seekable gzip or BGZF file without a sidecar uses the index it carries.
+ */
+static STATUS* loadOrBuildIndex(const char* filename, const CONTAINER_FORMAT format, ACCESS_INDEX** result) {
+    STATUS* status = loadAccessIndex(filename, result);
+    if (*result != NULL && (*result)->format == format && (*result)->compressedSize == fileSize(filename)) {
+        return status;
+    }
+    freeACCESS_INDEX(*result);
+    *result = format == CONTAINER_GZIP ? embeddedAccessIndex(filename) : NULL;
+    if (*result != NULL) {
+        status->code = DECOMPRESS_SUCCESS;
+        return status;
+    }
+    free(status->message);
+    free(status);
+
+    status = buildAccessIndex(filename, format, ACCESS_DEFAULT_SPAN, result);
+    if (*result != NULL) {
+        STATUS* saved = saveAccessIndex(*result, filename); // Without a saved index the next extract builds it again
+        free(saved->message);
+        free(saved);
+    }
+    return status;
+}
+
+/**
+ * @brief Extract Range
+ *
+ * Writes the bytes [offset, offset + length) of the decompressed data, decoding only from the access point before
+ * offset (see buildAccessIndex). The index is loaded from the sidecar file, or built and saved first. Continues across
+ * gzip members. The checksums can't be checked, as only a part of each member is decoded.
+ *
+ * @param filename The compressed file.
+ * @param format The container of the file.
+ * @param offset The first byte of the decompressed data to write.
+ * @param length The number of bytes to write, less if the data ends before.
+ * @param output The file receiving the bytes (e.g. stdout), not closed.
+ *
+ * @returns STATUS* The result. Must be freed.
+ *
+ * Maximum memory required:
+ *  - the index, an INFLATE_CONTEXT and WINDOW_SIZE + ACCESS_OUTPUT_SIZE bytes of output window
+ */
+extern STATUS* extractRange(const char* filename, const CONTAINER_FORMAT format, const uint64_t offset,
+                            const uint64_t length, FILE* output) {
+    ACCESS_INDEX* index = NULL;
+    STATUS* status = loadOrBuildIndex(filename, format, &index);
+    if (index == NULL) {
+        return status;
+    }
+    status->code = DECOMPRESS_SUCCESS;
+
+    const ACCESS_POINT* point = findAccessPoint(index, offset);
+    BIT_READER* reader = init_bit_reader(filename);
+    BIT_WRITER* bw = initWindowBIT_WRITER(WINDOW_SIZE, ACCESS_OUTPUT_SIZE);
+    INFLATE_CONTEXT* context = initINFLATE_CONTEXT();
+    size_t windowLength = 0;
+    if (reader == NULL || bw == NULL || context == NULL) {
+        status->code = reader == NULL ? CANT_OPEN_FILE : CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, reader == NULL ? "Can\'t open input file!" : "Can\'t allocate memory for the extraction!");
+    } else if (!seek_bit_reader(reader, point->bitOffset) || (point->memberStart && !process_gzip_header(reader)) ||
+               (point->windowLength > 0 &&
+                (!inflateBuffer(point->window, point->compressedLength, bw->buffer + WINDOW_SIZE - point->windowLength,
+                                point->windowLength, &windowLength) || windowLength != point->windowLength))) {
+        status->code = DECOMPRESS_FAILED;
+        createSTATUSMessage(status, "The index doesn\'t match the file!");
+    }
+
+    if (status->code == DECOMPRESS_SUCCESS) {
+        // Decoding starts at the access point, the output before offset is only decoded for its history
+        bw->file = output;
+        bw->streamStart = (int64_t) (WINDOW_SIZE - windowLength); // The window of the access point can be referred to
+        bw->skipBytes = offset - point->outputOffset;
+        bw->writeLimit = length;
+        const uint64_t end = offset - point->outputOffset + length < offset - point->outputOffset
+                             ? UINT64_MAX : offset - point->outputOffset + length;
+        while (bw->totalBytes + (bw->index - bw->historySize) < end) {
+            bool final = false;
+            if (!inflateBlock(reader, bw, context, &final, status)) {
+                break;
+            }
+            if (final) {
+                // The end of the data, or the end of a gzip member followed by the next one
+                uint8_t trailer[8];
+                align_to_byte(reader);
+                if (format != CONTAINER_GZIP || read_aligned_bytes(reader, trailer, 8) != 8 || at_end_of_gzip_members(reader)) {
+                    break;
+                }
+                if (!process_gzip_header(reader)) {
+                    status->code = DECOMPRESS_FAILED;
+                    createSTATUSMessage(status, "Invalid GZIP header after the end of a member!");
+                    break;
+                }
+                startOutputStream(bw);
+            }
+        }
+        flushBIT_WRITERBuffer(bw);
+        if ((fflush(output) != 0 || bw->writeError) && status->code == DECOMPRESS_SUCCESS) {
+            status->code = DECOMPRESS_FAILED;
+            createSTATUSMessage(status, "Can\'t write the extracted data!");
+        }
+        bw->file = NULL; // The caller's file
+    }
+    if (status->code == DECOMPRESS_SUCCESS) {
+        char message[96];
+        snprintf(message, sizeof(message), "Extracted %llu bytes!", (unsigned long long) (length - bw->writeLimit));
+        createSTATUSMessage(status, message);
+    }
+
+    freeINFLATE_CONTEXT(context);
+    if (bw != NULL) freeBIT_WRITER(bw);
+    if (reader != NULL) freeBIT_READER(reader);
+    freeACCESS_INDEX(index);
+    return status;
+}
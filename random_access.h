@@ -0,0 +1,55 @@
+//
+// Created by Attila on 12/19/2025.
+//
+
+#ifndef DEFLATE_RANDOM_ACCESS_H
+#define DEFLATE_RANDOM_ACCESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "container.h"
+#include "status.h"
+
+#define ACCESS_INDEX_EXTENSION "idx" // The sidecar index of "data.gz" is "data.gz.idx"
+#define ACCESS_DEFAULT_SPAN (1024 * 1024) // Output bytes between two access points
+
+/**
+ * @brief A block boundary of the compressed file where decoding can start (a zran checkpoint).
+ */
+typedef struct {
+    uint64_t outputOffset;      ///< Position of the boundary in the decompressed data.
+    uint64_t bitOffset;         ///< Position of the boundary in the compressed file.
+    uint32_t windowLength;      ///< Bytes of decompressed data before the boundary kept as the window (at most 32 KB).
+    uint32_t compressedLength;  ///< Size of the window as a raw deflate stream.
+    uint8_t* window;            ///< The window as a raw deflate stream.
+    bool memberStart;           ///< bitOffset is the start of a gzip member (a BGZF block), not of a deflate block.
+} ACCESS_POINT;
+
+/**
+ * @brief The access points of one compressed file, saved next to it as a sidecar file.
+ */
+typedef struct {
+    CONTAINER_FORMAT format;
+    uint64_t span;              ///< Requested output bytes between two access points.
+    uint64_t compressedSize;    ///< Size of the compressed file, an index of another size belongs to another file.
+    uint64_t totalOutput;       ///< Size of the decompressed data.
+    ACCESS_POINT* points;       ///< Ordered by outputOffset, the first one is the start of the data.
+    size_t count;
+    size_t capacity;
+} ACCESS_INDEX;
+
+extern void freeACCESS_INDEX(ACCESS_INDEX* index);
+
+extern STATUS* buildAccessIndex(const char* filename, CONTAINER_FORMAT format, uint64_t span, ACCESS_INDEX** result);
+
+extern STATUS* saveAccessIndex(const ACCESS_INDEX* index, const char* filename);
+
+extern STATUS* loadAccessIndex(const char* filename, ACCESS_INDEX** result);
+
+extern STATUS* indexFile(const char* filename, CONTAINER_FORMAT format, uint64_t span);
+
+extern STATUS* extractRange(const char* filename, CONTAINER_FORMAT format, uint64_t offset, uint64_t length, FILE* output);
+
+#endif //DEFLATE_RANDOM_ACCESS_H
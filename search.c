@@ -0,0 +1,417 @@
+//
+// Created by Attila on 12/22/2025.
+//
+
+#include "search.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef DEFLATE_DEBUGMALLOC
+#include "debugmalloc.h"
+#endif
+
+#include "batch.h"
+#include "decompress.h"
+
+#define SEARCH_NO_STATE UINT32_MAX // A missing transition of the trie while the automaton is built
+
+/**
+ * @brief Free SEARCH
+ *
+ * @param search The search to free. NULL is allowed.
+ */
+extern void freeSEARCH(SEARCH* search) {
+    if (search == NULL) {
+        return;
+    }
+    free(search->next);
+    free(search->accepting);
+    free(search->line);
+    free(search);
+}
+
+/**
+ * @brief Build Automaton
+ *
+ * Turns the trie of the patterns into a DFA: every missing transition of a state is taken from its failure state (the
+ * state of its longest proper suffix in the trie), in breadth first order so the failure state is always complete.
+ *
+ * @param search The search holding the trie.
+ *
+ * @returns bool false if the memory ran out.
+ */
+static bool buildAutomaton(SEARCH* search) {
+    uint32_t* failure = (uint32_t*) malloc(search->stateCount * sizeof(uint32_t));
+    uint32_t* queue = (uint32_t*) malloc(search->stateCount * sizeof(uint32_t));
+    if (failure == NULL || queue == NULL) {
+        free(failure);
+        free(queue);
+        return false;
+    }
+
+    size_t head = 0;
+    size_t tail = 0;
+    for (int c = 0; c < 256; c++) {
+        const uint32_t child = search->next[c];
+        if (child == SEARCH_NO_STATE) {
+            search->next[c] = 0;
+        } else {
+            failure[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        const uint32_t state = queue[head++];
+        // A pattern ending in the failure state ends here as well
+        search->accepting[state] = search->accepting[state] || search->accepting[failure[state]];
+        uint32_t* transitions = search->next + (size_t) state * 256;
+        const uint32_t* fallback = search->next + (size_t) failure[state] * 256;
+        for (int c = 0; c < 256; c++) {
+            if (transitions[c] == SEARCH_NO_STATE) {
+                transitions[c] = fallback[c];
+            } else {
+                failure[transitions[c]] = fallback[c];
+                queue[tail++] = transitions[c];
+            }
+        }
+    }
+    free(failure);
+    free(queue);
+    return true;
+}
+
+/**
+ * @brief Initialize SEARCH
+ *
+ * Builds the Aho-Corasick automaton of the patterns and collects their first bytes for the prefilter.
+ *
+ * @param patterns The literal patterns, not empty and without a newline (a match never spans two lines).
+ * @param patternCount The number of patterns (at least 1).
+ * @param output Where the matching lines are printed.
+ *
+ * @returns SEARCH* The search OR NULL if a pattern is invalid or the memory ran out. Must be freed with freeSEARCH.
+ *
+ * Maximum memory required:
+ *  - sizeof(SEARCH) + SEARCH_MAX_LINE + (the total length of the patterns + 1) * 1029 bytes
+ */
+extern SEARCH* initSEARCH(const char* const* patterns, const size_t patternCount, FILE* output) {
+    size_t states = 1;
+    for (size_t p = 0; p < patternCount; p++) {
+        const size_t length = strlen(patterns[p]);
+        if (length == 0 || memchr(patterns[p], '\n', length) != NULL) {
+            return NULL;
+        }
+        states += length;
+    }
+    if (patternCount == 0 || states > UINT32_MAX / 256) {
+        return NULL;
+    }
+
+    SEARCH* search = (SEARCH*) calloc(1, sizeof(SEARCH));
+    if (search == NULL) {
+        return NULL;
+    }
+    search->next = (uint32_t*) malloc(states * 256 * sizeof(uint32_t));
+    search->accepting = (bool*) calloc(states, sizeof(bool));
+    search->line = (uint8_t*) malloc(SEARCH_MAX_LINE);
+    if (search->next == NULL || search->accepting == NULL || search->line == NULL) {
+        freeSEARCH(search);
+        return NULL;
+    }
+    memset(search->next, 0xFF, states * 256 * sizeof(uint32_t)); // SEARCH_NO_STATE everywhere
+    search->stateCount = 1;
+    search->output = output;
+
+    for (size_t p = 0; p < patternCount; p++) {
+        const uint8_t* pattern = (const uint8_t*) patterns[p];
+        uint32_t state = 0;
+        for (size_t i = 0; pattern[i] != '\0'; i++) {
+            uint32_t* transition = search->next + (size_t) state * 256 + pattern[i];
+            if (*transition == SEARCH_NO_STATE) {
+                *transition = search->stateCount++;
+            }
+            state = *transition;
+        }
+        search->accepting[state] = true;
+
+        if (!search->startByte[pattern[0]]) {
+            search->startByte[pattern[0]] = true;
+            if (search->startByteCount < SEARCH_PREFILTER_BYTES) {
+                search->startBytes[search->startByteCount] = pattern[0];
+            }
+            search->startByteCount++;
+        }
+    }
+    if (!buildAutomaton(search)) {
+        freeSEARCH(search);
+        return NULL;
+    }
+    return search;
+}
+
+/**
+ * @brief Skip To Candidate
+ *
+ * The prefilter: from the root only the first byte of a pattern leads anywhere, so everything else is skipped. One
+ * first byte is found with memchr, two or three by comparing 16 bytes at a time (SSE2 where available).
+ *
+ * @returns size_t The index of the next first byte of a pattern, or length if there is none.
+ */
+static size_t skipToCandidate(const SEARCH* search, const uint8_t* data, const size_t length) {
+    if (search->startByteCount == 1) {
+        const uint8_t* found = (const uint8_t*) memchr(data, search->startBytes[0], length);
+        return found != NULL ? (size_t) (found - data) : length;
+    }
+    size_t i = 0;
+#if defined(__SSE2__)
+    if (search->startByteCount <= SEARCH_PREFILTER_BYTES) {
+        const __m128i first = _mm_set1_epi8((char) search->startBytes[0]);
+        const __m128i second = _mm_set1_epi8((char) search->startBytes[1]);
+        // With only two first bytes the third comparison repeats the second one
+        const __m128i third = _mm_set1_epi8((char) search->startBytes[search->startByteCount - 1]);
+        for (; i + 16 <= length; i += 16) {
+            const __m128i bytes = _mm_loadu_si128((const __m128i*) (data + i));
+            const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, first), _mm_cmpeq_epi8(bytes, second)),
+                                              _mm_cmpeq_epi8(bytes, third));
+            const int mask = _mm_movemask_epi8(hits);
+            if (mask != 0) {
+                return i + (size_t) __builtin_ctz((unsigned) mask);
+            }
+        }
+    }
+#endif
+    while (i < length && !search->startByte[data[i]]) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * @brief Find Match End
+ *
+ * Runs the automaton over the data from the state the previous piece ended in, so a pattern split between two pieces
+ * is found as well.
+ *
+ * @returns size_t The number of bytes up to and including the end of the first match, 0 if there is no match.
+ */
+static size_t findMatchEnd(SEARCH* search, const uint8_t* data, const size_t length) {
+    const uint32_t* next = search->next;
+    const bool* accepting = search->accepting;
+    uint32_t state = search->state;
+    size_t i = 0;
+    while (i < length) {
+        if (state == 0) {
+            i += skipToCandidate(search, data + i, length - i);
+            if (i == length) {
+                break;
+            }
+        }
+        state = next[(size_t) state * 256 + data[i++]];
+        if (accepting[state]) {
+            search->state = state;
+            return i;
+        }
+    }
+    search->state = state;
+    return 0;
+}
+
+/**
+ * @brief Appends bytes to the current line, the part beyond SEARCH_MAX_LINE is dropped.
+ */
+static void appendLine(SEARCH* search, const uint8_t* data, size_t length) {
+    if (length > SEARCH_MAX_LINE - search->lineLength) {
+        length = SEARCH_MAX_LINE - search->lineLength;
+    }
+    memcpy(search->line + search->lineLength, data, length);
+    search->lineLength += length;
+}
+
+/**
+ * @brief Starts a new line at the given position of the output.
+ */
+static void startLine(SEARCH* search, const uint64_t lineStart) {
+    search->lineStart = lineStart;
+    search->lineLength = 0;
+    search->lineMatched = false;
+}
+
+/**
+ * @brief Prints the current line like grep -b: [label:]offset:line
+ */
+static void printLine(SEARCH* search) {
+    if (search->label != NULL) {
+        fprintf(search->output, "%s:", search->label);
+    }
+    fprintf(search->output, "%llu:", (unsigned long long) search->lineStart);
+    fwrite(search->line, 1, search->lineLength, search->output);
+    fputc('\n', search->output);
+    search->matches++;
+}
+
+/**
+ * @brief Returns the index after the last newline of data[from, to), or SIZE_MAX if there is none.
+ */
+static size_t findLineStart(const uint8_t* data, const size_t from, size_t to) {
+    while (to > from) {
+        if (data[--to] == '\n') {
+            return to + 1;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/**
+ * @brief Search Output
+ *
+ * An OUTPUT_SINK: searches the next piece of the decompressed stream. Lines without a match are never copied, only the
+ * unfinished line at the end of the piece is kept. Once a line matches, the rest of it is skipped to with memchr and the
+ * whole line is printed.
+ *
+ * @param search The SEARCH.
+ * @param data The next piece of the output.
+ * @param length The length of the piece.
+ */
+extern void searchOutput(void* search, const uint8_t* data, const size_t length) {
+    SEARCH* s = (SEARCH*) search;
+    size_t position = 0;
+    while (position < length) {
+        if (s->lineMatched) {
+            const uint8_t* newline = (const uint8_t*) memchr(data + position, '\n', length - position);
+            const size_t end = newline != NULL ? (size_t) (newline - data) : length;
+            appendLine(s, data + position, end - position);
+            if (newline == NULL) {
+                break;
+            }
+            printLine(s);
+            startLine(s, s->offset + end + 1);
+            s->state = 0; // No pattern holds a newline, so the automaton is back at the root after one
+            position = end + 1;
+            continue;
+        }
+
+        const size_t matchEnd = findMatchEnd(s, data + position, length - position);
+        const size_t scanEnd = matchEnd != 0 ? position + matchEnd : length;
+        const size_t lineStart = findLineStart(data, position, scanEnd);
+        if (lineStart != SIZE_MAX) {
+            startLine(s, s->offset + lineStart);
+            position = lineStart;
+        }
+        appendLine(s, data + position, scanEnd - position);
+        s->lineMatched = matchEnd != 0;
+        position = scanEnd;
+    }
+    s->offset += length;
+}
+
+/**
+ * @brief Search File
+ *
+ * Prints the lines of the decompressed data of a file holding any pattern, with their offsets in the decompressed
+ * data. The output is searched piece by piece as it is decoded (see scanWithContext), it is never written anywhere.
+ *
+ * @param search The search from initSEARCH, may be reused for several files.
+ * @param filename The compressed file.
+ * @param format The container of the file.
+ * @param limits The caps on decompressing the file, NULL for none.
+ * @param label NULL, or the name printed before every line.
+ *
+ * @returns STATUS* DECOMPRESS_SUCCESS if the whole file was searched and its checksums match. Must be freed.
+ */
+extern STATUS* searchFile(SEARCH* search, const char* filename, const CONTAINER_FORMAT format,
+                          const INFLATE_LIMITS* limits, const char* label) {
+    INFLATE_CONTEXT* context = initINFLATE_CONTEXT();
+    if (context == NULL) {
+        STATUS* status = initSTATUS();
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the inflate context!");
+        return status;
+    }
+    if (limits != NULL) {
+        context->limits = *limits;
+    }
+    search->label = label;
+    search->state = 0;
+    search->offset = 0;
+    startLine(search, 0);
+
+    STATUS* status = scanWithContext(context, filename, format, searchOutput, search);
+    if (search->lineMatched) {
+        printLine(search); // The last line has no newline
+    }
+    freeINFLATE_CONTEXT(context);
+    return status;
+}
+
+/**
+ * @brief Search Paths
+ *
+ * Searches the given compressed files, directories recursively (only the files with the container's extension), one
+ * after the other. With several files every line starts with the name of its file, like grep.
+ *
+ * @param patterns The literal patterns (see initSEARCH).
+ * @param patternCount The number of patterns.
+ * @param paths The files and directories.
+ * @param pathCount The number of paths.
+ * @param format The container of the files.
+ * @param limits The caps on decompressing every file, NULL for none.
+ * @param output Where the matching lines are printed.
+ *
+ * @returns STATUS* DECOMPRESS_SUCCESS if every file was searched. Must be freed.
+ */
+extern STATUS* searchPaths(const char* const* patterns, const size_t patternCount, char** paths, const size_t pathCount,
+                           const CONTAINER_FORMAT format, const INFLATE_LIMITS* limits, FILE* output) {
+    STATUS* status = initSTATUS();
+    SEARCH* search = initSEARCH(patterns, patternCount, output);
+    if (search == NULL) {
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the search!");
+        return status;
+    }
+    BATCH_LIST* list = initBATCH_LIST();
+    bool collected = list != NULL;
+    for (size_t i = 0; collected && i < pathCount; i++) {
+        collected = addBatchPath(list, paths[i], false, format);
+    }
+    if (!collected) {
+        freeBATCH_LIST(list);
+        freeSEARCH(search);
+        status->code = CANT_ALLOCATE_MEMORY;
+        createSTATUSMessage(status, "Can\'t allocate memory for the file list!");
+        return status;
+    }
+
+    const bool labeled = list->count > 1;
+    size_t failed = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        const char* path = list->files[i].path;
+        STATUS* fileStatus = searchFile(search, path, format, limits, labeled ? path : NULL);
+        if (fileStatus->code != DECOMPRESS_SUCCESS) {
+            fflush(output);
+            fprintf(stderr, "%s: %s\n", path, fileStatus->message != NULL ? fileStatus->message : "failed");
+            failed++;
+        }
+        free(fileStatus->message);
+        free(fileStatus);
+    }
+
+    char message[128];
+    if (fflush(output) != 0 || ferror(output)) {
+        status->code = DECOMPRESS_FAILED;
+        snprintf(message, sizeof(message), "Can\'t write the matching lines!");
+    } else if (failed == 0) {
+        status->code = DECOMPRESS_SUCCESS;
+        snprintf(message, sizeof(message), "Found %llu matching line(s) in %zu file(s)!",
+                 (unsigned long long) search->matches, list->count);
+    } else {
+        status->code = DECOMPRESS_FAILED;
+        snprintf(message, sizeof(message), "%zu of %zu file(s) failed!", failed, list->count);
+    }
+    createSTATUSMessage(status, message);
+    freeBATCH_LIST(list);
+    freeSEARCH(search);
+    return status;
+}
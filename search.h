@@ -0,0 +1,54 @@
+//
+// Created by Attila on 12/22/2025.
+//
+
+#ifndef DEFLATE_SEARCH_H
+#define DEFLATE_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "container.h"
+#include "decompress.h"
+#include "status.h"
+
+#define SEARCH_MAX_LINE (64 * 1024) // A longer matching line is printed cut to its first SEARCH_MAX_LINE bytes
+#define SEARCH_PREFILTER_BYTES 3    // Up to this many distinct first bytes of the patterns are skipped to with SIMD
+
+/**
+ * @brief Finds the lines of a decompressed stream holding any of several literal patterns, piece by piece as the
+ * stream is decoded (see searchOutput). The patterns are matched by an Aho-Corasick automaton.
+ */
+typedef struct {
+    uint32_t* next;             ///< The automaton as a DFA: 256 transitions per state, state 0 is the root.
+    bool* accepting;            ///< Whether a pattern ends in the state.
+    uint32_t stateCount;
+    bool startByte[256];        ///< The first bytes of the patterns, only these leave the root.
+    uint8_t startBytes[SEARCH_PREFILTER_BYTES];
+    size_t startByteCount;      ///< Distinct first bytes, the prefilter is used up to SEARCH_PREFILTER_BYTES.
+    uint32_t state;             ///< The state after the bytes searched so far.
+    uint64_t offset;            ///< Output bytes before the current piece.
+    uint64_t lineStart;         ///< Position of the current line in the output.
+    uint8_t* line;              ///< The current line so far, at most SEARCH_MAX_LINE bytes.
+    size_t lineLength;
+    bool lineMatched;           ///< A pattern was found in the current line, it is printed when it ends.
+    uint64_t matches;           ///< Matching lines printed.
+    FILE* output;
+    const char* label;          ///< NULL, or the file name printed before every line.
+} SEARCH;
+
+extern SEARCH* initSEARCH(const char* const* patterns, size_t patternCount, FILE* output);
+
+extern void freeSEARCH(SEARCH* search);
+
+extern void searchOutput(void* search, const uint8_t* data, size_t length);
+
+extern STATUS* searchFile(SEARCH* search, const char* filename, CONTAINER_FORMAT format, const INFLATE_LIMITS* limits,
+                          const char* label);
+
+extern STATUS* searchPaths(const char* const* patterns, size_t patternCount, char** paths, size_t pathCount,
+                           CONTAINER_FORMAT format, const INFLATE_LIMITS* limits, FILE* output);
+
+#endif //DEFLATE_SEARCH_H
@@ -0,0 +1,288 @@
+//
+// Created by Attila on 12/20/2025.
+//
+
+#include "seekable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef DEFLATE_DEBUGMALLOC
+#include "debugmalloc.h"
+#endif
+
+#define SEEKABLE_INDEX_ID1 'I'     // Subfield of an index member: the flush points
+#define SEEKABLE_INDEX_ID2 'X'
+#define SEEKABLE_LOCATOR_ID1 'I'   // Subfield of the locator member: where the index starts
+#define SEEKABLE_LOCATOR_ID2 'L'
+#define SEEKABLE_POINT_SIZE 16     // Compressed and output offset, 8 bytes each
+#define SEEKABLE_POINTS_PER_MEMBER 4095 // As many as fit into the 65535 byte extra field of one member
+#define SEEKABLE_MEMBER_OVERHEAD 22 // Header with XLEN (12), empty final block (2) and trailer (8) of an empty member
+#define SEEKABLE_INITIAL_CAPACITY 64
+
+/**
+ * @brief Initialize SEEK_INDEX
+ *
+ * @returns SEEK_INDEX* An empty index OR NULL. Must be freed with freeSEEK_INDEX.
+ */
+extern SEEK_INDEX* initSEEK_INDEX(void) {
+    return (SEEK_INDEX*) calloc(1, sizeof(SEEK_INDEX));
+}
+
+/**
+ * @brief Free SEEK_INDEX
+ *
+ * @param index The index to free. NULL is allowed.
+ */
+extern void freeSEEK_INDEX(SEEK_INDEX* index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->points);
+    free(index);
+}
+
+/**
+ * @brief Add Seek Point
+ *
+ * @returns bool false if the memory can't be allocated.
+ */
+extern bool addSeekPoint(SEEK_INDEX* index, const uint64_t compressedOffset, const uint64_t outputOffset) {
+    if (index->count == index->capacity) {
+        const size_t capacity = index->capacity == 0 ? SEEKABLE_INITIAL_CAPACITY : index->capacity * 2;
+        SEEK_POINT* points = (SEEK_POINT*) realloc(index->points, capacity * sizeof(SEEK_POINT));
+        if (points == NULL) {
+            return false;
+        }
+        index->points = points;
+        index->capacity = capacity;
+    }
+    index->points[index->count].compressedOffset = compressedOffset;
+    index->points[index->count].outputOffset = outputOffset;
+    index->count++;
+    return true;
+}
+
+static void storeLittleEndian(uint8_t* bytes, const uint64_t value, const int count) {
+    for (int i = 0; i < count; i++) {
+        bytes[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static uint64_t loadLittleEndian(const uint8_t* bytes, const int count) {
+    uint64_t value = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+/**
+ * @brief Write Empty Member
+ *
+ * Writes a gzip member holding no data, whose extra field is a single subfield.
+ */
+static void writeEmptyMember(BIT_WRITER* bw, uint8_t* extra, const uint8_t id1, const uint8_t id2, const uint16_t length) {
+    extra[0] = id1;
+    extra[1] = id2;
+    storeLittleEndian(extra + 2, length, 2);
+    writeGzipExtraHeader(bw, extra, (uint16_t) (length + 4));
+    addBytes(bw, 0x0003, 2); // A final fixed block with only the end of block code
+    addBytes(bw, 0, 4); // CRC32 of nothing
+    addBytes(bw, 0, 4); // ISIZE
+}
+
+/**
+ * @brief Write Seek Index
+ *
+ * Appends the index of a seekable gzip file after its data member: the flush points in the extra fields of empty gzip
+ * members (4095 points per member), then the locator, an empty member of SEEKABLE_LOCATOR_SIZE bytes holding the
+ * position of the first index member and the size of the data. Every gzip decompressor skips the extra fields and
+ * outputs nothing for the empty members, so the file stays an ordinary gzip file, while a reader knowing the format
+ * finds the index from the last SEEKABLE_LOCATOR_SIZE bytes.
+ *
+ * @param bw The BIT_WRITER of the file, after the trailer of the data member.
+ * @param index The flush points. indexOffset is set to the position of the first index member.
+ * @param totalOutput The size of the data.
+ *
+ * Maximum memory required:
+ *  - 65535 bytes for an extra field
+ */
+extern void writeSeekIndex(BIT_WRITER* bw, SEEK_INDEX* index, const uint64_t totalOutput) {
+    uint8_t* extra = (uint8_t*) malloc(4 + SEEKABLE_POINTS_PER_MEMBER * SEEKABLE_POINT_SIZE);
+    if (extra == NULL) {
+        return; // Still a valid gzip file, only without its index
+    }
+    flushBitstreamWriter(bw);
+    index->indexOffset = bw->totalBytes + bw->index;
+    index->totalOutput = totalOutput;
+
+    for (size_t first = 0; first < index->count; first += SEEKABLE_POINTS_PER_MEMBER) {
+        const size_t count = index->count - first < SEEKABLE_POINTS_PER_MEMBER ? index->count - first : SEEKABLE_POINTS_PER_MEMBER;
+        for (size_t i = 0; i < count; i++) {
+            uint8_t* entry = extra + 4 + i * SEEKABLE_POINT_SIZE;
+            storeLittleEndian(entry, index->points[first + i].compressedOffset, 8);
+            storeLittleEndian(entry + 8, index->points[first + i].outputOffset, 8);
+        }
+        writeEmptyMember(bw, extra, SEEKABLE_INDEX_ID1, SEEKABLE_INDEX_ID2, (uint16_t) (count * SEEKABLE_POINT_SIZE));
+    }
+
+    storeLittleEndian(extra + 4, index->indexOffset, 8);
+    storeLittleEndian(extra + 12, totalOutput, 8);
+    writeEmptyMember(bw, extra, SEEKABLE_LOCATOR_ID1, SEEKABLE_LOCATOR_ID2, 16);
+    free(extra);
+}
+
+/**
+ * @brief Read Empty Member
+ *
+ * Checks that the bytes are an empty gzip member with a single subfield of the given id.
+ *
+ * @returns size_t The size of the member OR 0 if it isn't one. *payload and *length describe the subfield data.
+ */
+static size_t readEmptyMember(const uint8_t* bytes, const size_t size, const uint8_t id1, const uint8_t id2,
+                              const uint8_t** payload, size_t* length) {
+    static const uint8_t ending[10] = {0x03, 0x00, 0, 0, 0, 0, 0, 0, 0, 0};
+    if (size < SEEKABLE_MEMBER_OVERHEAD + 4 || bytes[0] != 0x1F || bytes[1] != 0x8B || bytes[2] != 0x08 || bytes[3] != 0x04) {
+        return 0;
+    }
+    const size_t xlen = (size_t) loadLittleEndian(bytes + 10, 2);
+    const size_t memberSize = SEEKABLE_MEMBER_OVERHEAD + xlen;
+    if (xlen < 4 || memberSize > size || bytes[12] != id1 || bytes[13] != id2 ||
+        loadLittleEndian(bytes + 14, 2) != xlen - 4 || memcmp(bytes + 12 + xlen, ending, sizeof(ending)) != 0) {
+        return 0;
+    }
+    *payload = bytes + 16;
+    *length = xlen - 4;
+    return memberSize;
+}
+
+/**
+ * @brief Parse Seek Index
+ *
+ * @param members The bytes of the file from the first index member to the locator.
+ * @param size The number of bytes.
+ * @param indexOffset The position of members in the file.
+ * @param totalOutput The size of the data, from the locator.
+ *
+ * @returns SEEK_INDEX* The index OR NULL if the members are not a valid index.
+ */
+static SEEK_INDEX* parseSeekIndex(const uint8_t* members, const size_t size, const uint64_t indexOffset,
+                                  const uint64_t totalOutput) {
+    SEEK_INDEX* index = initSEEK_INDEX();
+    if (index == NULL) {
+        return NULL;
+    }
+    index->indexOffset = indexOffset;
+    index->totalOutput = totalOutput;
+    size_t position = 0;
+    bool valid = true;
+    while (valid && position < size) {
+        const uint8_t* payload = NULL;
+        size_t length = 0;
+        const size_t memberSize = readEmptyMember(members + position, size - position, SEEKABLE_INDEX_ID1,
+                                                  SEEKABLE_INDEX_ID2, &payload, &length);
+        valid = memberSize > 0 && length % SEEKABLE_POINT_SIZE == 0;
+        for (size_t i = 0; valid && i < length; i += SEEKABLE_POINT_SIZE) {
+            const uint64_t compressedOffset = loadLittleEndian(payload + i, 8);
+            const uint64_t outputOffset = loadLittleEndian(payload + i + 8, 8);
+            const SEEK_POINT* last = index->count > 0 ? &index->points[index->count - 1] : NULL;
+            // The points are strictly ordered and inside the data member
+            valid = compressedOffset < indexOffset && outputOffset <= totalOutput &&
+                    (last == NULL || (compressedOffset > last->compressedOffset && outputOffset > last->outputOffset)) &&
+                    addSeekPoint(index, compressedOffset, outputOffset);
+        }
+        position += memberSize;
+    }
+    if (!valid) {
+        freeSEEK_INDEX(index);
+        return NULL;
+    }
+    return index;
+}
+
+/**
+ * @brief Read Locator
+ *
+ * @returns bool false if the last SEEKABLE_LOCATOR_SIZE bytes of a file of the given size are not a locator.
+ */
+static bool readLocator(const uint8_t* tail, const uint64_t size, uint64_t* indexOffset, uint64_t* totalOutput) {
+    const uint8_t* payload = NULL;
+    size_t length = 0;
+    if (readEmptyMember(tail, SEEKABLE_LOCATOR_SIZE, SEEKABLE_LOCATOR_ID1, SEEKABLE_LOCATOR_ID2, &payload, &length)
+        != SEEKABLE_LOCATOR_SIZE || length != 16) {
+        return false;
+    }
+    *indexOffset = loadLittleEndian(payload, 8);
+    *totalOutput = loadLittleEndian(payload + 8, 8);
+    return *indexOffset < size - SEEKABLE_LOCATOR_SIZE;
+}
+
+/**
+ * @brief Read Seek Index
+ *
+ * Finds the index of a seekable gzip file (see writeSeekIndex) held in memory.
+ *
+ * @param data The whole compressed file.
+ * @param size The size of the file.
+ *
+ * @returns SEEK_INDEX* The index OR NULL if the file has none. Must be freed with freeSEEK_INDEX.
+ */
+extern SEEK_INDEX* readSeekIndex(const uint8_t* data, const size_t size) {
+    uint64_t indexOffset = 0;
+    uint64_t totalOutput = 0;
+    if (size < SEEKABLE_LOCATOR_SIZE ||
+        !readLocator(data + size - SEEKABLE_LOCATOR_SIZE, size, &indexOffset, &totalOutput)) {
+        return NULL;
+    }
+    return parseSeekIndex(data + indexOffset, size - SEEKABLE_LOCATOR_SIZE - (size_t) indexOffset, indexOffset,
+                          totalOutput);
+}
+
+static bool seekFile(FILE* file, const uint64_t offset) {
+#if defined(_WIN32)
+    return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * @brief Load Seek Index
+ *
+ * Finds the index of a seekable gzip file (see writeSeekIndex), reading only the end of the file.
+ *
+ * @param filename The compressed file.
+ *
+ * @returns SEEK_INDEX* The index OR NULL if the file has none. Must be freed with freeSEEK_INDEX.
+ *
+ * Maximum memory required:
+ *  - the index members, about 16 bytes per flush point
+ */
+extern SEEK_INDEX* loadSeekIndex(const char* filename) {
+    struct stat info;
+    if (stat(filename, &info) != 0 || (uint64_t) info.st_size < SEEKABLE_LOCATOR_SIZE) {
+        return NULL;
+    }
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    const uint64_t size = (uint64_t) info.st_size;
+    uint8_t tail[SEEKABLE_LOCATOR_SIZE];
+    uint64_t indexOffset = 0;
+    uint64_t totalOutput = 0;
+    SEEK_INDEX* index = NULL;
+    if (seekFile(file, size - SEEKABLE_LOCATOR_SIZE) && fread(tail, 1, SEEKABLE_LOCATOR_SIZE, file) == SEEKABLE_LOCATOR_SIZE &&
+        readLocator(tail, size, &indexOffset, &totalOutput)) {
+        const size_t length = (size_t) (size - SEEKABLE_LOCATOR_SIZE - indexOffset);
+        uint8_t* members = (uint8_t*) malloc(length > 0 ? length : 1);
+        if (members != NULL && seekFile(file, indexOffset) && fread(members, 1, length, file) == length) {
+            index = parseSeekIndex(members, length, indexOffset, totalOutput);
+        }
+        free(members);
+    }
+    fclose(file);
+    return index;
+}
@@ -0,0 +1,48 @@
+//
+// Created by Attila on 12/20/2025.
+//
+
+#ifndef DEFLATE_SEEKABLE_H
+#define DEFLATE_SEEKABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitwriter.h"
+
+#define SEEKABLE_DEFAULT_INTERVAL (1024 * 1024) // Input bytes between two full flush points of a seekable gzip file
+#define SEEKABLE_LOCATOR_SIZE 42 // The empty gzip member closing a seekable file, which points to its index
+
+/**
+ * @brief A full flush point of a seekable gzip file: a byte aligned block boundary with no history before it.
+ */
+typedef struct {
+    uint64_t compressedOffset;  ///< Position of the first block after the flush in the compressed file.
+    uint64_t outputOffset;      ///< Position of the flush in the decompressed data.
+} SEEK_POINT;
+
+/**
+ * @brief The flush points of a seekable gzip file, stored in the extra fields of empty members at its end.
+ */
+typedef struct {
+    SEEK_POINT* points;     ///< Ordered by both offsets, the first one is the start of the data.
+    size_t count;
+    size_t capacity;
+    uint64_t totalOutput;   ///< Size of the decompressed data.
+    uint64_t indexOffset;   ///< Position of the first index member, the data member ends before it.
+} SEEK_INDEX;
+
+extern SEEK_INDEX* initSEEK_INDEX(void);
+
+extern void freeSEEK_INDEX(SEEK_INDEX* index);
+
+extern bool addSeekPoint(SEEK_INDEX* index, uint64_t compressedOffset, uint64_t outputOffset);
+
+extern void writeSeekIndex(BIT_WRITER* bw, SEEK_INDEX* index, uint64_t totalOutput);
+
+extern SEEK_INDEX* readSeekIndex(const uint8_t* data, size_t size);
+
+extern SEEK_INDEX* loadSeekIndex(const char* filename);
+
+#endif //DEFLATE_SEEKABLE_H
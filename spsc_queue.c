@@ -0,0 +1,143 @@
+//
+// Created by Attila on 12/16/2025.
+//
+
+#include "spsc_queue.h"
+
+#include <stdlib.h>
+#ifdef DEFLATE_DEBUGMALLOC
+#include "debugmalloc.h"
+#endif
+
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#error "spsc_queue.c needs the __atomic builtins of GCC or Clang"
+#endif
+
+/**
+ * @brief Initialize SPSC_QUEUE
+ *
+ * @param capacity The number of values the queue holds, rounded up to a power of two.
+ *
+ * @returns SPSC_QUEUE* The empty queue OR NULL. Must be freed with freeSPSC_QUEUE.
+ *
+ * Maximum memory required:
+ *  - 32bit systems: sizeof(SPSC_QUEUE) + 4 * capacity bytes
+ *  - 64bit systems: sizeof(SPSC_QUEUE) + 8 * capacity bytes
+ */
+extern SPSC_QUEUE* initSPSC_QUEUE(const size_t capacity) {
+    SPSC_QUEUE* queue = (SPSC_QUEUE*) malloc(sizeof(SPSC_QUEUE));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->capacity = 1;
+    while (queue->capacity < capacity) {
+        queue->capacity <<= 1;
+    }
+    queue->items = (size_t*) malloc(queue->capacity * sizeof(size_t));
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->head = 0;
+    queue->tail = 0;
+    queue->sleeping = false;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    return queue;
+}
+
+/**
+ * @brief Free SPSC_QUEUE
+ *
+ * @param queue The queue to free, no thread may use it anymore. NULL is allowed.
+ */
+extern void freeSPSC_QUEUE(SPSC_QUEUE* queue) {
+    if (queue == NULL) {
+        return;
+    }
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+    free(queue);
+}
+
+/**
+ * @brief Returns true if the side waiting on 'index' (head or tail) can go on: the other side moved it away from
+ * 'blocked', the value at which the queue is full or empty.
+ */
+static bool hasMoved(const size_t* index, const size_t blocked) {
+    return __atomic_load_n(index, __ATOMIC_SEQ_CST) != blocked;
+}
+
+/**
+ * @brief Waits until the other side moves 'index' away from 'blocked': spins SPSC_QUEUE_SPIN_COUNT times, then sleeps.
+ * 'sleeping' is set before the last check, and wakeOtherSide reads it after moving its index, with full fences on both
+ * sides, so either this side sees the move or the other side sees it sleeping and signals under the lock.
+ */
+static void waitForOtherSide(SPSC_QUEUE* queue, const size_t* index, const size_t blocked) {
+    for (unsigned spins = 0; spins < SPSC_QUEUE_SPIN_COUNT; spins++) {
+        if (LOAD_ACQUIRE(index) != blocked) {
+            return;
+        }
+    }
+    pthread_mutex_lock(&queue->lock);
+    __atomic_store_n(&queue->sleeping, true, __ATOMIC_SEQ_CST);
+    while (!hasMoved(index, blocked)) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    __atomic_store_n(&queue->sleeping, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Wakes the other side if it sleeps in waitForOtherSide. Called after publishing a new head or tail.
+ */
+static void wakeOtherSide(SPSC_QUEUE* queue) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->sleeping, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+/**
+ * @brief SPSC Push
+ *
+ * Appends a value, waiting while the queue is full. Only the producer thread may call it.
+ *
+ * @param queue The queue.
+ * @param value The value.
+ */
+extern void spscPush(SPSC_QUEUE* queue, const size_t value) {
+    const size_t tail = queue->tail;
+    if (tail - LOAD_ACQUIRE(&queue->head) == queue->capacity) {
+        waitForOtherSide(queue, &queue->head, tail - queue->capacity);
+    }
+    queue->items[tail & (queue->capacity - 1)] = value;
+    STORE_RELEASE(&queue->tail, tail + 1);
+    wakeOtherSide(queue);
+}
+
+/**
+ * @brief SPSC Pop
+ *
+ * Removes the oldest value, waiting while the queue is empty. Only the consumer thread may call it.
+ *
+ * @param queue The queue.
+ *
+ * @returns size_t The value.
+ */
+extern size_t spscPop(SPSC_QUEUE* queue) {
+    const size_t head = queue->head;
+    if (LOAD_ACQUIRE(&queue->tail) == head) {
+        waitForOtherSide(queue, &queue->tail, head);
+    }
+    const size_t value = queue->items[head & (queue->capacity - 1)];
+    STORE_RELEASE(&queue->head, head + 1);
+    wakeOtherSide(queue);
+    return value;
+}
@@ -0,0 +1,46 @@
+//
+// Created by Attila on 12/16/2025.
+//
+
+#ifndef DEFLATE_SPSC_QUEUE_H
+#define DEFLATE_SPSC_QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Busy polls of a full or empty queue before the waiting thread sleeps on the condition variable
+#define SPSC_QUEUE_SPIN_COUNT 256
+
+/**
+ * @brief Bounded lock-free queue of size_t values between exactly one producer and one consumer thread.
+ *
+ * Every index is only written by one side: tail by the producer, head by the consumer. The slot written before tail is
+ * published (release) is visible to the consumer once it sees the new tail (acquire), and the other way around.
+ * head and tail run freely, the slot of a value is index & (capacity - 1).
+ *
+ * A side finding the queue full or empty spins briefly, then sleeps on 'changed' with 'sleeping' set. The other side
+ * only takes the lock to wake it when 'sleeping' is set, so a queue which is never waited on never locks.
+ */
+typedef struct {
+    size_t* items;
+    size_t capacity;        ///< A power of two.
+    char padding0[64];
+    size_t head;            ///< Next value to pop, written by the consumer only.
+    char padding1[64];
+    size_t tail;            ///< Next free slot, written by the producer only.
+    char padding2[64];
+    bool sleeping;          ///< A side waits on changed. Only one side can wait at a time.
+    pthread_mutex_t lock;
+    pthread_cond_t changed; ///< Signalled after a push or pop while a side is sleeping.
+} SPSC_QUEUE;
+
+extern SPSC_QUEUE* initSPSC_QUEUE(size_t capacity);
+
+extern void freeSPSC_QUEUE(SPSC_QUEUE* queue);
+
+extern void spscPush(SPSC_QUEUE* queue, size_t value);
+
+extern size_t spscPop(SPSC_QUEUE* queue);
+
+#endif //DEFLATE_SPSC_QUEUE_H
@@ -14,6 +14,10 @@ typedef enum {
     CANT_ALLOCATE_MEMORY,
     DECOMPRESS_SUCCESS,
     DECOMPRESS_FAILED,
+    DECOMPRESS_CRC_MISMATCH,
+    DECOMPRESS_SIZE_MISMATCH,
+    DECOMPRESS_ADLER32_MISMATCH,
+    DECOMPRESS_LIMIT_EXCEEDED,
 } STATUS_CODE;
 
 typedef struct {
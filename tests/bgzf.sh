@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# BGZF (blocked gzip of samtools) written and read block by block on several threads, its .gzi index, and blocks
+# which lie about their size.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+make_large
+
+for input in text rand zero empty; do
+    roundtrip $input gz "--bgzf -j 3" "-j 3"
+    roundtrip $input gz "--bgzf" ""
+done
+roundtrip large gz "--bgzf -j 3" "-j 3"
+
+"$PROGRAM" -c --bgzf text > /dev/null 2>&1
+succeeds index text.gz
+[ -s text.gz.gzi ] || fail "index of a BGZF file didn't write text.gz.gzi"
+
+# Blocks whose deflate data decodes past the block size, through matches and through literals, with an ISIZE which
+# doesn't tell: the block window must not slide, the blocks are rejected
+for input in bgzf_oversized_matches bgzf_oversized_literals; do
+    cp "$DATA/$input.gz" .
+    fails "Found a corrupt BGZF block!" -t -j 2 $input.gz
+    fails "Found a corrupt BGZF block!" -d -j 2 $input.gz
+    [ -e $input ] && fail "the output of $input.gz was kept"
+done
+
+cp text blocked
+mkdir blocked.gz
+fails "Can't open output file!" -c --bgzf -j 3 blocked
+fails "BGZF is a gzip container." -c --bgzf --zlib text
+
+finish
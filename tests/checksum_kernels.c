@@ -0,0 +1,122 @@
+//
+// Created by Attila on 12/23/2025.
+//
+
+// Checks every CRC32 and Adler-32 kernel the CPU supports against a byte-wise reference: all lengths 0-4096 at all
+// offsets 0-15 of the buffer (so every head and tail alignment), from a running value that changes with the offset.
+
+#include "CRC_CHECKSUM.h"
+#include "ADLER_CHECKSUM.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_LENGTH 4096
+#define MAX_OFFSET 16
+
+/**
+ * @brief Bit-at-a-time CRC32 of one byte, straight from the definition of the polynomial.
+ */
+static uint32_t reference_crc32(uint32_t crc, uint8_t byte) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (0U - (crc & 1U)));
+    }
+    return crc;
+}
+
+/**
+ * @brief Adler-32 of one byte, both sums reduced right away (RFC 1950).
+ */
+static uint32_t reference_adler32(uint32_t adler, uint8_t byte) {
+    uint32_t s1 = adler & 0xFFFF;
+    uint32_t s2 = adler >> 16;
+    s1 = (s1 + byte) % ADLER32_MODULUS;
+    s2 = (s2 + s1) % ADLER32_MODULUS;
+    return (s2 << 16) | s1;
+}
+
+/**
+ * @brief Checks the selected CRC32 kernel on every length and offset, the reference grows one byte at a time.
+ * @returns The number of mismatches.
+ */
+static int check_crc32(const char* name, const uint8_t* buffer) {
+    int mismatches = 0;
+    for (size_t offset = 0; offset < MAX_OFFSET; offset++) {
+        const uint32_t start = CRC32_INITIAL_VALUE ^ (uint32_t) (offset * 0x9E3779B9U);
+        uint32_t expected = start;
+        for (size_t length = 0; length <= MAX_LENGTH; length++) {
+            if (length > 0) expected = reference_crc32(expected, buffer[offset + length - 1]);
+            const uint32_t actual = calculate_crc32(start, buffer + offset, length);
+            if (actual != expected && mismatches++ < 10) {
+                fprintf(stderr, "CRC32 %s: offset %zu length %zu gives %08x instead of %08x\n", name, offset, length,
+                        actual, expected);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Checks the selected Adler-32 kernel on every length and offset, the reference grows one byte at a time.
+ * @returns The number of mismatches.
+ */
+static int check_adler32(const char* name, const uint8_t* buffer) {
+    int mismatches = 0;
+    for (size_t offset = 0; offset < MAX_OFFSET; offset++) {
+        // Large sums at the start stress the deferred modulo of the vector kernels
+        const uint32_t start = offset == 0 ? ADLER32_INITIAL_VALUE
+                : (uint32_t) ((ADLER32_MODULUS - offset) << 16 | (ADLER32_MODULUS - 2 * offset));
+        uint32_t expected = start;
+        for (size_t length = 0; length <= MAX_LENGTH; length++) {
+            if (length > 0) expected = reference_adler32(expected, buffer[offset + length - 1]);
+            const uint32_t actual = calculate_adler32(start, buffer + offset, length);
+            if (actual != expected && mismatches++ < 10) {
+                fprintf(stderr, "Adler-32 %s: offset %zu length %zu gives %08x instead of %08x\n", name, offset,
+                        length, actual, expected);
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main(void) {
+    static const char* crcNames[] = {"table", "pclmul", "vpclmul"};
+    static const char* adlerNames[] = {"scalar", "ssse3", "avx2"};
+
+    // Pseudo-random bytes, then all 0xFF bytes, the worst case for the sums of Adler-32
+    static uint8_t patterns[2][MAX_OFFSET + MAX_LENGTH];
+    uint32_t state = 12345;
+    for (size_t i = 0; i < sizeof(patterns[0]); i++) {
+        state = state * 1103515245U + 12345U;
+        patterns[0][i] = (uint8_t) (state >> 16);
+    }
+    memset(patterns[1], 0xFF, sizeof(patterns[1]));
+
+    int mismatches = 0;
+    for (int kernel = CRC32_KERNEL_TABLE; kernel <= CRC32_KERNEL_VPCLMUL; kernel++) {
+        if (!select_crc32_kernel((CRC32_KERNEL) kernel)) {
+            printf("CRC32 %s: not supported, skipped\n", crcNames[kernel]);
+            continue;
+        }
+        int failed = 0;
+        for (int pattern = 0; pattern < 2; pattern++) failed += check_crc32(crcNames[kernel], patterns[pattern]);
+        printf("CRC32 %s: %s\n", crcNames[kernel], failed ? "FAILED" : "ok");
+        mismatches += failed;
+    }
+    for (int kernel = ADLER32_KERNEL_SCALAR; kernel <= ADLER32_KERNEL_AVX2; kernel++) {
+        if (!select_adler32_kernel((ADLER32_KERNEL) kernel)) {
+            printf("Adler-32 %s: not supported, skipped\n", adlerNames[kernel]);
+            continue;
+        }
+        int failed = 0;
+        for (int pattern = 0; pattern < 2; pattern++) failed += check_adler32(adlerNames[kernel], patterns[pattern]);
+        printf("Adler-32 %s: %s\n", adlerNames[kernel], failed ? "FAILED" : "ok");
+        mismatches += failed;
+    }
+
+    if (mismatches > 0) {
+        fprintf(stderr, "%d mismatch(es)!\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# Shared part of the ctest scripts, sourced by every one of them with the path of the program as $1:
+#   . "$(dirname "$0")/common.sh"
+# Each script runs in a temporary directory of its own, which is removed at the end.
+#
+
+PROGRAM=$1
+if [ -z "$PROGRAM" ] || [ ! -x "$PROGRAM" ]; then
+    echo "Usage: $0 <program>"
+    exit 2
+fi
+case $PROGRAM in
+    /*) ;;
+    *) PROGRAM=$(pwd)/$PROGRAM ;;
+esac
+DATA=$(cd "$(dirname "$0")" && pwd)/data
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/deflate-test.XXXXXX") || exit 2
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 2
+
+FAILURES=0
+
+fail() {
+    echo "FAIL: $*"
+    FAILURES=$((FAILURES + 1))
+}
+
+# succeeds <args>...: the program must exit with 0
+succeeds() {
+    output=$("$PROGRAM" "$@" 2>&1)
+    code=$?
+    if [ "$code" -ne 0 ]; then
+        fail "$* exited with $code: $output"
+        return 1
+    fi
+    return 0
+}
+
+# fails <message> <args>...: the program must exit with 1 and report exactly that message on a line of its own, so a
+# crash or an unrelated error doesn't count as the expected failure
+fails() {
+    message=$1
+    shift
+    output=$("$PROGRAM" "$@" 2>&1)
+    code=$?
+    if [ "$code" -ne 1 ]; then
+        fail "$* exited with $code instead of 1: $output"
+        return 1
+    fi
+    if ! printf '%s\n' "$output" | grep -qxF "$message"; then
+        fail "$* didn't report \"$message\": $output"
+        return 1
+    fi
+    return 0
+}
+
+# roundtrip <input> <extension> <compress options> <decompress options>: compresses, verifies and decompresses the
+# input, the data must come back unchanged
+roundtrip() {
+    input=$1
+    extension=$2
+    rm -f "$input.$extension"
+    succeeds -c $3 "$input" || return
+    mv "$input" "$input.orig"
+    succeeds -t $4 "$input.$extension"
+    succeeds -d $4 "$input.$extension"
+    cmp -s "$input" "$input.orig" || fail "$input: -c $3 / -d $4 changed the data"
+    mv "$input.orig" "$input"
+}
+
+# Inputs: compressible text, random bytes, zeros (a sparse output) and an empty file
+make_inputs() {
+    awk 'BEGIN { srand(1); for (i = 0; i < 40000; i++) printf "%d line %x of the text %d\n", i, rand() * 1e9, rand() * 1e3 }' > text
+    head -c 300000 /dev/urandom > rand
+    head -c 3000000 /dev/zero > zero
+    : > empty
+}
+
+# Text large enough for the guessed chunks of the parallel decompressor (two PARALLEL_INFLATE_CHUNK_SIZE chunks of
+# compressed data)
+make_large() {
+    awk 'BEGIN { srand(2); for (i = 0; i < 600000; i++) printf "%d entry %x %x %d\n", i, rand() * 1e9, rand() * 1e9, rand() * 1e4 }' > large
+}
+
+# finish: reports the result as the exit code of the script
+finish() {
+    if [ "$FAILURES" -ne 0 ]; then
+        echo "$FAILURES check(s) failed"
+        exit 1
+    fi
+    echo "All checks passed"
+    exit 0
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# gzip, zlib and raw deflate round trips on one thread, and the errors of the decoder: truncated and corrupt input,
+# back-references before the start of the stream, a failed write of the output.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+for input in text rand zero empty; do
+    roundtrip $input gz "" ""
+    roundtrip $input zz "--zlib" "--zlib"
+    roundtrip $input deflate "--raw" "--raw"
+done
+
+"$PROGRAM" -c text > /dev/null 2>&1
+head -c 20000 text.gz > truncated.gz
+fails "Unexpected end of the compressed data!" -d truncated.gz
+cp text.gz corrupt.gz
+printf 'corrupt-data-corrupt-data' | dd of=corrupt.gz bs=1 seek=30000 conv=notrunc 2> /dev/null
+fails "CRC32 mismatch, the decompressed data is corrupt!" -d corrupt.gz
+fails "CRC32 mismatch, the decompressed data is corrupt!" -t corrupt.gz
+
+# A match reaching before the first byte of the stream
+printf '\113\004\102\000' > far.deflate
+fails "Invalid distance too far back!" -d --raw far.deflate
+
+# A full disk while writing the output
+if [ -w /dev/full ]; then
+    ln -s /dev/full full
+    cp text.gz full.gz
+    fails "Can't write the output file!" -d full.gz
+fi
+
+finish
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# Every chunk compressed into a gzip member of its own (--independent), read back as one multi-member file.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+for input in text rand zero empty; do
+    roundtrip $input gz "--independent -j 3" ""
+    roundtrip $input gz "--independent -j 3 --chunk-size 64K" "-j 3"
+done
+
+# Zero bytes after the last member (the padding of a tape or block device) are ignored like gzip does, anything else
+# must start another member
+"$PROGRAM" -c --independent -j 3 --chunk-size 64K text > /dev/null 2>&1
+cp text.gz unpadded.gz
+for decoder in "" "-j 3"; do
+    { cat unpadded.gz; head -c 10000 /dev/zero; } > padded.gz
+    succeeds -t $decoder padded.gz
+    succeeds -d $decoder padded.gz
+    cmp -s padded text || fail "-d $decoder of a zero padded file changed the data"
+    { cat unpadded.gz; printf '\000\000garbage'; } > garbage.gz
+    fails "Invalid GZIP header after the end of a member!" -t $decoder garbage.gz
+done
+rm text.gz
+
+cp text blocked
+mkdir blocked.gz
+fails "Can't open output file!" -c --independent -j 3 blocked
+fails "Only the gzip container can hold independent members." -c --independent --zlib text
+
+finish
@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# The caps on decompressing one file (--max-output, --max-ratio, --max-time), and the removal of the partial output.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+"$PROGRAM" -c zero > /dev/null 2>&1
+"$PROGRAM" -c --bgzf -j 2 text > /dev/null 2>&1
+rm zero text
+fails "The compression ratio exceeds the ratio limit!" -d --max-ratio 10 zero.gz
+[ -e zero ] && fail "the output of a tripped limit was kept"
+fails "The decompressed data exceeds the output limit!" -d --max-output 1M zero.gz
+fails "The decompressed data exceeds the output limit!" -t --max-output 1M zero.gz
+fails "The decompressed data exceeds the output limit!" -d --max-output 1M -j 3 text.gz
+[ -e text ] && fail "the output of a tripped limit was kept"
+# Every file of a batch or a search gets the caps of its own: only the file passing them fails
+mkdir many
+cp zero.gz text.gz many/
+fails "many/zero.gz: The decompressed data exceeds the output limit!" -t --max-output 2M -j 2 many
+fails "1 of 2 file(s) failed!" -t --max-output 2M -j 2 many
+fails "many/zero.gz: The decompressed data exceeds the output limit!" search --max-output 2M line many
+succeeds search --max-output 2M line text.gz
+
+succeeds -d --max-output 4M --max-ratio 2000 --max-time 60 zero.gz
+head -c 3000000 /dev/zero | cmp -s - zero || fail "decompressing within the limits changed the data"
+
+finish
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# Several files and directories processed by the thread pool at once, and the files which fail among them.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+mkdir -p batch/nested
+cp text rand batch/
+cp zero empty batch/nested/
+succeeds -c -j 2 batch
+rm batch/text batch/rand batch/nested/zero batch/nested/empty
+succeeds -t -j 2 batch
+succeeds -d -j 2 batch
+for input in text rand zero empty; do
+    found=batch/$input
+    [ -e "$found" ] || found=batch/nested/$input
+    cmp -s "$found" $input || fail "the batch round trip changed $input"
+done
+
+# Every file of a batch gets the layout a single file gets from the same options. The headers hold the time of the
+# compression, so the sizes are compared: every layout but --pipeline changes the size of these inputs.
+mkdir layouts
+for mode in --bgzf --seekable "--flush-every 128K" "--independent --chunk-size 128K" --pipeline; do
+    cp text rand zero empty layouts/
+    succeeds -c $mode -j 2 layouts
+    for input in text rand zero empty; do
+        mv layouts/$input.gz layouts/$input.batch.gz
+        "$PROGRAM" -c $mode layouts/$input > /dev/null 2>&1
+        [ "$(wc -c < layouts/$input.gz)" -eq "$(wc -c < layouts/$input.batch.gz)" ] ||
+            fail "the batch ignored $mode for $input"
+        succeeds -t layouts/$input.batch.gz
+    done
+    rm -f layouts/*
+done
+
+cp text blocked
+mkdir blocked.gz
+fails "1 of 2 file(s) failed!" -c blocked text
+fails "blocked: Can't open output file!" -c -j 2 blocked text
+
+finish
@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# One stream compressed by several threads (-j), and an output which can't be opened or written.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+for input in text rand zero empty; do
+    roundtrip $input gz "-j 3" ""
+    roundtrip $input zz "--zlib -j 3" "--zlib"
+    roundtrip $input deflate "--raw -j 3 --chunk-size 64K" "--raw"
+done
+
+cp text blocked
+mkdir blocked.gz
+fails "Can't open output file!" -c blocked
+fails "Can't open output file!" -c -j 3 blocked
+if [ -w /dev/full ]; then
+    cp text full
+    ln -s /dev/full full.gz
+    fails "Can't write the output file!" -c full
+    fails "Can't write the output file!" -c -j 3 full
+fi
+
+finish
@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# One gzip member decoded by several threads from guessed block boundaries (-d -j), with markers for the window the
+# chunks don't know yet, and the failures of the chunks.
+#
+. "$(dirname "$0")/common.sh"
+make_large
+
+roundtrip large gz "" "-j 3"
+roundtrip large zz "--zlib" "--zlib -j 3"
+roundtrip large deflate "--raw" "--raw -j 3"
+
+"$PROGRAM" -c large > /dev/null 2>&1
+head -c 6000000 large.gz > truncated.gz
+fails "Found a corrupt block!" -d -j 3 truncated.gz
+[ -e truncated ] && fail "the output of a truncated input was kept"
+cp large.gz corrupt.gz
+printf 'corrupt-data-corrupt-data' | dd of=corrupt.gz bs=1 seek=5000000 conv=notrunc 2> /dev/null
+"$PROGRAM" -d -j 3 corrupt.gz > /dev/null 2>&1
+[ $? -eq 1 ] || fail "-d -j 3 of a corrupt input didn't fail"
+[ -e corrupt ] && fail "the output of a corrupt input was kept"
+if [ -w /dev/full ]; then
+    ln -s /dev/full full
+    cp large.gz full.gz
+    fails "Can't write the output file!" -d -j 3 full.gz
+fi
+
+finish
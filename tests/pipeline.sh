@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# The read / match / entropy code pipeline (--pipeline), with the blocks entropy coded on the calling thread or on -j
+# threads and spliced at bit offsets.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+for input in text rand zero empty; do
+    for threads in 1 3; do
+        roundtrip $input gz "--pipeline -j $threads" ""
+        roundtrip $input zz "--zlib --pipeline -j $threads" "--zlib"
+        roundtrip $input deflate "--raw --pipeline -j $threads" "--raw"
+    done
+done
+
+cp text blocked
+mkdir blocked.gz
+fails "Can't open output file!" -c --pipeline blocked
+fails "Can't open output file!" -c --pipeline -j 3 blocked
+if [ -w /dev/full ]; then
+    cp text full
+    ln -s /dev/full full.gz
+    fails "Can't write the output file!" -c --pipeline full
+    fails "Can't write the output file!" -c --pipeline -j 3 full
+fi
+
+finish
@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# The index of access points of a compressed file (index), and ranges decoded from the nearest point (extract).
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+"$PROGRAM" -c text > /dev/null 2>&1
+"$PROGRAM" -c -j 3 --independent rand > /dev/null 2>&1
+
+# Without an index extract builds one
+"$PROGRAM" extract rand.gz 100000 5000 > part 2> /dev/null || fail "extract without an index exited with $?"
+tail -c +100001 rand | head -c 5000 | cmp -s - part || fail "extract of a multi-member file returned the wrong bytes"
+
+succeeds index --span 256K text.gz
+[ -s text.gz.idx ] || fail "index didn't write text.gz.idx"
+for range in "0 100" "700000 5000" "1048570 20" "1499990 1000"; do
+    set -- $range
+    "$PROGRAM" extract text.gz $1 $2 > part 2> /dev/null || fail "extract $1 $2 exited with $?"
+    tail -c +$(($1 + 1)) text | head -c $2 | cmp -s - part || fail "extract $1 $2 returned the wrong bytes"
+done
+fails "Usage: program extract [options] <file> <offset> <length>" extract text.gz 100
+
+finish
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# Lines of the decompressed data holding any of the patterns, found while decoding (search).
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+
+"$PROGRAM" -c text > /dev/null 2>&1
+"$PROGRAM" -c --zlib text > /dev/null 2>&1
+
+found=$("$PROGRAM" search "line 1" text.gz 2> /dev/null | wc -l)
+expected=$(grep -c "line 1" text)
+[ "$found" -eq "$expected" ] || fail "search found $found lines instead of $expected"
+
+found=$("$PROGRAM" search --zlib -e "of the text 99" -e "line 123" text.zz 2> /dev/null | wc -l)
+expected=$(grep -c -e "of the text 99" -e "line 123" text)
+[ "$found" -eq "$expected" ] || fail "search with -e found $found lines instead of $expected"
+
+# Every line is printed with its offset in the decompressed data
+"$PROGRAM" search "line 2b" text.gz 2> /dev/null | head -n 20 > lines
+while IFS= read -r line; do
+    offset=${line%%:*}
+    text=${line#*:}
+    tail -c +$((offset + 1)) text | head -n 1 | grep -qxF "$text" || fail "search printed $line at the wrong offset"
+done < lines
+
+output=$("$PROGRAM" search "no such line" text.gz text.gz 2>&1)
+[ "$output" = "Found 0 matching line(s) in 2 file(s)!" ] || fail "search without a match printed: $output"
+fails "Usage: program search [options] <pattern> <file|directory>..." search "" text.gz
+
+finish
@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# gzip with full flush points and an index of them (--seekable), decoded from the flush points by -d -j.
+#
+. "$(dirname "$0")/common.sh"
+make_inputs
+make_large
+
+for input in text rand zero empty; do
+    roundtrip $input gz "--seekable --flush-every 64K -j 3" ""
+    roundtrip $input gz "--seekable --flush-every 64K" "-j 3"
+done
+roundtrip large gz "--seekable -j 3" "-j 3"
+
+cp text blocked
+mkdir blocked.gz
+fails "Can't open output file!" -c --seekable -j 3 blocked
+fails "Only the gzip container can be seekable." -c --seekable --zlib text
+
+finish
@@ -0,0 +1,23 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# Holes of a sparse input compressed as zero runs without reading them (SEEK_HOLE / SEEK_DATA).
+#
+. "$(dirname "$0")/common.sh"
+
+# Holes at the start, in the middle and at the end, data which doesn't end on a page
+truncate -s 5M holes
+awk 'BEGIN { for (i = 0; i < 3000; i++) printf "data %d\n", i }' > data
+dd if=data of=holes bs=1 seek=2000000 conv=notrunc 2> /dev/null
+cp holes all_hole
+truncate -s 0 all_hole
+truncate -s 3M all_hole
+
+for input in holes all_hole; do
+    roundtrip $input gz "" ""
+    roundtrip $input zz "--zlib" "--zlib"
+    roundtrip $input deflate "--raw" "--raw"
+done
+
+finish
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Created by Attila on 12/23/2025.
+#
+# Zero pages of the decompressed output left as holes of the file, and the failures of finishing a sparse file.
+#
+. "$(dirname "$0")/common.sh"
+
+# Zeros around data, neither aligned to a page
+head -c 1000000 /dev/zero > mixed
+awk 'BEGIN { for (i = 0; i < 3000; i++) printf "data %d\n", i }' >> mixed
+head -c 2000003 /dev/zero >> mixed
+head -c 3000000 /dev/zero > zero
+
+for input in mixed zero; do
+    roundtrip $input gz "" ""
+    roundtrip $input gz "" "-j 3"
+    roundtrip $input gz "--bgzf" "-j 3"
+done
+
+# Only where the file system has holes at all: the zeros must not take up the space of the file
+truncate -s 1M probe 2> /dev/null
+if [ -e probe ] && [ "$(du -k probe | cut -f1)" -eq 0 ]; then
+    for options in "" "--bgzf -j 3"; do
+        rm -f zero.gz
+        "$PROGRAM" -c $options zero > /dev/null 2>&1
+        rm zero
+        succeeds -d $options zero.gz
+        [ "$(du -k zero | cut -f1)" -lt 100 ] || fail "-d $options wrote the zeros of the output instead of skipping them"
+    done
+fi
+
+finish